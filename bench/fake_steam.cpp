@@ -0,0 +1,558 @@
+#include "fake_steam.h"
+
+#include <algorithm>
+#include <cstring>
+
+FakeSteamSockets &FakeSteamSockets::instance() {
+  static FakeSteamSockets *sockets = new FakeSteamSockets();
+  return *sockets;
+}
+
+SteamNetworkingMicroseconds FakeSteamSockets::now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+SteamNetworkingMessage_t *FakeSteamSockets::newMessage(int size) {
+  auto *message = new SteamNetworkingMessage_t();
+  if (size > 0) {
+    message->m_pData = new char[size];
+    message->m_pfnFreeData = [](SteamNetworkingMessage_t *done) {
+      delete[] static_cast<char *>(done->m_pData);
+    };
+  }
+  message->m_cbSize = size;
+  message->m_pfnRelease = release;
+  return message;
+}
+
+void FakeSteamSockets::release(SteamNetworkingMessage_t *message) {
+  if (message->m_usecTimeReceived != 0) {
+    FakeSteamSockets &sockets = instance();
+    std::lock_guard<std::mutex> lock(sockets.delaysMutex_);
+    if (sockets.recordDelays_) {
+      sockets.releaseDelays_.push_back(now() - message->m_usecTimeReceived);
+    }
+  }
+  if (message->m_pfnFreeData) {
+    message->m_pfnFreeData(message);
+  }
+  delete message;
+}
+
+std::pair<HSteamNetConnection, HSteamNetConnection>
+FakeSteamSockets::connectPair() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const HSteamNetConnection first = nextConn_++;
+  const HSteamNetConnection second = nextConn_++;
+  conns_[first].peer = second;
+  conns_[second].peer = first;
+  return {first, second};
+}
+
+void FakeSteamSockets::setLink(HSteamNetConnection conn, int64_t bytesPerSec,
+                               std::chrono::microseconds delay) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Conn *state = find(conn);
+  if (!state) {
+    return;
+  }
+  for (Conn *end : {state, find(state->peer)}) {
+    if (end) {
+      end->rate = bytesPerSec;
+      end->delay = delay.count();
+      if (bytesPerSec == 0) {
+        end->unsent.clear();
+        end->unsentBytes = 0;
+        end->busyUntil = 0;
+      }
+    }
+  }
+}
+
+void FakeSteamSockets::setSendBuffer(HSteamNetConnection conn, int bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto size = static_cast<std::size_t>(std::max(bytes, 0));
+  if (conn == k_HSteamNetConnection_Invalid) {
+    sendBufferBytes_ = size ? size : kDefaultSendBufferBytes;
+  } else if (Conn *state = find(conn)) {
+    state->sendBuffer = size;
+  }
+}
+
+void FakeSteamSockets::inject(HSteamNetConnection conn, const void *data,
+                              uint32 size) {
+  SteamNetworkingMessage_t *message = newMessage(static_cast<int>(size));
+  std::memcpy(message->m_pData, data, size);
+  std::lock_guard<std::mutex> lock(mutex_);
+  deliver(conn, message, now());
+}
+
+FakeSteamSockets::Stats FakeSteamSockets::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void FakeSteamSockets::recordReleaseDelays(bool on) {
+  std::lock_guard<std::mutex> lock(delaysMutex_);
+  recordDelays_ = on;
+}
+
+std::vector<int64_t> FakeSteamSockets::takeReleaseDelays() {
+  std::lock_guard<std::mutex> lock(delaysMutex_);
+  std::vector<int64_t> delays;
+  delays.swap(releaseDelays_);
+  return delays;
+}
+
+FakeSteamSockets::Conn *FakeSteamSockets::find(HSteamNetConnection conn) {
+  auto it = conns_.find(conn);
+  return it != conns_.end() ? &it->second : nullptr;
+}
+
+void FakeSteamSockets::settle(Conn &conn, SteamNetworkingMicroseconds now) {
+  while (!conn.unsent.empty() && conn.unsent.front().first <= now) {
+    conn.unsentBytes -= conn.unsent.front().second;
+    conn.unsent.pop_front();
+  }
+}
+
+EResult FakeSteamSockets::send(HSteamNetConnection conn,
+                               SteamNetworkingMessage_t *message,
+                               int64 *messageNumber) {
+  Conn *state = find(conn);
+  if (!state) {
+    release(message);
+    return k_EResultInvalidParam;
+  }
+  const SteamNetworkingMicroseconds at = now();
+  settle(*state, at);
+  const auto size = static_cast<uint32>(message->m_cbSize);
+  SteamNetworkingMicroseconds arrival = at + state->delay;
+  if (state->rate > 0) {
+    const std::size_t sendBuffer =
+        state->sendBuffer ? state->sendBuffer : sendBufferBytes_;
+    if (state->unsentBytes > 0 && state->unsentBytes + size > sendBuffer) {
+      ++stats_.refused;
+      release(message);
+      return k_EResultLimitExceeded;
+    }
+    state->busyUntil = std::max(at, state->busyUntil) +
+                       static_cast<SteamNetworkingMicroseconds>(size) *
+                           1000000 / state->rate;
+    state->unsent.emplace_back(state->busyUntil, size);
+    state->unsentBytes += size;
+    arrival = state->busyUntil + state->delay;
+  }
+  ++stats_.messagesSent;
+  stats_.bytesSent += size;
+  if (messageNumber) {
+    *messageNumber = state->nextMessageNumber;
+  }
+  ++state->nextMessageNumber;
+  // Delivered as is, so the receiver's Release() runs the sender's free
+  // callback, as Steam eventually would.
+  deliver(state->peer, message, arrival);
+  return k_EResultOK;
+}
+
+void FakeSteamSockets::deliver(HSteamNetConnection to,
+                               SteamNetworkingMessage_t *message,
+                               SteamNetworkingMicroseconds at) {
+  Conn *state = find(to);
+  if (!state) {
+    release(message);
+    return;
+  }
+  message->m_conn = to;
+  message->m_nConnUserData = state->userData;
+  message->m_usecTimeReceived = at;
+  state->inbox.push_back(Arrival{message, at});
+  if (state->group != k_HSteamNetPollGroup_Invalid) {
+    ready_[state->group].insert(to);
+  }
+}
+
+int FakeSteamSockets::take(HSteamNetConnection conn, Conn &state,
+                           SteamNetworkingMessage_t **out, int max,
+                           SteamNetworkingMicroseconds now) {
+  int count = 0;
+  while (count < max && !state.inbox.empty() && state.inbox.front().at <= now) {
+    out[count++] = state.inbox.front().message;
+    state.inbox.pop_front();
+  }
+  if (state.inbox.empty() && state.group != k_HSteamNetPollGroup_Invalid) {
+    ready_[state.group].erase(conn);
+  }
+  return count;
+}
+
+HSteamListenSocket FakeSteamSockets::CreateListenSocketIP(const SteamNetworkingIPAddr &, int, const SteamNetworkingConfigValue_t *) {
+  return k_HSteamListenSocket_Invalid;
+}
+
+HSteamNetConnection FakeSteamSockets::ConnectByIPAddress(const SteamNetworkingIPAddr &, int, const SteamNetworkingConfigValue_t *) {
+  return k_HSteamNetConnection_Invalid;
+}
+
+HSteamListenSocket FakeSteamSockets::CreateListenSocketP2P(int, int, const SteamNetworkingConfigValue_t *) {
+  return k_HSteamListenSocket_Invalid;
+}
+
+HSteamNetConnection FakeSteamSockets::ConnectP2P(const SteamNetworkingIdentity &, int, int, const SteamNetworkingConfigValue_t *) {
+  return k_HSteamNetConnection_Invalid;
+}
+
+EResult FakeSteamSockets::AcceptConnection(HSteamNetConnection conn) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return find(conn) ? k_EResultOK : k_EResultInvalidParam;
+}
+
+bool FakeSteamSockets::CloseConnection(HSteamNetConnection conn, int, const char *, bool) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Conn *state = find(conn);
+  if (!state) {
+    return false;
+  }
+  if (state->group != k_HSteamNetPollGroup_Invalid) {
+    ready_[state->group].erase(conn);
+  }
+  for (const Arrival &arrival : state->inbox) {
+    release(arrival.message);
+  }
+  conns_.erase(conn);
+  return true;
+}
+
+bool FakeSteamSockets::CloseListenSocket(HSteamListenSocket) { return false; }
+
+bool FakeSteamSockets::SetConnectionUserData(HSteamNetConnection conn, int64 userData) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Conn *state = find(conn);
+  if (!state) {
+    return false;
+  }
+  state->userData = userData;
+  return true;
+}
+
+int64 FakeSteamSockets::GetConnectionUserData(HSteamNetConnection conn) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Conn *state = find(conn);
+  return state ? state->userData : -1;
+}
+
+void FakeSteamSockets::SetConnectionName(HSteamNetConnection, const char *) {}
+
+bool FakeSteamSockets::GetConnectionName(HSteamNetConnection, char *name, int maxLen) {
+  if (name && maxLen > 0) {
+    name[0] = '\0';
+  }
+  return false;
+}
+
+EResult FakeSteamSockets::SendMessageToConnection(HSteamNetConnection conn, const void *data, uint32 size, int flags, int64 *messageNumber) {
+  SteamNetworkingMessage_t *message = newMessage(static_cast<int>(size));
+  if (size > 0) {
+    std::memcpy(message->m_pData, data, size);
+  }
+  message->m_nFlags = flags;
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.sendCalls;
+  return send(conn, message, messageNumber);
+}
+
+void FakeSteamSockets::SendMessages(int count, SteamNetworkingMessage_t *const *messages, int64 *results) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.sendCalls;
+  for (int i = 0; i < count; ++i) {
+    int64 number = 0;
+    const EResult result = send(messages[i]->m_conn, messages[i], &number);
+    if (results) {
+      results[i] = result == k_EResultOK ? number : -static_cast<int64>(result);
+    }
+  }
+}
+
+EResult FakeSteamSockets::FlushMessagesOnConnection(HSteamNetConnection conn) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return find(conn) ? k_EResultOK : k_EResultInvalidParam;
+}
+
+int FakeSteamSockets::ReceiveMessagesOnConnection(HSteamNetConnection conn, SteamNetworkingMessage_t **out, int max) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.receiveCalls;
+  Conn *state = find(conn);
+  if (!state) {
+    return -1;
+  }
+  const int count = take(conn, *state, out, max, now());
+  if (count == 0) {
+    ++stats_.emptyReceives;
+  }
+  return count;
+}
+
+bool FakeSteamSockets::GetConnectionInfo(HSteamNetConnection conn, SteamNetConnectionInfo_t *info) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Conn *state = find(conn);
+  if (!state) {
+    return false;
+  }
+  if (info) {
+    *info = SteamNetConnectionInfo_t();
+    info->m_eState = k_ESteamNetworkingConnectionState_Connected;
+    info->m_nUserData = state->userData;
+  }
+  return true;
+}
+
+EResult FakeSteamSockets::GetConnectionRealTimeStatus(HSteamNetConnection conn, SteamNetConnectionRealTimeStatus_t *status, int lanes, SteamNetConnectionRealTimeLaneStatus_t *laneStatus) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.statusCalls;
+  Conn *state = find(conn);
+  if (!state) {
+    return k_EResultNoConnection;
+  }
+  const SteamNetworkingMicroseconds at = now();
+  settle(*state, at);
+  const int rate = state->rate > 0
+                       ? static_cast<int>(std::min<int64_t>(state->rate, 1 << 30))
+                       : 1 << 30;
+  if (status) {
+    *status = SteamNetConnectionRealTimeStatus_t();
+    status->m_eState = k_ESteamNetworkingConnectionState_Connected;
+    status->m_nPing = static_cast<int>(std::max<SteamNetworkingMicroseconds>(1, 2 * state->delay / 1000));
+    status->m_flConnectionQualityLocal = 1.0f;
+    status->m_flConnectionQualityRemote = 1.0f;
+    status->m_nSendRateBytesPerSecond = rate;
+    status->m_flOutBytesPerSec = static_cast<float>(rate);
+    status->m_cbPendingReliable = static_cast<int>(state->unsentBytes);
+    status->m_usecQueueTime = state->unsent.empty() ? 0 : state->busyUntil - at;
+  }
+  for (int i = 0; laneStatus && i < lanes; ++i) {
+    laneStatus[i] = SteamNetConnectionRealTimeLaneStatus_t();
+  }
+  if (laneStatus && lanes > 0) {
+    // Lanes share one queue here.
+    laneStatus[0].m_cbPendingReliable = static_cast<int>(state->unsentBytes);
+  }
+  return k_EResultOK;
+}
+
+int FakeSteamSockets::GetDetailedConnectionStatus(HSteamNetConnection, char *, int) { return -1; }
+
+bool FakeSteamSockets::GetListenSocketAddress(HSteamListenSocket, SteamNetworkingIPAddr *) { return false; }
+
+bool FakeSteamSockets::CreateSocketPair(HSteamNetConnection *first, HSteamNetConnection *second, bool, const SteamNetworkingIdentity *, const SteamNetworkingIdentity *) {
+  const auto pair = connectPair();
+  *first = pair.first;
+  *second = pair.second;
+  return true;
+}
+
+EResult FakeSteamSockets::ConfigureConnectionLanes(HSteamNetConnection conn, int, const int *, const uint16 *) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return find(conn) ? k_EResultOK : k_EResultNoConnection;
+}
+
+bool FakeSteamSockets::GetIdentity(SteamNetworkingIdentity *) { return false; }
+
+ESteamNetworkingAvailability FakeSteamSockets::InitAuthentication() {
+  return k_ESteamNetworkingAvailability_Current;
+}
+
+ESteamNetworkingAvailability FakeSteamSockets::GetAuthenticationStatus(SteamNetAuthenticationStatus_t *) {
+  return k_ESteamNetworkingAvailability_Current;
+}
+
+HSteamNetPollGroup FakeSteamSockets::CreatePollGroup() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return nextGroup_++;
+}
+
+bool FakeSteamSockets::DestroyPollGroup(HSteamNetPollGroup group) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &entry : conns_) {
+    if (entry.second.group == group) {
+      entry.second.group = k_HSteamNetPollGroup_Invalid;
+    }
+  }
+  ready_.erase(group);
+  return true;
+}
+
+bool FakeSteamSockets::SetConnectionPollGroup(HSteamNetConnection conn, HSteamNetPollGroup group) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Conn *state = find(conn);
+  if (!state) {
+    return false;
+  }
+  if (state->group != k_HSteamNetPollGroup_Invalid) {
+    ready_[state->group].erase(conn);
+  }
+  state->group = group;
+  if (group != k_HSteamNetPollGroup_Invalid && !state->inbox.empty()) {
+    ready_[group].insert(conn);
+  }
+  return true;
+}
+
+int FakeSteamSockets::ReceiveMessagesOnPollGroup(HSteamNetPollGroup group, SteamNetworkingMessage_t **out, int max) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.receiveCalls;
+  const SteamNetworkingMicroseconds at = now();
+  int count = 0;
+  auto it = ready_.find(group);
+  if (it != ready_.end()) {
+    // take() may drop the connection from the set; step past it first.
+    for (auto conn = it->second.begin(); conn != it->second.end() && count < max;) {
+      const HSteamNetConnection id = *conn++;
+      count += take(id, conns_[id], out + count, max - count, at);
+    }
+  }
+  if (count == 0) {
+    ++stats_.emptyReceives;
+  }
+  return count;
+}
+
+bool FakeSteamSockets::ReceivedRelayAuthTicket(const void *, int, SteamDatagramRelayAuthTicket *) { return false; }
+
+int FakeSteamSockets::FindRelayAuthTicketForServer(const SteamNetworkingIdentity &, int, SteamDatagramRelayAuthTicket *) { return 0; }
+
+HSteamNetConnection FakeSteamSockets::ConnectToHostedDedicatedServer(const SteamNetworkingIdentity &, int, int, const SteamNetworkingConfigValue_t *) {
+  return k_HSteamNetConnection_Invalid;
+}
+
+uint16 FakeSteamSockets::GetHostedDedicatedServerPort() { return 0; }
+
+SteamNetworkingPOPID FakeSteamSockets::GetHostedDedicatedServerPOPID() { return 0; }
+
+EResult FakeSteamSockets::GetHostedDedicatedServerAddress(SteamDatagramHostedAddress *) { return k_EResultFail; }
+
+HSteamListenSocket FakeSteamSockets::CreateHostedDedicatedServerListenSocket(int, int, const SteamNetworkingConfigValue_t *) {
+  return k_HSteamListenSocket_Invalid;
+}
+
+EResult FakeSteamSockets::GetGameCoordinatorServerLogin(SteamDatagramGameCoordinatorServerLogin *, int *, void *) { return k_EResultFail; }
+
+HSteamNetConnection FakeSteamSockets::ConnectP2PCustomSignaling(ISteamNetworkingConnectionSignaling *, const SteamNetworkingIdentity *, int, int, const SteamNetworkingConfigValue_t *) {
+  return k_HSteamNetConnection_Invalid;
+}
+
+bool FakeSteamSockets::ReceivedP2PCustomSignal(const void *, int, ISteamNetworkingSignalingRecvContext *) { return false; }
+
+bool FakeSteamSockets::GetCertificateRequest(int *, void *, SteamNetworkingErrMsg &) { return false; }
+
+bool FakeSteamSockets::SetCertificate(const void *, int, SteamNetworkingErrMsg &) { return false; }
+
+void FakeSteamSockets::ResetIdentity(const SteamNetworkingIdentity *) {}
+
+void FakeSteamSockets::RunCallbacks() {}
+
+bool FakeSteamSockets::BeginAsyncRequestFakeIP(int) { return false; }
+
+void FakeSteamSockets::GetFakeIP(int, SteamNetworkingFakeIPResult_t *) {}
+
+HSteamListenSocket FakeSteamSockets::CreateListenSocketP2PFakeIP(int, int, const SteamNetworkingConfigValue_t *) {
+  return k_HSteamListenSocket_Invalid;
+}
+
+EResult FakeSteamSockets::GetRemoteFakeIPForConnection(HSteamNetConnection, SteamNetworkingIPAddr *) { return k_EResultFail; }
+
+ISteamNetworkingFakeUDPPort *FakeSteamSockets::CreateFakeUDPPort(int) { return nullptr; }
+
+FakeSteamUtils &FakeSteamUtils::instance() {
+  static FakeSteamUtils *utils = new FakeSteamUtils();
+  return *utils;
+}
+
+SteamNetworkingMessage_t *FakeSteamUtils::AllocateMessage(int size) {
+  return FakeSteamSockets::newMessage(size);
+}
+
+void FakeSteamUtils::InitRelayNetworkAccess() {}
+
+ESteamNetworkingAvailability FakeSteamUtils::GetRelayNetworkStatus(SteamRelayNetworkStatus_t *) {
+  return k_ESteamNetworkingAvailability_Current;
+}
+
+float FakeSteamUtils::GetLocalPingLocation(SteamNetworkPingLocation_t &) { return -1.0f; }
+
+int FakeSteamUtils::EstimatePingTimeBetweenTwoLocations(const SteamNetworkPingLocation_t &, const SteamNetworkPingLocation_t &) { return -1; }
+
+int FakeSteamUtils::EstimatePingTimeFromLocalHost(const SteamNetworkPingLocation_t &) { return -1; }
+
+void FakeSteamUtils::ConvertPingLocationToString(const SteamNetworkPingLocation_t &, char *buf, int size) {
+  if (buf && size > 0) {
+    buf[0] = '\0';
+  }
+}
+
+bool FakeSteamUtils::ParsePingLocationString(const char *, SteamNetworkPingLocation_t &) { return false; }
+
+bool FakeSteamUtils::CheckPingDataUpToDate(float) { return true; }
+
+int FakeSteamUtils::GetPingToDataCenter(SteamNetworkingPOPID, SteamNetworkingPOPID *) { return -1; }
+
+int FakeSteamUtils::GetDirectPingToPOP(SteamNetworkingPOPID) { return -1; }
+
+int FakeSteamUtils::GetPOPCount() { return 0; }
+
+int FakeSteamUtils::GetPOPList(SteamNetworkingPOPID *, int) { return 0; }
+
+SteamNetworkingMicroseconds FakeSteamUtils::GetLocalTimestamp() { return FakeSteamSockets::now(); }
+
+void FakeSteamUtils::SetDebugOutputFunction(ESteamNetworkingSocketsDebugOutputType, FSteamNetworkingSocketsDebugOutput) {}
+
+ESteamNetworkingFakeIPType FakeSteamUtils::GetIPv4FakeIPType(uint32) { return k_ESteamNetworkingFakeIPType_NotFake; }
+
+EResult FakeSteamUtils::GetRealIdentityForFakeIP(const SteamNetworkingIPAddr &, SteamNetworkingIdentity *) { return k_EResultFail; }
+
+bool FakeSteamUtils::SetConfigValue(ESteamNetworkingConfigValue value, ESteamNetworkingConfigScope scope, intptr_t object, ESteamNetworkingConfigDataType type, const void *arg) {
+  if (value == k_ESteamNetworkingConfig_SendBufferSize &&
+      type == k_ESteamNetworkingConfig_Int32 && arg) {
+    const int32 bytes = *static_cast<const int32 *>(arg);
+    if (scope == k_ESteamNetworkingConfig_Global) {
+      FakeSteamSockets::instance().setSendBuffer(k_HSteamNetConnection_Invalid, bytes);
+    } else if (scope == k_ESteamNetworkingConfig_Connection) {
+      FakeSteamSockets::instance().setSendBuffer(
+          static_cast<HSteamNetConnection>(object), bytes);
+    }
+  }
+  return true;
+}
+
+ESteamNetworkingGetConfigValueResult FakeSteamUtils::GetConfigValue(ESteamNetworkingConfigValue, ESteamNetworkingConfigScope, intptr_t, ESteamNetworkingConfigDataType *, void *, size_t *) {
+  return k_ESteamNetworkingGetConfigValue_BadValue;
+}
+
+const char *FakeSteamUtils::GetConfigValueInfo(ESteamNetworkingConfigValue, ESteamNetworkingConfigDataType *, ESteamNetworkingConfigScope *) {
+  return nullptr;
+}
+
+ESteamNetworkingConfigValue FakeSteamUtils::IterateGenericEditableConfigValues(ESteamNetworkingConfigValue, bool) {
+  return static_cast<ESteamNetworkingConfigValue>(0); // k_ESteamNetworkingConfig_Invalid
+}
+
+void FakeSteamUtils::SteamNetworkingIPAddr_ToString(const SteamNetworkingIPAddr &, char *buf, size_t size, bool) {
+  if (buf && size > 0) {
+    buf[0] = '\0';
+  }
+}
+
+bool FakeSteamUtils::SteamNetworkingIPAddr_ParseString(SteamNetworkingIPAddr *, const char *) { return false; }
+
+ESteamNetworkingFakeIPType FakeSteamUtils::SteamNetworkingIPAddr_GetFakeIPType(const SteamNetworkingIPAddr &) {
+  return k_ESteamNetworkingFakeIPType_NotFake;
+}
+
+void FakeSteamUtils::SteamNetworkingIdentity_ToString(const SteamNetworkingIdentity &, char *buf, size_t size) {
+  if (buf && size > 0) {
+    buf[0] = '\0';
+  }
+}
+
+bool FakeSteamUtils::SteamNetworkingIdentity_ParseString(SteamNetworkingIdentity *, const char *) { return false; }
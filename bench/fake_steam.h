@@ -0,0 +1,198 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+#include <isteamnetworkingsockets.h>
+#include <isteamnetworkingutils.h>
+#include <steamnetworkingtypes.h>
+
+// In-process stand-in for Steam's connection-oriented sockets, for the
+// benches in this directory. Connections come in pairs from connectPair();
+// what one end sends arrives at the other, in order. A link can be given a
+// send rate and a one-way delay: sent messages wait out their serialization
+// time at that rate (reported as pending reliable bytes, and refused with
+// k_EResultLimitExceeded once the send buffer is full, as Steam does; its
+// size follows SendBufferSize set through FakeSteamUtils) plus
+// the delay before the peer can receive them.
+//
+// There is one instance per process, and it is never destroyed: the SDK
+// declares the interface destructors without defining them.
+class FakeSteamSockets : public ISteamNetworkingSockets {
+public:
+  static FakeSteamSockets &instance();
+
+  std::pair<HSteamNetConnection, HSteamNetConnection> connectPair();
+  // Applies to both directions. A rate of 0 sends without limit, and
+  // lifting a limit that way also empties the send buffer.
+  void setLink(HSteamNetConnection conn, int64_t bytesPerSec,
+               std::chrono::microseconds delay);
+  // Where SetConfigValue(k_ESteamNetworkingConfig_SendBufferSize) lands:
+  // for one connection, or with k_HSteamNetConnection_Invalid for those
+  // that have no value of their own.
+  void setSendBuffer(HSteamNetConnection conn, int bytes);
+  // Queues a message for `conn` as if its peer had sent it over an idle,
+  // unlimited link.
+  void inject(HSteamNetConnection conn, const void *data, uint32 size);
+
+  struct Stats {
+    uint64_t messagesSent = 0;
+    uint64_t bytesSent = 0;
+    uint64_t refused = 0;     // over the send buffer
+    uint64_t sendCalls = 0;   // SendMessages and SendMessageToConnection
+    uint64_t receiveCalls = 0;
+    uint64_t emptyReceives = 0;
+    uint64_t statusCalls = 0;   // GetConnectionRealTimeStatus
+  };
+  Stats stats() const;
+
+  // While on, the time from arrival to release of every received message
+  // is kept, in microseconds, until taken.
+  void recordReleaseDelays(bool on);
+  std::vector<int64_t> takeReleaseDelays();
+
+  // Allocates a message that, like Steam's, frees its buffer and itself
+  // on Release().
+  static SteamNetworkingMessage_t *newMessage(int size);
+  static SteamNetworkingMicroseconds now();
+
+  HSteamListenSocket CreateListenSocketIP(const SteamNetworkingIPAddr &, int, const SteamNetworkingConfigValue_t *) override;
+  HSteamNetConnection ConnectByIPAddress(const SteamNetworkingIPAddr &, int, const SteamNetworkingConfigValue_t *) override;
+  HSteamListenSocket CreateListenSocketP2P(int, int, const SteamNetworkingConfigValue_t *) override;
+  HSteamNetConnection ConnectP2P(const SteamNetworkingIdentity &, int, int, const SteamNetworkingConfigValue_t *) override;
+  EResult AcceptConnection(HSteamNetConnection conn) override;
+  bool CloseConnection(HSteamNetConnection conn, int, const char *, bool) override;
+  bool CloseListenSocket(HSteamListenSocket) override;
+  bool SetConnectionUserData(HSteamNetConnection conn, int64 userData) override;
+  int64 GetConnectionUserData(HSteamNetConnection conn) override;
+  void SetConnectionName(HSteamNetConnection, const char *) override;
+  bool GetConnectionName(HSteamNetConnection, char *, int) override;
+  EResult SendMessageToConnection(HSteamNetConnection conn, const void *data, uint32 size, int flags, int64 *messageNumber) override;
+  void SendMessages(int count, SteamNetworkingMessage_t *const *messages, int64 *results) override;
+  EResult FlushMessagesOnConnection(HSteamNetConnection conn) override;
+  int ReceiveMessagesOnConnection(HSteamNetConnection conn, SteamNetworkingMessage_t **out, int max) override;
+  bool GetConnectionInfo(HSteamNetConnection conn, SteamNetConnectionInfo_t *info) override;
+  EResult GetConnectionRealTimeStatus(HSteamNetConnection conn, SteamNetConnectionRealTimeStatus_t *status, int lanes, SteamNetConnectionRealTimeLaneStatus_t *laneStatus) override;
+  int GetDetailedConnectionStatus(HSteamNetConnection, char *, int) override;
+  bool GetListenSocketAddress(HSteamListenSocket, SteamNetworkingIPAddr *) override;
+  bool CreateSocketPair(HSteamNetConnection *first, HSteamNetConnection *second, bool, const SteamNetworkingIdentity *, const SteamNetworkingIdentity *) override;
+  EResult ConfigureConnectionLanes(HSteamNetConnection conn, int, const int *, const uint16 *) override;
+  bool GetIdentity(SteamNetworkingIdentity *) override;
+  ESteamNetworkingAvailability InitAuthentication() override;
+  ESteamNetworkingAvailability GetAuthenticationStatus(SteamNetAuthenticationStatus_t *) override;
+  HSteamNetPollGroup CreatePollGroup() override;
+  bool DestroyPollGroup(HSteamNetPollGroup group) override;
+  bool SetConnectionPollGroup(HSteamNetConnection conn, HSteamNetPollGroup group) override;
+  int ReceiveMessagesOnPollGroup(HSteamNetPollGroup group, SteamNetworkingMessage_t **out, int max) override;
+  bool ReceivedRelayAuthTicket(const void *, int, SteamDatagramRelayAuthTicket *) override;
+  int FindRelayAuthTicketForServer(const SteamNetworkingIdentity &, int, SteamDatagramRelayAuthTicket *) override;
+  HSteamNetConnection ConnectToHostedDedicatedServer(const SteamNetworkingIdentity &, int, int, const SteamNetworkingConfigValue_t *) override;
+  uint16 GetHostedDedicatedServerPort() override;
+  SteamNetworkingPOPID GetHostedDedicatedServerPOPID() override;
+  EResult GetHostedDedicatedServerAddress(SteamDatagramHostedAddress *) override;
+  HSteamListenSocket CreateHostedDedicatedServerListenSocket(int, int, const SteamNetworkingConfigValue_t *) override;
+  EResult GetGameCoordinatorServerLogin(SteamDatagramGameCoordinatorServerLogin *, int *, void *) override;
+  HSteamNetConnection ConnectP2PCustomSignaling(ISteamNetworkingConnectionSignaling *, const SteamNetworkingIdentity *, int, int, const SteamNetworkingConfigValue_t *) override;
+  bool ReceivedP2PCustomSignal(const void *, int, ISteamNetworkingSignalingRecvContext *) override;
+  bool GetCertificateRequest(int *, void *, SteamNetworkingErrMsg &) override;
+  bool SetCertificate(const void *, int, SteamNetworkingErrMsg &) override;
+  void ResetIdentity(const SteamNetworkingIdentity *) override;
+  void RunCallbacks() override;
+  bool BeginAsyncRequestFakeIP(int) override;
+  void GetFakeIP(int, SteamNetworkingFakeIPResult_t *) override;
+  HSteamListenSocket CreateListenSocketP2PFakeIP(int, int, const SteamNetworkingConfigValue_t *) override;
+  EResult GetRemoteFakeIPForConnection(HSteamNetConnection, SteamNetworkingIPAddr *) override;
+  ISteamNetworkingFakeUDPPort *CreateFakeUDPPort(int) override;
+
+private:
+  // Steam's default SendBufferSize.
+  static constexpr std::size_t kDefaultSendBufferBytes = 512 * 1024;
+
+  struct Arrival {
+    SteamNetworkingMessage_t *message;
+    SteamNetworkingMicroseconds at;
+  };
+  struct Conn {
+    HSteamNetConnection peer = k_HSteamNetConnection_Invalid;
+    HSteamNetPollGroup group = k_HSteamNetPollGroup_Invalid;
+    int64 userData = -1;
+    std::size_t sendBuffer = 0; // 0: the global value
+    int64_t rate = 0;
+    SteamNetworkingMicroseconds delay = 0;
+    SteamNetworkingMicroseconds busyUntil = 0; // end of the last serialization
+    // Sent and not yet serialized: (time it will be, bytes).
+    std::deque<std::pair<SteamNetworkingMicroseconds, uint32>> unsent;
+    std::size_t unsentBytes = 0;
+    std::deque<Arrival> inbox;
+    int64 nextMessageNumber = 1;
+  };
+
+  FakeSteamSockets() = default;
+
+  // The rest run with mutex_ held.
+  Conn *find(HSteamNetConnection conn);
+  void settle(Conn &conn, SteamNetworkingMicroseconds now);
+  EResult send(HSteamNetConnection conn, SteamNetworkingMessage_t *message,
+               int64 *messageNumber);
+  void deliver(HSteamNetConnection to, SteamNetworkingMessage_t *message,
+               SteamNetworkingMicroseconds at);
+  int take(HSteamNetConnection conn, Conn &state, SteamNetworkingMessage_t **out,
+           int max, SteamNetworkingMicroseconds now);
+  static void release(SteamNetworkingMessage_t *message);
+
+  mutable std::mutex mutex_;
+  std::map<HSteamNetConnection, Conn> conns_;
+  HSteamNetConnection nextConn_ = 1;
+  HSteamNetPollGroup nextGroup_ = 1;
+  std::size_t sendBufferBytes_ = kDefaultSendBufferBytes;
+  // Grouped connections with messages waiting, per poll group.
+  std::map<HSteamNetPollGroup, std::set<HSteamNetConnection>> ready_;
+  Stats stats_;
+  std::mutex delaysMutex_;
+  bool recordDelays_ = false;
+  std::vector<int64_t> releaseDelays_;
+};
+
+// Stand-in for the utilities the tunnel uses: message allocation and
+// config values (SendBufferSize is passed to the sockets, the rest accepted
+// and ignored). Never destroyed, like the sockets.
+class FakeSteamUtils : public ISteamNetworkingUtils {
+public:
+  static FakeSteamUtils &instance();
+
+  SteamNetworkingMessage_t *AllocateMessage(int size) override;
+  void InitRelayNetworkAccess() override;
+  ESteamNetworkingAvailability GetRelayNetworkStatus(SteamRelayNetworkStatus_t *) override;
+  float GetLocalPingLocation(SteamNetworkPingLocation_t &) override;
+  int EstimatePingTimeBetweenTwoLocations(const SteamNetworkPingLocation_t &, const SteamNetworkPingLocation_t &) override;
+  int EstimatePingTimeFromLocalHost(const SteamNetworkPingLocation_t &) override;
+  void ConvertPingLocationToString(const SteamNetworkPingLocation_t &, char *buf, int size) override;
+  bool ParsePingLocationString(const char *, SteamNetworkPingLocation_t &) override;
+  bool CheckPingDataUpToDate(float) override;
+  int GetPingToDataCenter(SteamNetworkingPOPID, SteamNetworkingPOPID *) override;
+  int GetDirectPingToPOP(SteamNetworkingPOPID) override;
+  int GetPOPCount() override;
+  int GetPOPList(SteamNetworkingPOPID *, int) override;
+  SteamNetworkingMicroseconds GetLocalTimestamp() override;
+  void SetDebugOutputFunction(ESteamNetworkingSocketsDebugOutputType, FSteamNetworkingSocketsDebugOutput) override;
+  ESteamNetworkingFakeIPType GetIPv4FakeIPType(uint32) override;
+  EResult GetRealIdentityForFakeIP(const SteamNetworkingIPAddr &, SteamNetworkingIdentity *) override;
+  bool SetConfigValue(ESteamNetworkingConfigValue, ESteamNetworkingConfigScope, intptr_t, ESteamNetworkingConfigDataType, const void *) override;
+  ESteamNetworkingGetConfigValueResult GetConfigValue(ESteamNetworkingConfigValue, ESteamNetworkingConfigScope, intptr_t, ESteamNetworkingConfigDataType *, void *, size_t *) override;
+  const char *GetConfigValueInfo(ESteamNetworkingConfigValue, ESteamNetworkingConfigDataType *, ESteamNetworkingConfigScope *) override;
+  ESteamNetworkingConfigValue IterateGenericEditableConfigValues(ESteamNetworkingConfigValue, bool) override;
+  void SteamNetworkingIPAddr_ToString(const SteamNetworkingIPAddr &, char *buf, size_t size, bool) override;
+  bool SteamNetworkingIPAddr_ParseString(SteamNetworkingIPAddr *, const char *) override;
+  ESteamNetworkingFakeIPType SteamNetworkingIPAddr_GetFakeIPType(const SteamNetworkingIPAddr &) override;
+  void SteamNetworkingIdentity_ToString(const SteamNetworkingIdentity &, char *buf, size_t size) override;
+  bool SteamNetworkingIdentity_ParseString(SteamNetworkingIdentity *, const char *) override;
+
+private:
+  FakeSteamUtils() = default;
+};
@@ -0,0 +1,149 @@
+// Receive path: SteamMessageHandler draining host connections through its
+// poll group, against the stand-in transport.
+//
+//   bench_poll_latency [connections=64] [messages/s=20000] [budget us=1000]
+//                      [spin us=100] [seconds=5]
+//
+// Reports the idle poll rate and CPU, the delay from a message's arrival to
+// its release by the multiplex manager under a steady load, and how long a
+// burst of messages takes to get through.
+#include "bench_util.h"
+#include "fake_steam.h"
+#include "steam_message_handler.h"
+#include "tunnel_protocol.h"
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A credit grant for a stream that was never opened: parsed and dropped, so
+// the cost measured is the receive path's own.
+std::vector<uint8_t> creditFrame() {
+  std::vector<uint8_t> frame(tunnel::kMaxFrameHeaderBytes +
+                             tunnel::kMaxVarintBytes);
+  std::size_t len = tunnel::writeFrameHeader(
+      frame.data(), tunnel::FrameType::Credit, tunnel::makeStreamId(1, 0));
+  len += tunnel::encodeVarint(1024, frame.data() + len);
+  frame.resize(len);
+  return frame;
+}
+
+void waitForMessages(SteamMessageHandler &handler, uint64_t count) {
+  while (handler.getPollStats().messages < count) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const auto connectionCount = static_cast<int>(bench::argOr(argc, argv, 1, 64));
+  const long rate = bench::argOr(argc, argv, 2, 20000);
+  const std::chrono::microseconds budget(bench::argOr(argc, argv, 3, 1000));
+  const std::chrono::microseconds spin(bench::argOr(argc, argv, 4, 100));
+  const double seconds = static_cast<double>(bench::argOr(argc, argv, 5, 5));
+
+  FakeSteamSockets &steam = FakeSteamSockets::instance();
+  boost::asio::io_context io;
+  auto work = boost::asio::make_work_guard(io);
+  std::vector<HSteamNetConnection> connections;
+  std::mutex connectionsMutex;
+  bool isHost = true;
+  int localPort = 0;
+  for (int i = 0; i < connectionCount; ++i) {
+    connections.push_back(steam.connectPair().second);
+  }
+
+  SteamMessageHandler handler(io, &steam, connections, connectionsMutex,
+                              isHost, localPort, 0, &FakeSteamUtils::instance());
+  handler.setLatencyBudget(budget);
+  handler.setSpinWindow(spin);
+  handler.start();
+  std::thread runner([&io]() { io.run(); });
+
+  // One message each creates the managers before anything is measured.
+  const std::vector<uint8_t> frame = creditFrame();
+  const auto size = static_cast<uint32>(frame.size());
+  for (HSteamNetConnection conn : connections) {
+    steam.inject(conn, frame.data(), size);
+  }
+  waitForMessages(handler, connections.size());
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  // Idle.
+  {
+    const auto before = handler.getPollStats();
+    const double cpu = bench::cpuSeconds();
+    const auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    const double elapsed = bench::secondsSince(start);
+    const auto after = handler.getPollStats();
+    std::cout << "[Bench] idle, " << connectionCount << " connections, budget "
+              << budget.count() << "us: "
+              << static_cast<double>(after.polls - before.polls) / elapsed
+              << " polls/s, "
+              << 100.0 * (bench::cpuSeconds() - cpu) / elapsed
+              << "% of a core" << std::endl;
+  }
+
+  // Steady load, spread over the connections.
+  {
+    steam.takeReleaseDelays();
+    steam.recordReleaseDelays(true);
+    const auto before = handler.getPollStats();
+    const double cpu = bench::cpuSeconds();
+    const auto start = std::chrono::steady_clock::now();
+    const auto total = static_cast<uint64_t>(static_cast<double>(rate) * seconds);
+    // Sent in 100us ticks, so the sender sleeps instead of adding a spinning
+    // thread to the CPU figure.
+    uint64_t sent = 0;
+    for (auto tick = start; sent < total; tick += std::chrono::microseconds(100)) {
+      std::this_thread::sleep_until(tick);
+      const auto due = std::min(
+          total, static_cast<uint64_t>(static_cast<double>(rate) *
+                                       bench::secondsSince(start)));
+      for (; sent < due; ++sent) {
+        steam.inject(connections[sent % connections.size()], frame.data(), size);
+      }
+    }
+    waitForMessages(handler, before.messages + total);
+    const double elapsed = bench::secondsSince(start);
+    steam.recordReleaseDelays(false);
+    std::vector<int64_t> delays = steam.takeReleaseDelays();
+    const auto after = handler.getPollStats();
+    std::cout << "[Bench] load, " << rate << " messages/s: arrival to release p50 "
+              << bench::percentile(delays, 0.5) << "us, p99 "
+              << bench::percentile(delays, 0.99) << "us, max "
+              << bench::percentile(delays, 1.0) << "us; "
+              << static_cast<double>(after.polls - before.polls) / elapsed
+              << " polls/s, largest batch " << after.maxBatch << "; "
+              << 100.0 * (bench::cpuSeconds() - cpu) / elapsed
+              << "% of a core" << std::endl;
+  }
+
+  // Burst: queued as fast as one thread can, drained as it arrives.
+  {
+    const uint64_t burst = 100000;
+    const auto before = handler.getPollStats();
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < burst; ++i) {
+      steam.inject(connections[i % connections.size()], frame.data(), size);
+    }
+    waitForMessages(handler, before.messages + burst);
+    const double elapsed = bench::secondsSince(start);
+    std::cout << "[Bench] burst: " << burst << " messages in "
+              << elapsed * 1000.0 << "ms ("
+              << static_cast<double>(burst) / elapsed << " messages/s), largest batch "
+              << handler.getPollStats().maxBatch << std::endl;
+  }
+
+  handler.stop();
+  work.reset();
+  io.stop();
+  runner.join();
+  return 0;
+}
@@ -0,0 +1,153 @@
+// Send scheduler with thousands of queued streams on one connection.
+//
+//   bench_stream_scaling [streams=10000] [bytes per stream=3000]
+//
+// Every stream queues its data behind a link throttled to a trickle. Half
+// of them are then closed in random order, which times removal from the
+// scheduler's queues, and the limit is lifted to time the drain of the rest.
+#include "bench_util.h"
+#include "buffer_pool.h"
+#include "fake_steam.h"
+#include "multiplex_manager.h"
+#include "transport_profile.h"
+
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+constexpr int kListenBacklog = 4096;
+constexpr std::chrono::milliseconds kSettleTime{500};
+constexpr std::chrono::seconds kDrainTimeout{120};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const auto streamCount = static_cast<std::size_t>(bench::argOr(argc, argv, 1, 10000));
+  const auto streamBytes = static_cast<std::size_t>(bench::argOr(argc, argv, 2, 3000));
+  bench::raiseFileLimit();
+
+  FakeSteamSockets &steam = FakeSteamSockets::instance();
+  // Steam's buffers as the app configures them.
+  TransportProfile().applyToSteam(&FakeSteamUtils::instance());
+  const HSteamNetConnection conn = steam.connectPair().first;
+  // A byte a second: the first send fills the link and the rest queue.
+  steam.setLink(conn, 1, std::chrono::microseconds(0));
+
+  boost::asio::io_context io;
+  auto work = boost::asio::make_work_guard(io);
+  bool isHost = false;
+  int localPort = 0;
+  MultiplexManager manager(&steam, conn, io, isHost, localPort,
+                           &FakeSteamUtils::instance());
+
+  tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+  acceptor.listen(kListenBacklog);
+  const tcp::endpoint endpoint = acceptor.local_endpoint();
+  std::vector<uint32_t> ids;
+  std::mutex idsMutex;
+  std::function<void()> accept = [&]() {
+    acceptor.async_accept([&](const boost::system::error_code &error,
+                              tcp::socket peer) {
+      if (error) {
+        return;
+      }
+      const uint32_t id =
+          manager.addClient(std::make_shared<tcp::socket>(std::move(peer)));
+      {
+        std::lock_guard<std::mutex> lock(idsMutex);
+        ids.push_back(id);
+      }
+      accept();
+    });
+  };
+  accept();
+  std::thread runner([&io]() { io.run(); });
+
+  // Open: each application connection writes its data and closes.
+  const std::vector<char> payload(streamBytes, 'x');
+  const BufferPool::Stats poolBefore = BufferPool::instance().stats();
+  const auto openStart = std::chrono::steady_clock::now();
+  {
+    boost::asio::io_context clientIo;
+    for (std::size_t i = 0; i < streamCount; ++i) {
+      tcp::socket socket(clientIo);
+      socket.connect(endpoint);
+      boost::asio::write(socket, boost::asio::buffer(payload));
+      socket.shutdown(tcp::socket::shutdown_send);
+    }
+  }
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(idsMutex);
+      if (ids.size() == streamCount) {
+        break;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::this_thread::sleep_for(kSettleTime);
+  const double openSeconds =
+      bench::secondsSince(openStart) -
+      std::chrono::duration<double>(kSettleTime).count();
+
+  // Close half, in random order, on the manager's thread.
+  std::mt19937 rng(1);
+  std::shuffle(ids.begin(), ids.end(), rng);
+  const std::size_t half = streamCount / 2;
+  std::promise<double> closed;
+  boost::asio::post(io, [&]() {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < half; ++i) {
+      manager.removeClient(ids[i]);
+    }
+    closed.set_value(bench::secondsSince(start));
+  });
+  const double closeSeconds = closed.get_future().get();
+
+  // Drain the rest.
+  const uint64_t sentBefore = steam.stats().bytesSent;
+  const auto drainStart = std::chrono::steady_clock::now();
+  steam.setLink(conn, 0, std::chrono::microseconds(0));
+  while (manager.activeStreamCount() > 0 &&
+         bench::secondsSince(drainStart) <
+             static_cast<double>(kDrainTimeout.count())) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  const double drainSeconds = bench::secondsSince(drainStart);
+  const std::size_t left = manager.activeStreamCount();
+
+  std::cout << "[Bench] " << streamCount << " streams of " << streamBytes
+            << " bytes: open and queue " << openSeconds * 1000.0 << "ms; close "
+            << half << " queued streams " << closeSeconds * 1000.0 << "ms ("
+            << closeSeconds * 1e6 / static_cast<double>(half)
+            << "us each); drain " << streamCount - half << " streams "
+            << drainSeconds * 1000.0 << "ms, "
+            << steam.stats().bytesSent - sentBefore << " bytes sent" << std::endl;
+  const BufferPool::Stats poolAfter = BufferPool::instance().stats();
+  const MultiplexManager::BatchStats batches = manager.getBatchStats();
+  std::cout << "[Bench] buffer pool " << poolAfter.acquired - poolBefore.acquired
+            << " acquires, " << poolAfter.reused - poolBefore.reused
+            << " reused, " << poolAfter.heapAllocations - poolBefore.heapAllocations
+            << " heap allocations, " << poolAfter.cachedBytes
+            << " bytes cached; " << batches.framesSent << " frames in "
+            << batches.messagesSent << " messages (x" << batches.batchFactor()
+            << "), " << batches.submits << " submits, " << batches.refused
+            << " refused" << std::endl;
+  if (left > 0) {
+    std::cerr << "[Bench] " << left << " streams still open after the drain"
+              << std::endl;
+  }
+
+  work.reset();
+  io.stop();
+  runner.join();
+  return left == 0 ? 0 : 1;
+}
@@ -0,0 +1,274 @@
+// Upload goodput over one connection against the same streams striped over
+// several, each connection capped as a single Steam connection would be.
+//
+//   bench_stripe_throughput [stripes=4] [streams=16] [KB/s per connection=4096]
+//                           [delay ms=20] [KB per stream=2048]
+//
+// Streams go to the client manager with the fewest active streams, ties
+// rotating, as SteamNetworkingManager::connectionForNewStream picks them.
+// A host manager per connection forwards to a local sink that counts bytes.
+#include "bench_util.h"
+#include "buffer_pool.h"
+#include "fake_steam.h"
+#include "io_context_pool.h"
+#include "multiplex_manager.h"
+#include "transport_profile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+constexpr int kReceiveBatch = 256;
+constexpr std::chrono::microseconds kPumpInterval{200};
+constexpr std::chrono::seconds kRunTimeout{300};
+
+// One end of a connection pair: its manager, fed from the stand-in by a
+// timer on the manager's own context, as the handler's poll would.
+struct Side {
+  Side(FakeSteamSockets &steam, HSteamNetConnection conn,
+       boost::asio::io_context &context, bool &isHost, int &localPort)
+      : conn(conn), manager(&steam, conn, context, isHost, localPort,
+                            &FakeSteamUtils::instance()),
+        timer(context) {}
+
+  void pump() {
+    timer.expires_after(kPumpInterval);
+    timer.async_wait([this](const boost::system::error_code &error) {
+      if (error) {
+        return;
+      }
+      SteamNetworkingMessage_t *messages[kReceiveBatch];
+      int count = 0;
+      do {
+        if (manager.isReceiveBlocked()) {
+          break;
+        }
+        count = FakeSteamSockets::instance().ReceiveMessagesOnConnection(
+            conn, messages, kReceiveBatch);
+        manager.receiveTunnelMessages(messages, count);
+      } while (count == kReceiveBatch);
+      pump();
+    });
+  }
+
+  HSteamNetConnection conn;
+  MultiplexManager manager;
+  boost::asio::steady_timer timer;
+};
+
+// Accepts the host managers' connections and counts what they deliver.
+class Sink {
+public:
+  Sink() : acceptor_(io_, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)) {
+    accept();
+    thread_ = std::thread([this]() { io_.run(); });
+  }
+  ~Sink() {
+    io_.stop();
+    thread_.join();
+  }
+
+  int port() const { return acceptor_.local_endpoint().port(); }
+  uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+private:
+  void accept() {
+    acceptor_.async_accept([this](const boost::system::error_code &error,
+                                  tcp::socket peer) {
+      if (error) {
+        return;
+      }
+      read(std::make_shared<tcp::socket>(std::move(peer)),
+           std::make_shared<std::vector<char>>(64 * 1024));
+      accept();
+    });
+  }
+
+  void read(std::shared_ptr<tcp::socket> socket,
+            std::shared_ptr<std::vector<char>> buffer) {
+    socket->async_read_some(
+        boost::asio::buffer(*buffer),
+        [this, socket, buffer](const boost::system::error_code &error,
+                               std::size_t bytes) {
+          if (error) {
+            return;
+          }
+          bytes_.fetch_add(bytes, std::memory_order_relaxed);
+          read(socket, buffer);
+        });
+  }
+
+  boost::asio::io_context io_;
+  tcp::acceptor acceptor_;
+  std::atomic<uint64_t> bytes_{0};
+  std::thread thread_;
+};
+
+// Aggregate goodput in bytes per second, or 0 if the run did not finish.
+double run(int stripes, int streams, int64_t bytesPerSec,
+           std::chrono::microseconds delay, std::size_t streamBytes) {
+  FakeSteamSockets &steam = FakeSteamSockets::instance();
+  Sink sink;
+  bool clientIsHost = false;
+  bool hostIsHost = true;
+  int clientPort = 0;
+  int sinkPort = sink.port();
+
+  IoContextPool pool(IoContextPool::defaultSize());
+  std::vector<std::unique_ptr<Side>> clients;
+  std::vector<std::unique_ptr<Side>> hosts;
+  for (int i = 0; i < stripes; ++i) {
+    const auto pair = steam.connectPair();
+    steam.setLink(pair.first, bytesPerSec, delay);
+    clients.push_back(std::make_unique<Side>(
+        steam, pair.first, pool.contextFor(pair.first), clientIsHost, clientPort));
+    hosts.push_back(std::make_unique<Side>(
+        steam, pair.second, pool.contextFor(pair.second), hostIsHost, sinkPort));
+  }
+  for (auto &side : clients) {
+    side->pump();
+  }
+  for (auto &side : hosts) {
+    side->pump();
+  }
+  pool.start();
+
+  // The applications' connections, accepted straight onto the context of
+  // the manager chosen for them.
+  boost::asio::io_context listenerIo;
+  tcp::acceptor listener(listenerIo,
+                         tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+  const tcp::endpoint listenerEndpoint = listener.local_endpoint();
+  std::vector<std::thread> writers;
+  // Incompressible, so the links carry every byte the sink counts.
+  std::vector<char> payload(streamBytes);
+  uint32_t seed = 1;
+  for (char &byte : payload) {
+    seed = seed * 1664525u + 1013904223u;
+    byte = static_cast<char>(seed >> 24);
+  }
+  const FakeSteamSockets::Stats steamBefore = steam.stats();
+  const BufferPool::Stats poolBefore = BufferPool::instance().stats();
+  const auto start = std::chrono::steady_clock::now();
+  std::size_t rotation = 0;
+  for (int i = 0; i < streams; ++i) {
+    writers.emplace_back([&listenerEndpoint, &payload]() {
+      boost::asio::io_context io;
+      tcp::socket socket(io);
+      socket.connect(listenerEndpoint);
+      boost::asio::write(socket, boost::asio::buffer(payload));
+      socket.shutdown(tcp::socket::shutdown_send);
+    });
+    Side *best = nullptr;
+    std::size_t bestStreams = std::numeric_limits<std::size_t>::max();
+    for (std::size_t j = 0; j < clients.size(); ++j) {
+      Side *side = clients[(rotation + j) % clients.size()].get();
+      if (side->manager.activeStreamCount() < bestStreams) {
+        best = side;
+        bestStreams = side->manager.activeStreamCount();
+      }
+    }
+    ++rotation;
+    best->manager.addClient(std::make_shared<tcp::socket>(
+        listener.accept(best->manager.ioContext())));
+  }
+
+  const uint64_t total = static_cast<uint64_t>(streams) * streamBytes;
+  while (sink.bytes() < total && bench::secondsSince(start) <
+                                     static_cast<double>(kRunTimeout.count())) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  const double elapsed = bench::secondsSince(start);
+  const bool finished = sink.bytes() >= total;
+  const FakeSteamSockets::Stats steamAfter = steam.stats();
+  const uint64_t sends = steamAfter.sendCalls - steamBefore.sendCalls;
+  std::cout << "[Bench] " << stripes << " connections: "
+            << steamAfter.messagesSent - steamBefore.messagesSent
+            << " messages in " << sends << " send calls, "
+            << static_cast<double>(steamAfter.statusCalls - steamBefore.statusCalls) /
+                   static_cast<double>(std::max<uint64_t>(sends, 1))
+            << " status reads per send call" << std::endl;
+  const BufferPool::Stats poolAfter = BufferPool::instance().stats();
+  const uint64_t acquired = poolAfter.acquired - poolBefore.acquired;
+  std::cout << "[Bench] " << stripes << " connections: buffer pool "
+            << acquired << " acquires, "
+            << 100.0 * static_cast<double>(poolAfter.reused - poolBefore.reused) /
+                   static_cast<double>(std::max<uint64_t>(acquired, 1))
+            << "% reused, "
+            << poolAfter.heapAllocations - poolBefore.heapAllocations
+            << " heap allocations" << std::endl;
+  MultiplexManager::BatchStats batches;
+  MultiplexManager::CompressionStats compression;
+  for (const auto &side : clients) {
+    const auto stats = side->manager.getBatchStats();
+    batches.framesSent += stats.framesSent;
+    batches.messagesSent += stats.messagesSent;
+    batches.submits += stats.submits;
+    batches.refused += stats.refused;
+    const auto compressed = side->manager.getCompressionStats();
+    compression.bytesIn += compressed.bytesIn;
+    compression.bytesOut += compressed.bytesOut;
+    compression.bytesSkipped += compressed.bytesSkipped;
+    compression.probesFailed += compressed.probesFailed;
+  }
+  MultiplexManager::ConnectStats connects;
+  for (const auto &side : hosts) {
+    const auto stats = side->manager.getConnectStats();
+    connects.completed += stats.completed;
+    connects.failed += stats.failed;
+    connects.totalLatencyUs += stats.totalLatencyUs;
+  }
+  std::cout << "[Bench] " << stripes << " connections: client "
+            << batches.framesSent << " frames in " << batches.messagesSent
+            << " messages (x" << batches.batchFactor() << "), "
+            << batches.submits << " submits, " << batches.refused
+            << " refused; compression " << compression.bytesIn << " -> "
+            << compression.bytesOut << " bytes, " << compression.bytesSkipped
+            << " sent raw, " << compression.probesFailed
+            << " failed probes; host " << connects.completed << " connects, "
+            << connects.failed << " failed, average "
+            << connects.averageLatencyUs() << "us" << std::endl;
+  if (!finished) {
+    std::cerr << "[Bench] " << stripes << " connections: only " << sink.bytes()
+              << " of " << total << " bytes arrived" << std::endl;
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  pool.stop();
+  return finished ? static_cast<double>(total) / elapsed : 0.0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const auto stripes = static_cast<int>(bench::argOr(argc, argv, 1, 4));
+  const auto streams = static_cast<int>(bench::argOr(argc, argv, 2, 16));
+  const int64_t bytesPerSec = bench::argOr(argc, argv, 3, 4096) * 1024;
+  const std::chrono::microseconds delay(bench::argOr(argc, argv, 4, 20) * 1000);
+  const auto streamBytes =
+      static_cast<std::size_t>(bench::argOr(argc, argv, 5, 2048)) * 1024;
+
+  // Steam's buffers as the app configures them.
+  TransportProfile().applyToSteam(&FakeSteamUtils::instance());
+  const double single = run(1, streams, bytesPerSec, delay, streamBytes);
+  const double striped = run(stripes, streams, bytesPerSec, delay, streamBytes);
+  std::cout << "[Bench] " << streams << " streams, " << bytesPerSec / 1024
+            << " KB/s and " << delay.count() / 1000
+            << "ms per connection: 1 connection " << single / 1048576.0
+            << " MB/s, " << stripes << " connections " << striped / 1048576.0
+            << " MB/s";
+  if (single > 0) {
+    std::cout << " (x" << striped / single << ")";
+  }
+  std::cout << std::endl;
+  return single > 0 && striped > 0 ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+#include "buffer_pool.h"
+
+#include <cstring>
+#include <new>
+
+namespace {
+// Classes sized for: control frames, one tunnel chunk or batch, typical
+// socket reads, large reads, and the per-stream read buffer.
+constexpr std::size_t kClassCapacity[] = {256, 2048, 16 * 1024, 64 * 1024,
+                                          1024 * 1024};
+constexpr std::size_t kClassMaxCached[] = {4096, 8192, 256, 64, 64};
+} // namespace
+
+PooledBuffer::PooledBuffer(const PooledBuffer &other) : block_(other.block_) {
+  if (block_) {
+    block_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+PooledBuffer &PooledBuffer::operator=(const PooledBuffer &other) {
+  if (this != &other) {
+    PooledBuffer copy(other);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+PooledBuffer &PooledBuffer::operator=(PooledBuffer &&other) noexcept {
+  if (this != &other) {
+    reset();
+    block_ = other.block_;
+    other.block_ = nullptr;
+  }
+  return *this;
+}
+
+void PooledBuffer::resize(std::size_t size) {
+  if (block_) {
+    block_->size = size <= block_->capacity ? size : block_->capacity;
+  }
+}
+
+void PooledBuffer::reset() {
+  if (block_ && block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    BufferPool::instance().release(block_);
+  }
+  block_ = nullptr;
+}
+
+BufferPool &BufferPool::instance() {
+  static BufferPool pool;
+  return pool;
+}
+
+BufferPool::BufferPool() {
+  for (std::size_t i = 0; i < kClassCount; ++i) {
+    classes_[i].capacity = kClassCapacity[i];
+    classes_[i].maxCached = kClassMaxCached[i];
+    // Reserve up front so returning a block never reallocates the list.
+    classes_[i].free.reserve(kClassMaxCached[i]);
+  }
+}
+
+BufferPool::~BufferPool() { trim(); }
+
+BufferBlock *BufferPool::allocateBlock(uint32_t sizeClass,
+                                       std::size_t capacity) {
+  void *raw = ::operator new(sizeof(BufferBlock) + capacity);
+  auto *block = new (raw) BufferBlock();
+  block->sizeClass = sizeClass;
+  block->capacity = capacity;
+  heapAllocations_.fetch_add(1, std::memory_order_relaxed);
+  return block;
+}
+
+void BufferPool::freeBlock(BufferBlock *block) {
+  block->~BufferBlock();
+  ::operator delete(static_cast<void *>(block));
+  heapFrees_.fetch_add(1, std::memory_order_relaxed);
+}
+
+PooledBuffer BufferPool::acquire(std::size_t size) {
+  acquired_.fetch_add(1, std::memory_order_relaxed);
+  outstanding_.fetch_add(1, std::memory_order_relaxed);
+
+  uint32_t index = 0;
+  while (index < kClassCount && classes_[index].capacity < size) {
+    ++index;
+  }
+
+  BufferBlock *block = nullptr;
+  if (index < kClassCount) {
+    SizeClass &sizeClass = classes_[index];
+    {
+      std::lock_guard<std::mutex> lock(sizeClass.mutex);
+      if (!sizeClass.free.empty()) {
+        block = sizeClass.free.back();
+        sizeClass.free.pop_back();
+      }
+    }
+    if (block) {
+      reused_.fetch_add(1, std::memory_order_relaxed);
+      block->refs.store(1, std::memory_order_relaxed);
+    } else {
+      block = allocateBlock(index, sizeClass.capacity);
+    }
+  } else {
+    block = allocateBlock(kUnpooled, size);
+  }
+  block->size = size;
+  return PooledBuffer(block);
+}
+
+PooledBuffer BufferPool::copy(const char *data, std::size_t len) {
+  PooledBuffer buffer = acquire(len);
+  if (len > 0 && data) {
+    std::memcpy(buffer.data(), data, len);
+  }
+  return buffer;
+}
+
+void BufferPool::release(BufferBlock *block) {
+  outstanding_.fetch_sub(1, std::memory_order_relaxed);
+  if (block->sizeClass < kClassCount) {
+    SizeClass &sizeClass = classes_[block->sizeClass];
+    std::lock_guard<std::mutex> lock(sizeClass.mutex);
+    if (sizeClass.free.size() < sizeClass.maxCached) {
+      sizeClass.free.push_back(block);
+      return;
+    }
+  }
+  freeBlock(block);
+}
+
+void BufferPool::trim() {
+  for (auto &sizeClass : classes_) {
+    std::vector<BufferBlock *> blocks;
+    {
+      std::lock_guard<std::mutex> lock(sizeClass.mutex);
+      blocks.swap(sizeClass.free);
+      sizeClass.free.reserve(sizeClass.maxCached);
+    }
+    for (auto *block : blocks) {
+      freeBlock(block);
+    }
+  }
+}
+
+BufferPool::Stats BufferPool::stats() const {
+  Stats stats;
+  stats.heapAllocations = heapAllocations_.load(std::memory_order_relaxed);
+  stats.heapFrees = heapFrees_.load(std::memory_order_relaxed);
+  stats.acquired = acquired_.load(std::memory_order_relaxed);
+  stats.reused = reused_.load(std::memory_order_relaxed);
+  stats.outstanding = outstanding_.load(std::memory_order_relaxed);
+  for (const auto &sizeClass : classes_) {
+    std::lock_guard<std::mutex> lock(sizeClass.mutex);
+    stats.cachedBytes += sizeClass.free.size() * sizeClass.capacity;
+  }
+  return stats;
+}
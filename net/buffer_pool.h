@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Header placed in front of every pooled allocation; the payload follows it.
+struct BufferBlock {
+  std::atomic<uint32_t> refs{1};
+  uint32_t sizeClass = 0;
+  std::size_t capacity = 0;
+  std::size_t size = 0;
+
+  char *data() { return reinterpret_cast<char *>(this + 1); }
+};
+
+// Intrusively refcounted handle to a pooled buffer. Copies share the same
+// bytes; the block goes back to its pool when the last handle drops.
+class PooledBuffer {
+public:
+  PooledBuffer() = default;
+  PooledBuffer(const PooledBuffer &other);
+  PooledBuffer(PooledBuffer &&other) noexcept : block_(other.block_) {
+    other.block_ = nullptr;
+  }
+  PooledBuffer &operator=(const PooledBuffer &other);
+  PooledBuffer &operator=(PooledBuffer &&other) noexcept;
+  ~PooledBuffer() { reset(); }
+
+  char *data() const { return block_ ? block_->data() : nullptr; }
+  std::size_t size() const { return block_ ? block_->size : 0; }
+  std::size_t capacity() const { return block_ ? block_->capacity : 0; }
+  bool empty() const { return size() == 0; }
+  explicit operator bool() const { return block_ != nullptr; }
+
+  // Shrinks or grows the logical size within the existing capacity.
+  void resize(std::size_t size);
+  void reset();
+
+  // Passes this handle's reference through an opaque slot (e.g. a C
+  // callback's user data) and takes it back on the other side.
+  BufferBlock *detach() {
+    BufferBlock *block = block_;
+    block_ = nullptr;
+    return block;
+  }
+  static PooledBuffer attach(BufferBlock *block) { return PooledBuffer(block); }
+
+private:
+  friend class BufferPool;
+  explicit PooledBuffer(BufferBlock *block) : block_(block) {}
+
+  BufferBlock *block_ = nullptr;
+};
+
+// Size-classed buffer pool shared by the tunnel send and receive paths.
+// Released blocks are cached per class, so steady-state traffic does not
+// touch the heap. Requests above the largest class are served unpooled.
+class BufferPool {
+public:
+  struct Stats {
+    uint64_t heapAllocations = 0; // blocks obtained from operator new
+    uint64_t heapFrees = 0;       // blocks returned to operator delete
+    uint64_t acquired = 0;        // total acquire() calls
+    uint64_t reused = 0;          // acquire() served from a free list
+    uint64_t outstanding = 0;     // blocks currently referenced
+    std::size_t cachedBytes = 0;  // capacity parked in free lists
+  };
+
+  static BufferPool &instance();
+
+  // Returns a buffer whose size() is `size` and capacity() at least that.
+  PooledBuffer acquire(std::size_t size);
+  PooledBuffer copy(const char *data, std::size_t len);
+  Stats stats() const;
+
+  // Frees every cached block; outstanding buffers are not affected.
+  void trim();
+
+private:
+  friend class PooledBuffer;
+
+  static constexpr std::size_t kClassCount = 5;
+  static constexpr uint32_t kUnpooled = kClassCount;
+
+  struct SizeClass {
+    std::size_t capacity;
+    std::size_t maxCached;
+    mutable std::mutex mutex;
+    std::vector<BufferBlock *> free;
+  };
+
+  BufferPool();
+  ~BufferPool();
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  void release(BufferBlock *block);
+  BufferBlock *allocateBlock(uint32_t sizeClass, std::size_t capacity);
+  void freeBlock(BufferBlock *block);
+
+  std::array<SizeClass, kClassCount> classes_;
+  std::atomic<uint64_t> heapAllocations_{0};
+  std::atomic<uint64_t> heapFrees_{0};
+  std::atomic<uint64_t> acquired_{0};
+  std::atomic<uint64_t> reused_{0};
+  std::atomic<uint64_t> outstanding_{0};
+};
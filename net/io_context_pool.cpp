@@ -0,0 +1,50 @@
+#include "io_context_pool.h"
+
+#include <algorithm>
+
+IoContextPool::IoContextPool(std::size_t size) {
+  size = std::max<std::size_t>(size, 1);
+  contexts_.reserve(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    // Concurrency hint 1: each context is only ever run by one thread.
+    contexts_.push_back(std::make_unique<boost::asio::io_context>(1));
+  }
+}
+
+IoContextPool::~IoContextPool() { stop(); }
+
+void IoContextPool::start() {
+  if (!threads_.empty()) {
+    return;
+  }
+  for (auto &context : contexts_) {
+    context->restart();
+    guards_.push_back(boost::asio::make_work_guard(*context));
+    threads_.emplace_back([ctx = context.get()]() { ctx->run(); });
+  }
+}
+
+void IoContextPool::stop() {
+  for (auto &guard : guards_) {
+    guard.reset();
+  }
+  guards_.clear();
+  for (auto &context : contexts_) {
+    context->stop();
+  }
+  for (auto &thread : threads_) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+  threads_.clear();
+}
+
+boost::asio::io_context &IoContextPool::contextFor(uint64_t key) {
+  return *contexts_[key % contexts_.size()];
+}
+
+std::size_t IoContextPool::defaultSize() {
+  const std::size_t cores = std::thread::hardware_concurrency();
+  return std::clamp<std::size_t>(cores / 2, 1, 4);
+}
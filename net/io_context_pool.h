@@ -0,0 +1,35 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Fixed set of io_contexts, each run by exactly one thread. Everything bound
+// to one context runs serialized on its thread, so a Steam connection pinned
+// to a context gets strand semantics without an explicit strand.
+class IoContextPool {
+public:
+  explicit IoContextPool(std::size_t size);
+  ~IoContextPool();
+
+  void start();
+  void stop();
+
+  std::size_t size() const { return contexts_.size(); }
+  // The same key always maps to the same context.
+  boost::asio::io_context &contextFor(uint64_t key);
+
+  // Worker count used when none is configured: half the cores, at most 4.
+  static std::size_t defaultSize();
+
+private:
+  using WorkGuard =
+      boost::asio::executor_work_guard<boost::asio::io_context::executor_type>;
+
+  std::vector<std::unique_ptr<boost::asio::io_context>> contexts_;
+  std::vector<WorkGuard> guards_;
+  std::vector<std::thread> threads_;
+};
@@ -0,0 +1,170 @@
+#include "lz_codec.h"
+
+#include <cstring>
+
+namespace {
+constexpr int kHashBits = 12;
+constexpr std::size_t kMinMatch = 4;
+// The last match must start this far from the end and the final bytes are
+// always literals, as in the LZ4 block format.
+constexpr std::size_t kMatchStartLimit = 12;
+constexpr std::size_t kLastLiterals = 5;
+
+inline uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t hash4(uint32_t v) {
+  return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+// Writes the 255-run continuation of a length whose nibble saturated.
+inline uint8_t *writeLength(uint8_t *op, std::size_t rem) {
+  while (rem >= 255) {
+    *op++ = 255;
+    rem -= 255;
+  }
+  *op++ = static_cast<uint8_t>(rem);
+  return op;
+}
+
+inline bool readLength(const uint8_t *&ip, const uint8_t *end,
+                       std::size_t &len) {
+  uint8_t b = 0;
+  do {
+    if (ip >= end) {
+      return false;
+    }
+    b = *ip++;
+    len += b;
+  } while (b == 255);
+  return true;
+}
+} // namespace
+
+namespace lz {
+
+std::size_t compress(const uint8_t *src, std::size_t len, uint8_t *dst,
+                     std::size_t capacity) {
+  if (len == 0 || len > kMaxInputBytes) {
+    return 0;
+  }
+  uint16_t table[1 << kHashBits];
+  std::memset(table, 0, sizeof(table));
+
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  const uint8_t *const end = src + len;
+  const uint8_t *const matchStartLimit =
+      len > kMatchStartLimit ? end - kMatchStartLimit : src;
+  const uint8_t *const matchEndLimit = end - kLastLiterals;
+  uint8_t *op = dst;
+  uint8_t *const opEnd = dst + capacity;
+
+  while (ip < matchStartLimit) {
+    const uint32_t h = hash4(read32(ip));
+    const uint8_t *ref = src + table[h];
+    table[h] = static_cast<uint16_t>(ip - src);
+    if (ref >= ip || read32(ref) != read32(ip)) {
+      // Skip faster through data that keeps missing.
+      ip += 1 + ((ip - anchor) >> 6);
+      continue;
+    }
+
+    const uint8_t *mp = ip + kMinMatch;
+    const uint8_t *rp = ref + kMinMatch;
+    while (mp < matchEndLimit && *mp == *rp) {
+      ++mp;
+      ++rp;
+    }
+    const std::size_t literals = static_cast<std::size_t>(ip - anchor);
+    const std::size_t matchExtra = static_cast<std::size_t>(mp - ip) - kMinMatch;
+    if (static_cast<std::size_t>(opEnd - op) <
+        1 + literals + literals / 255 + 1 + 2 + matchExtra / 255 + 1) {
+      return 0;
+    }
+    uint8_t *token = op++;
+    *token = static_cast<uint8_t>((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) {
+      op = writeLength(op, literals - 15);
+    }
+    std::memcpy(op, anchor, literals);
+    op += literals;
+    const auto offset = static_cast<uint16_t>(ip - ref);
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    *token |= static_cast<uint8_t>(matchExtra < 15 ? matchExtra : 15);
+    if (matchExtra >= 15) {
+      op = writeLength(op, matchExtra - 15);
+    }
+    ip = mp;
+    anchor = ip;
+  }
+
+  const std::size_t literals = static_cast<std::size_t>(end - anchor);
+  if (static_cast<std::size_t>(opEnd - op) <
+      1 + literals + literals / 255 + 1) {
+    return 0;
+  }
+  *op++ = static_cast<uint8_t>((literals < 15 ? literals : 15) << 4);
+  if (literals >= 15) {
+    op = writeLength(op, literals - 15);
+  }
+  std::memcpy(op, anchor, literals);
+  op += literals;
+  return static_cast<std::size_t>(op - dst);
+}
+
+bool decompress(const uint8_t *src, std::size_t len, uint8_t *dst,
+                std::size_t rawLen) {
+  const uint8_t *ip = src;
+  const uint8_t *const end = src + len;
+  uint8_t *op = dst;
+  uint8_t *const opEnd = dst + rawLen;
+
+  while (ip < end) {
+    const uint8_t token = *ip++;
+    std::size_t literals = token >> 4;
+    if (literals == 15 && !readLength(ip, end, literals)) {
+      return false;
+    }
+    if (literals > static_cast<std::size_t>(end - ip) ||
+        literals > static_cast<std::size_t>(opEnd - op)) {
+      return false;
+    }
+    std::memcpy(op, ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip == end) {
+      break; // the last sequence carries literals only
+    }
+
+    if (end - ip < 2) {
+      return false;
+    }
+    const std::size_t offset = ip[0] | (static_cast<std::size_t>(ip[1]) << 8);
+    ip += 2;
+    if (offset == 0 || offset > static_cast<std::size_t>(op - dst)) {
+      return false;
+    }
+    std::size_t match = token & 0x0F;
+    if (match == 15 && !readLength(ip, end, match)) {
+      return false;
+    }
+    match += kMinMatch;
+    if (match > static_cast<std::size_t>(opEnd - op)) {
+      return false;
+    }
+    // Byte copy: the source may overlap the bytes being written.
+    const uint8_t *ref = op - offset;
+    for (std::size_t i = 0; i < match; ++i) {
+      op[i] = ref[i];
+    }
+    op += match;
+  }
+  return op == opEnd;
+}
+
+} // namespace lz
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Small LZ77 block codec (LZ4 block layout) for tunnel chunks. It favours
+// speed over ratio: one hash probe per position, no entropy stage, so text
+// and game state shrink cheaply while compressed data is rejected quickly.
+namespace lz {
+
+// Largest input compress() accepts; offsets are 16-bit.
+constexpr std::size_t kMaxInputBytes = 65535;
+
+// Worst-case output size for `len` bytes of input.
+inline std::size_t compressBound(std::size_t len) {
+  return len + len / 255 + 16;
+}
+
+// Compresses `len` bytes into `dst`. Returns the compressed size, or 0 when
+// the input is too large or the output would not fit in `capacity`; passing
+// a capacity below `len` therefore doubles as a ratio gate.
+std::size_t compress(const uint8_t *src, std::size_t len, uint8_t *dst,
+                     std::size_t capacity);
+
+// Decodes a block that must expand to exactly `rawLen` bytes. Malformed
+// input is rejected without reading or writing out of bounds.
+bool decompress(const uint8_t *src, std::size_t len, uint8_t *dst,
+                std::size_t rawLen);
+
+} // namespace lz
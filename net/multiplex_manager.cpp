@@ -1,140 +1,463 @@
 #include "multiplex_manager.h"
+#include "lz_codec.h"
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstring>
 #include <iostream>
+#include <iterator>
 #include <random>
 
 namespace {
 // Keep chunks close to path MTU to reduce Steam UDP fragmentation/lock pressure
 constexpr std::size_t kTunnelChunkBytes =
     1100; // slightly larger chunks to reduce fragment count
-constexpr std::size_t kSendBufferBytes = 8 * 1024 * 1024;
+// Read buffer ladder, matching BufferPool size classes. A stream moves up
+// after kReadGrowAfter reads that fill its buffer and back down after
+// kReadShrinkAfter reads that use less than a quarter of it.
+constexpr std::size_t kReadBufferSizes[] = {2048, 16 * 1024, 64 * 1024};
+constexpr uint32_t kReadGrowAfter = 2;
+constexpr uint32_t kReadShrinkAfter = 64;
+constexpr std::size_t kDefaultReadBudgetBytes = 64 * 1024 * 1024;
 constexpr std::size_t kHighWaterBytes = 512 * 1024; // tighter throttling
 constexpr std::size_t kLowWaterBytes = 256 * 1024;
+// Floor for the BDP controller; the constants above are its starting point
+// until the first sample arrives, and the transport profile sets the rest.
+constexpr std::size_t kMinHighWaterBytes = 64 * 1024;
+constexpr std::chrono::milliseconds kTuneInterval{250};
+// A batch is sealed once it reaches roughly one Steam packet, so coalescing
+// never adds fragmentation; larger frames still travel on their own.
+constexpr std::size_t kBatchBytes = 1200;
+constexpr std::chrono::microseconds kDefaultBatchDelay{200};
+constexpr std::size_t kMaxGatherBuffers = 64;
+// The peer allocates stream slots densely, so an Open names a slot at most a
+// few past the table (Opens on different lanes may arrive out of order).
+// Anything further, or any other frame for a slot never opened, is refused
+// rather than growing the table.
+constexpr std::size_t kMaxSlotLead = 256;
+// Received payloads at least this large are written from the Steam message
+// instead of a copy. Held messages keep Steam's memory alive outside its own
+// receive limits, so they are capped process-wide; past the cap payloads are
+// copied and their messages released at once.
+constexpr std::size_t kMinZeroCopyBytes = 512;
+constexpr std::size_t kMaxHeldMessages = 512;
+constexpr std::size_t kMaxHeldBytes = 4 * 1024 * 1024;
+// Deficit added per round for each unit of class weight; one batch worth.
+constexpr std::size_t kDrrQuantum = kBatchBytes;
+constexpr uint32_t kDefaultPriorityWeights[] = {8, 4, 1};
+// Lanes are indexed by class; the interactive one has strict priority.
+constexpr std::size_t kInteractiveLane = 0;
+// Credit is returned in chunks so Credit frames stay rare on bulk streams.
+constexpr std::size_t kCreditUpdateBytes = tunnel::kStreamWindowBytes / 4;
+// Chunks smaller than this are not worth a compression attempt; a chunk is
+// sent compressed only if it saves at least 1/kMinCompressSavings.
+constexpr std::size_t kMinCompressBytes = 256;
+constexpr std::size_t kMinCompressSavings = 8;
+// After a failed probe a stream sends kCompressSkipBase << backoff reads raw.
+constexpr uint32_t kCompressSkipBase = 4;
+constexpr uint32_t kMaxCompressBackoff = 6;
+// Host-side warm pool: each target port keeps as many pre-connected sockets
+// as streams were opened to it in the last kWarmRateWindow, up to the limit.
+// Ports opened fewer than kWarmMinOpens times in the window keep none, so a
+// service holding one long connection never sees a spare idle client.
+// Idle sockets are dropped after kWarmIdleTimeout, before most services'
+// own keep-alive timeouts would close them.
+constexpr std::size_t kDefaultWarmSockets = 8;
+constexpr std::chrono::seconds kWarmRateWindow{2};
+constexpr std::size_t kWarmMinOpens = 2;
+constexpr std::chrono::seconds kWarmIdleTimeout{15};
+constexpr std::chrono::seconds kWarmSweepInterval{1};
+// Resumption: how long the initiator waits for the peer's Resume, and how
+// many released streams may keep an unacknowledged tail for replay.
+constexpr std::chrono::seconds kResumeTimeout{10};
+constexpr std::size_t kMaxLingering = 256;
+constexpr std::size_t kMaxLingeringBytes = 16 * 1024 * 1024;
 
-// Simple, local ID generator to avoid pulling in the full nanoid dependency
-std::string generateId(std::size_t length = 6) {
-  static constexpr char chars[] =
-      "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
-  static thread_local std::mt19937 rng{std::random_device{}()};
-  std::uniform_int_distribution<std::size_t> dist(0, sizeof(chars) - 2);
+// Idle streams and expired lingering replays are swept at this interval.
+constexpr std::chrono::seconds kReapInterval{30};
+// A closing stream that makes no progress for this long is dropped.
+constexpr std::chrono::seconds kCloseDrainTimeout{2 * kReapInterval};
+// The usual TCP keepalive time: an application that stays silent longer
+// without keepalives of its own has in practice gone away.
+constexpr std::chrono::seconds kDefaultStreamIdleTimeout{2 * 60 * 60};
 
-  std::string id;
-  id.reserve(length);
-  for (std::size_t i = 0; i < length; ++i) {
-    id.push_back(chars[dist(rng)]);
+// Shared by every manager, like the BufferPool the buffers come from.
+std::atomic<std::size_t> g_readBufferBytes{0};
+std::atomic<std::size_t> g_readBufferBudget{kDefaultReadBudgetBytes};
+std::atomic<uint64_t> g_readBufferGrows{0};
+std::atomic<uint64_t> g_readBufferShrinks{0};
+std::atomic<uint64_t> g_readBufferDenied{0};
+std::atomic<std::size_t> g_heldMessages{0};
+std::atomic<std::size_t> g_heldMessageBytes{0};
+std::atomic<uint64_t> g_zeroCopyBytes{0};
+std::atomic<uint64_t> g_copiedBytes{0};
+std::atomic<uint64_t> g_heldCapReached{0};
+
+// Reserves room for one more held message; false once the cap is reached.
+bool reserveHeldMessage(std::size_t bytes) {
+  const std::size_t messages =
+      g_heldMessages.fetch_add(1, std::memory_order_relaxed) + 1;
+  const std::size_t held =
+      g_heldMessageBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  if (messages > kMaxHeldMessages || held > kMaxHeldBytes) {
+    g_heldMessages.fetch_sub(1, std::memory_order_relaxed);
+    g_heldMessageBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    return false;
   }
-  return id;
+  return true;
+}
+
+tunnel::FrameType frameTypeOf(const PooledBuffer &frame) {
+  return static_cast<tunnel::FrameType>(static_cast<uint8_t>(frame.data()[0]) &
+                                        0x0F);
+}
+
+// Hello, Resume and Datagram ids are not stream ids, even when they match one.
+bool isStreamFrame(tunnel::FrameType type) {
+  return type != tunnel::FrameType::Hello &&
+         type != tunnel::FrameType::Resume &&
+         type != tunnel::FrameType::Datagram;
+}
+
+// Frames that carry a stream's byte stream and are resent on resume.
+bool isReplayed(tunnel::FrameType type) {
+  return type == tunnel::FrameType::Open || type == tunnel::FrameType::Data ||
+         type == tunnel::FrameType::CompressedData ||
+         type == tunnel::FrameType::Disconnect;
+}
+
+// Drops replay frames the peer has acknowledged; returns their size. A
+// Disconnect carries no bytes and is only dropped with its stream.
+template <typename Frames> std::size_t trimAcked(Frames &frames, uint64_t acked) {
+  std::size_t bytes = 0;
+  while (!frames.empty() && frames.front().end <= acked &&
+         frameTypeOf(frames.front().frame) != tunnel::FrameType::Disconnect) {
+    bytes += frames.front().frame.size();
+    frames.pop_front();
+  }
+  return bytes;
+}
+
+// Raw stream bytes a frame payload stands for.
+uint64_t rawBytesOf(tunnel::FrameType type, const char *payload, size_t len) {
+  if (type == tunnel::FrameType::Data) {
+    return payload ? len : 0;
+  }
+  if (type == tunnel::FrameType::CompressedData && payload) {
+    const auto *p = reinterpret_cast<const uint8_t *>(payload);
+    uint32_t raw = 0;
+    return tunnel::decodeVarint(p, p + len, raw) ? raw : 0;
+  }
+  return 0;
+}
+
+uint64_t elapsedNs(std::chrono::steady_clock::time_point since) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - since)
+          .count());
 }
+
+// Buffers of one gather write, owned by its completion handler so a stream
+// released mid-write cannot recycle them under the kernel.
+template <typename Chunk> struct GatherWrite {
+  std::array<Chunk, kMaxGatherBuffers> chunks;
+  std::size_t count = 0;
+  std::size_t bytes = 0;
+};
 } // namespace
 
 MultiplexManager::MultiplexManager(ISteamNetworkingSockets *steamInterface,
                                    HSteamNetConnection steamConn,
                                    boost::asio::io_context &io_context,
-                                   bool &isHost, int &localPort)
-    : steamInterface_(steamInterface), steamConn_(steamConn),
-      io_context_(io_context), isHost_(isHost), localPort_(localPort) {
+                                   bool &isHost, int &localPort,
+                                   ISteamNetworkingUtils *steamUtils)
+    : steamInterface_(steamInterface),
+      steamUtils_(steamUtils ? steamUtils : SteamNetworkingUtils()),
+      steamConn_(steamConn),
+      io_context_(io_context), isHost_(isHost), localPort_(localPort),
+      batchDelayUs_(kDefaultBatchDelay.count()),
+      chunkBytes_(kTunnelChunkBytes), highWaterBytes_(kHighWaterBytes),
+      lowWaterBytes_(kLowWaterBytes), warmLimit_(kDefaultWarmSockets),
+      streamIdleTimeoutSec_(kDefaultStreamIdleTimeout.count()) {
+  tuning_.chunkBytes = kTunnelChunkBytes;
+  tuning_.highWaterBytes = kHighWaterBytes;
+  tuning_.lowWaterBytes = kLowWaterBytes;
   sendTimer_ = std::make_unique<boost::asio::steady_timer>(io_context_);
+  batchTimer_ = std::make_unique<boost::asio::steady_timer>(io_context_);
+  warmTimer_ = std::make_unique<boost::asio::steady_timer>(io_context_);
+  resumeTimer_ = std::make_unique<boost::asio::steady_timer>(io_context_);
+  reapTimer_ = std::make_unique<boost::asio::steady_timer>(io_context_);
+  if (!isHost_) {
+    std::random_device random;
+    const uint64_t token =
+        (static_cast<uint64_t>(random()) << 32) ^ random();
+    sessionToken_.store(token != 0 ? token : 1, std::memory_order_relaxed);
+  }
+  for (std::size_t i = 0; i < kPriorityCount; ++i) {
+    classes_[i].weight = kDefaultPriorityWeights[i];
+  }
+  configureLanes();
+  sendHello();
+  armReapTimer();
 }
 
 MultiplexManager::~MultiplexManager() {
+  if (hostUdp_) {
+    hostUdp_->stop();
+  }
   // Close all sockets
-  std::lock_guard<std::mutex> lock(mapMutex_);
-  for (auto &pair : clientMap_) {
-    pair.second->close();
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  for (auto &stream : streams_) {
+    if (stream.active) {
+      releaseStream(stream);
+    }
+  }
+  streams_.clear();
+  boost::system::error_code ec;
+  for (auto &entry : warmPools_) {
+    for (auto &warm : entry.second.idle) {
+      warm.socket->close(ec);
+    }
+  }
+  warmPools_.clear();
+  warmTimer_->cancel();
+  resumeTimer_->cancel();
+  reapTimer_->cancel();
+}
+
+MultiplexManager::Stream *MultiplexManager::findStream(uint32_t id) {
+  const uint32_t slot = tunnel::streamSlot(id);
+  if (slot >= streams_.size()) {
+    return nullptr;
+  }
+  Stream &stream = streams_[slot];
+  return (stream.active && stream.id == id) ? &stream : nullptr;
+}
+
+MultiplexManager::Stream &MultiplexManager::slotFor(uint32_t id) {
+  const uint32_t slot = tunnel::streamSlot(id);
+  if (slot >= streams_.size()) {
+    streams_.resize(slot + 1);
+  }
+  Stream &stream = streams_[slot];
+  if (!stream.active && stream.id != id) {
+    // Per-id bookkeeping of a previous occupant does not carry over.
+    stream.id = id;
+    stream.missingReported = false;
+    stream.lastConnectFail = {};
+  }
+  return stream;
+}
+
+void MultiplexManager::releaseStream(Stream &stream) {
+  const uint32_t slot = tunnel::streamSlot(stream.id);
+  if (stream.socket) {
+    stream.socket->close();
+    stream.socket.reset();
+  }
+  setReadBuffer(stream, 0, true);
+  stream.fullReads = 0;
+  stream.shortReads = 0;
+  if (stream.onClosed) {
+    boost::asio::post(io_context_, std::move(stream.onClosed));
+    stream.onClosed = nullptr;
+  }
+  stream.pending.clear();
+  stream.writeQueue.clear();
+  stream.writeQueuedBytes = 0;
+  stream.writing = false;
+  stream.connecting = false;
+  stream.paused = false;
+  if (stream.draining && !stream.replay.empty()) {
+    // Its Disconnect went out, but the peer may not have the tail yet.
+    const auto now = std::chrono::steady_clock::now();
+    auto previous = lingering_.find(stream.id);
+    if (previous != lingering_.end()) {
+      eraseLingering(previous);
+    }
+    Lingering &lingering = lingering_[stream.id];
+    lingering.replay = std::move(stream.replay);
+    lingering.bytes = stream.replayBytes;
+    lingering.receivedBytes = stream.receivedBytes;
+    lingering.creditGranted = stream.creditGranted + stream.creditOwed;
+    lingering.lane = stream.lane;
+    lingering.expires = now + kResumeWindow;
+    lingeringBytes_ += stream.replayBytes;
+    stream.replay.clear();
+    stream.replayBytes = 0;
+    pruneLingering(now);
+  } else {
+    dropReplay(stream);
+  }
+  stream.sentBytes = 0;
+  stream.creditReceived = 0;
+  stream.receivedBytes = 0;
+  stream.creditGranted = 0;
+  stream.draining = false;
+  stream.peerClosed = false;
+  stream.activityMark = 0;
+  stream.idleSince = {};
+  stream.sendCredit = 0;
+  stream.creditOwed = 0;
+  stream.compressSkip = 0;
+  stream.compressBackoff = 0;
+  if (stream.service) {
+    --stream.service->activeStreams;
+    stream.service = nullptr;
+  }
+  removeFromOrder(slot);
+  if (stream.active) {
+    activeStreams_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  stream.active = false;
+  if (stream.local) {
+    stream.local = false;
+    freeSlots_[stream.lane].push_back(slot);
   }
-  clientMap_.clear();
 }
 
-std::string MultiplexManager::addClient(std::shared_ptr<tcp::socket> socket) {
-  std::string id;
+uint32_t MultiplexManager::addClient(std::shared_ptr<tcp::socket> socket,
+                                     const std::string &service,
+                                     std::function<void()> onClosed) {
+  uint32_t id = 0;
+  boost::system::error_code ec;
+  if (closed_.load(std::memory_order_relaxed)) {
+    // Accepted while the connection was going away.
+    socket->close(ec);
+    if (onClosed) {
+      boost::asio::post(io_context_, std::move(onClosed));
+    }
+    return 0;
+  }
+  const uint16_t localPort = socket->local_endpoint(ec).port();
   {
-    std::lock_guard<std::mutex> lock(mapMutex_);
-    do {
-      id = generateId(6);
-    } while (clientMap_.find(id) != clientMap_.end());
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    const StreamPriority priority = priorityForPort(localPort);
+    // A slot is only reused on the lane it was last used on, so the new
+    // stream's Open cannot overtake the old stream's tail on another lane.
+    auto &freeSlots = freeSlots_[static_cast<std::size_t>(priority)];
+    uint32_t slot = 0;
+    uint32_t generation = 0;
+    if (!freeSlots.empty()) {
+      // FIFO reuse keeps a closed slot out of circulation for as long as
+      // possible; the generation bump covers the rest.
+      slot = freeSlots.front();
+      freeSlots.pop_front();
+      generation =
+          (streams_[slot].generation + 1) & tunnel::kStreamGenerationMask;
+    } else {
+      slot = static_cast<uint32_t>(streams_.size());
+      streams_.emplace_back();
+    }
+    id = tunnel::makeStreamId(slot, generation);
 
-    clientMap_[id] = socket;
-    readBuffers_[id].resize(1048576);
-    missingClients_.erase(id);
+    Stream &stream = streams_[slot];
+    stream.id = id;
+    stream.generation = generation;
+    stream.active = true;
+    activeStreams_.fetch_add(1, std::memory_order_relaxed);
+    stream.local = true;
+    stream.socket = socket;
+    setReadBuffer(stream, kReadBufferSizes[0], true);
+    stream.sendCredit = tunnel::kStreamWindowBytes;
+    stream.missingReported = false;
+    stream.onClosed = std::move(onClosed);
+    applySocketProfile(*socket);
+    stream.priority = priority;
+    stream.lane = static_cast<uint8_t>(priority);
+    attachService(stream, service);
   }
+  // Open first so the host connects even if its service speaks first.
+  sendTunnelPacket(id, service.data(), service.size(),
+                   tunnel::FrameType::Open);
   startAsyncRead(id);
   std::cout << "Added client with id " << id << std::endl;
   return id;
 }
 
-bool MultiplexManager::removeClient(const std::string &id) {
-  bool removed = false;
-  std::lock_guard<std::mutex> lock(mapMutex_);
-  auto it = clientMap_.find(id);
-  if (it != clientMap_.end()) {
-    it->second->close();
-    clientMap_.erase(it);
-    removed = true;
-  }
-  readBuffers_.erase(id);
-  missingClients_.erase(id);
-  {
-    std::lock_guard<std::mutex> lock(pausedMutex_);
-    pausedReads_.erase(id);
+// Releases a closing stream once nothing is left to deliver. Called with
+// streamsMutex_ held.
+bool MultiplexManager::releaseIfDone(Stream &stream) {
+  const bool closing =
+      stream.peerClosed || (stream.draining && stream.pending.empty());
+  if (!closing || stream.writeQueuedBytes > 0) {
+    return false;
   }
+  releaseStream(stream); // the close follows the written data with a FIN
+  return true;
+}
 
-  if (removed) {
-    std::cout << "Removed client with id " << id << std::endl;
+// The peer will send nothing more on the stream and takes nothing more from
+// it, but what it already sent still reaches the host socket.
+bool MultiplexManager::closeFromPeer(uint32_t id) {
+  bool found = false;
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    if (Stream *stream = findStream(id)) {
+      found = true;
+      stream->peerClosed = true;
+      stream->pending.clear();
+      removeFromOrder(tunnel::streamSlot(id));
+      stream->idleSince = std::chrono::steady_clock::now();
+      releaseIfDone(*stream);
+    }
+    if (!hasBacklog()) {
+      sendBlocked_.store(false, std::memory_order_relaxed);
+    }
   }
-  bool shouldResume = false;
+  return found;
+}
+
+bool MultiplexManager::removeClient(uint32_t id) {
+  bool removed = false;
   {
-    std::lock_guard<std::mutex> queueLock(queueMutex_);
-    pendingPackets_.erase(id);
-    removeFromOrder(id);
-    if (pendingPackets_.empty()) {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    if (Stream *stream = findStream(id)) {
+      releaseStream(*stream);
+      removed = true;
+    }
+    if (!hasBacklog()) {
       sendBlocked_.store(false, std::memory_order_relaxed);
-      shouldResume = true;
     }
   }
-  if (shouldResume) {
-    resumePausedReads();
+
+  if (removed) {
+    std::cout << "Removed client with id " << id << std::endl;
   }
   return removed;
 }
 
-std::shared_ptr<tcp::socket>
-MultiplexManager::getClient(const std::string &id) {
-  std::lock_guard<std::mutex> lock(mapMutex_);
-  auto it = clientMap_.find(id);
-  if (it != clientMap_.end()) {
-    return it->second;
+std::shared_ptr<tcp::socket> MultiplexManager::getClient(uint32_t id) {
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  if (Stream *stream = findStream(id)) {
+    return stream->socket;
   }
   return nullptr;
 }
 
-std::vector<char> MultiplexManager::buildPacket(const std::string &id,
-                                                const char *data, size_t len,
-                                                int type) const {
-  const size_t idLen = id.size() + 1;
-  const size_t payloadLen = (type == 0 ? len : 0);
-  const size_t packetSize = idLen + sizeof(uint32_t) + payloadLen;
-  std::vector<char> packet(packetSize);
-  std::memcpy(packet.data(), id.c_str(), idLen);
-  auto *pType = reinterpret_cast<uint32_t *>(packet.data() + idLen);
-  *pType = type;
+PooledBuffer MultiplexManager::buildPacket(uint32_t id, const char *data,
+                                           size_t len,
+                                           tunnel::FrameType type) const {
+  const size_t payloadLen = (data ? len : 0);
+  PooledBuffer packet =
+      BufferPool::instance().acquire(tunnel::frameHeaderSize(id) + payloadLen);
+  const size_t headerLen = tunnel::writeFrameHeader(
+      reinterpret_cast<uint8_t *>(packet.data()), type, id);
   if (payloadLen > 0 && data) {
-    std::memcpy(packet.data() + idLen + sizeof(uint32_t), data, payloadLen);
+    std::memcpy(packet.data() + headerLen, data, payloadLen);
   }
   return packet;
 }
 
-bool MultiplexManager::trySendPacket(const std::vector<char> &packet) {
-  if (packet.empty()) {
-    return true;
-  }
+bool MultiplexManager::stagePacket(Outgoing &packet) {
+  sampleRound();
 
-  SteamNetConnectionRealTimeStatus_t status{};
-  if (steamInterface_->GetConnectionRealTimeStatus(steamConn_, &status, 0,
-                                                   nullptr)) {
-    if (static_cast<std::size_t>(status.m_cbPendingReliable) >=
-        kHighWaterBytes) {
+  // The interactive lane is exempt from the watermarks: Steam schedules it
+  // ahead of the bulk bytes filling its buffer, which is the point of lanes.
+  if (packet.lane != kInteractiveLane) {
+    if (roundPendingReliable_ + outboxBytes_ >=
+        highWaterBytes_.load(std::memory_order_relaxed)) {
       lastBlocked_ = std::chrono::steady_clock::now();
       int current = backoffMs_.load(std::memory_order_relaxed);
       int next = std::min(current * 2, 200);
@@ -142,99 +465,589 @@ bool MultiplexManager::trySendPacket(const std::vector<char> &packet) {
       sendBlocked_.store(true, std::memory_order_relaxed);
       return false;
     }
+    if (UploadScheduler *scheduler =
+            uploadScheduler_.load(std::memory_order_relaxed)) {
+      if (!scheduler->maySend(uploadClient_.load(std::memory_order_relaxed))) {
+        return false;
+      }
+    }
   }
-
-  if (isSendSaturated()) {
+  // Steam refuses a message that would overfill the connection's send
+  // buffer, and later, smaller ones on the same lane could still get in
+  // out of order. A round therefore stages no more than fits, less an
+  // eighth left for datagrams sent meanwhile.
+  const std::size_t room = roundSendBuffer_ - roundSendBuffer_ / 8;
+  if (!outbox_.empty() &&
+      roundPendingTotal_ + outboxBytes_ + packet.size > room) {
     return false;
   }
-  EResult result = steamInterface_->SendMessageToConnection(
-      steamConn_, packet.data(), static_cast<uint32>(packet.size()),
-      k_nSteamNetworkingSend_Reliable | k_nSteamNetworkingSend_NoNagle,
-      nullptr);
-  if (result == k_EResultOK) {
-    backoffMs_.store(5, std::memory_order_relaxed);
+  outboxBytes_ += packet.size;
+  outbox_.push_back(std::move(packet));
+  return true;
+}
+
+bool MultiplexManager::submitOutbox() {
+  roundSampled_ = false;
+  if (outbox_.empty()) {
     return true;
   }
-  if (result == k_EResultLimitExceeded) {
+  const HSteamNetConnection conn = steamConn_.load();
+  const bool lanes = lanesConfigured_.load(std::memory_order_relaxed);
+  const int flags =
+      k_nSteamNetworkingSend_Reliable | k_nSteamNetworkingSend_NoNagle;
+  submitMessages_.clear();
+  for (Outgoing &packet : outbox_) {
+    SteamNetworkingMessage_t *message =
+        steamUtils_ ? steamUtils_->AllocateMessage(0) : nullptr;
+    if (!message) {
+      // Whatever could not be wrapped is kept, in order, for the next round.
+      break;
+    }
+    message->m_pData = packet.buffer.data() + packet.offset;
+    message->m_cbSize = static_cast<int>(packet.size);
+    message->m_conn = conn;
+    message->m_nFlags = flags;
+    message->m_idxLane = lanes ? static_cast<uint16>(packet.lane) : 0;
+    // Steam owns the message now and drops this reference when done.
+    message->m_nUserData =
+        reinterpret_cast<int64>(PooledBuffer(packet.buffer).detach());
+    message->m_pfnFreeData = [](SteamNetworkingMessage_t *done) {
+      PooledBuffer::attach(reinterpret_cast<BufferBlock *>(done->m_nUserData));
+    };
+    submitMessages_.push_back(message);
+  }
+  const std::size_t count = submitMessages_.size();
+  submitResults_.assign(count, 0);
+  if (count > 0) {
+    steamInterface_->SendMessages(static_cast<int>(count),
+                                  submitMessages_.data(),
+                                  submitResults_.data());
+    submits_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::array<std::vector<Outgoing>, kPriorityCount> refused;
+  bool sent = false;
+  UploadScheduler *scheduler = uploadScheduler_.load(std::memory_order_relaxed);
+  for (std::size_t i = 0; i < outbox_.size(); ++i) {
+    Outgoing &packet = outbox_[i];
+    const EResult result =
+        i < count ? (submitResults_[i] < 0
+                         ? static_cast<EResult>(-submitResults_[i])
+                         : k_EResultOK)
+                  : k_EResultLimitExceeded;
+    if (result == k_EResultOK) {
+      sent = true;
+      ++lanes_[packet.lane].messagesSent;
+      lanes_[packet.lane].bytesSent += packet.size;
+      framesSent_.fetch_add(packet.frames, std::memory_order_relaxed);
+      messagesSent_.fetch_add(1, std::memory_order_relaxed);
+      if (scheduler) {
+        scheduler->consume(uploadClient_.load(std::memory_order_relaxed),
+                           packet.size);
+      }
+    } else if (result == k_EResultLimitExceeded) {
+      refusedMessages_.fetch_add(1, std::memory_order_relaxed);
+      refused[packet.lane].push_back(std::move(packet));
+    } else if (result != k_EResultNoConnection &&
+               result != k_EResultInvalidParam) {
+      std::cerr << "[Multiplex] SendMessages failed with result "
+                << static_cast<int>(result) << std::endl;
+    }
+  }
+  outbox_.clear();
+  outboxBytes_ = 0;
+
+  // Refused messages go back ahead of anything stalled since they were
+  // staged, keeping each lane in order.
+  bool accepted = true;
+  for (std::size_t lane = 0; lane < lanes_.size(); ++lane) {
+    if (refused[lane].empty()) {
+      continue;
+    }
+    accepted = false;
+    auto &stalled = lanes_[lane].stalled;
+    stalled.insert(stalled.begin(),
+                   std::make_move_iterator(refused[lane].begin()),
+                   std::make_move_iterator(refused[lane].end()));
+  }
+  // Any accepted message resets the backoff; a refusal then doubles it
+  // once, however many messages of the round were refused.
+  if (sent) {
+    backoffMs_.store(5, std::memory_order_relaxed);
+  }
+  if (!accepted) {
     lastBlocked_ = std::chrono::steady_clock::now();
     int current = backoffMs_.load(std::memory_order_relaxed);
     int next = std::min(current * 2, 100);
     backoffMs_.store(next, std::memory_order_relaxed);
     sendBlocked_.store(true, std::memory_order_relaxed);
+  }
+  return accepted;
+}
+
+bool MultiplexManager::appendToBatch(std::size_t lane, const char *head,
+                                     size_t headLen, const char *body,
+                                     size_t bodyLen) {
+  LaneBatch &batch = lanes_[lane];
+  const uint32_t frameLen = static_cast<uint32_t>(headLen + bodyLen);
+  const size_t entryLen = tunnel::varintSize(frameLen) + frameLen;
+  if (batch.openFrames > 0 && batch.open.size() + entryLen > kBatchBytes) {
+    sizeFlushes_.fetch_add(1, std::memory_order_relaxed);
+    if (!sealBatch(lane)) {
+      return false;
+    }
+  }
+  if (!batch.open) {
+    // Sized for a full batch, or for one larger frame on its own.
+    batch.open = BufferPool::instance().acquire(
+        std::max(kBatchBytes, tunnel::kMaxFrameHeaderBytes + entryLen));
+    batch.open.resize(tunnel::writeFrameHeader(
+        reinterpret_cast<uint8_t *>(batch.open.data()),
+        tunnel::FrameType::Batch, 0));
+  }
+  std::size_t at = batch.open.size();
+  batch.open.resize(at + entryLen);
+  char *out = batch.open.data();
+  at += tunnel::encodeVarint(frameLen, reinterpret_cast<uint8_t *>(out + at));
+  std::memcpy(out + at, head, headLen);
+  if (bodyLen > 0) {
+    std::memcpy(out + at + headLen, body, bodyLen);
+  }
+  ++batch.openFrames;
+  if (batch.open.size() >= kBatchBytes) {
+    sizeFlushes_.fetch_add(1, std::memory_order_relaxed);
+    sealBatch(lane); // a refused batch is kept in batch.stalled
+  }
+  return true;
+}
+
+bool MultiplexManager::appendToBatch(std::size_t lane,
+                                     const PooledBuffer &frame) {
+  const std::size_t size = frame.size();
+  if (tunnel::frameHeaderSize(0) + tunnel::varintSize(size) + size <
+      kBatchBytes) {
+    return appendToBatch(lane, frame.data(), size);
+  }
+  // Too large to share a message: it goes out alone, from its own buffer.
+  LaneBatch &batch = lanes_[lane];
+  if (batch.openFrames > 0) {
+    sizeFlushes_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (!sealBatch(lane) || !batch.stalled.empty()) {
+    return false;
+  }
+  Outgoing packet{frame, 0, size, 1, lane};
+  if (!stagePacket(packet)) {
+    batch.stalled.push_back(std::move(packet));
+  }
+  return true;
+}
+
+bool MultiplexManager::sealBatch(std::size_t lane) {
+  LaneBatch &batch = lanes_[lane];
+  if (batch.openFrames == 0) {
+    return true;
+  }
+  if (!batch.stalled.empty()) {
+    return false;
+  }
+
+  Outgoing packet;
+  packet.lane = lane;
+  packet.frames = batch.openFrames;
+  packet.size = batch.open.size();
+  if (batch.openFrames == 1) {
+    // A lone frame goes out unwrapped.
+    const auto *begin = reinterpret_cast<const uint8_t *>(batch.open.data());
+    const auto *p = begin + tunnel::frameHeaderSize(0);
+    uint32_t frameLen = 0;
+    tunnel::decodeVarint(p, begin + batch.open.size(), frameLen);
+    packet.offset = static_cast<std::size_t>(p - begin);
+    packet.size = frameLen;
+  }
+  packet.buffer = std::move(batch.open);
+  batch.openFrames = 0;
+  if (!stagePacket(packet)) {
+    batch.stalled.push_back(std::move(packet));
     return false;
   }
+  return true;
+}
+
+bool MultiplexManager::sealAllBatches() {
+  bool sealed = true;
+  for (std::size_t lane = 0; lane < lanes_.size(); ++lane) {
+    if (!sealBatch(lane)) {
+      sealed = false;
+    }
+  }
+  return sealed;
+}
 
-  if (result != k_EResultNoConnection && result != k_EResultInvalidParam) {
-    std::cerr << "[Multiplex] SendMessageToConnection failed with result "
-              << static_cast<int>(result) << std::endl;
+bool MultiplexManager::retryStalledBatch(std::size_t lane) {
+  auto &stalled = lanes_[lane].stalled;
+  while (!stalled.empty()) {
+    if (!stagePacket(stalled.front())) {
+      return false;
+    }
+    stalled.pop_front();
   }
   return true;
 }
 
-void MultiplexManager::enqueuePacket(const std::string &id,
-                                     std::vector<char> packet) {
+bool MultiplexManager::anyLaneStalled() const {
+  for (const auto &batch : lanes_) {
+    if (!batch.stalled.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Called from the constructor and with streamsMutex_ held.
+void MultiplexManager::configureLanes() {
+  int priorities[kPriorityCount];
+  uint16 weights[kPriorityCount];
+  for (std::size_t i = 0; i < kPriorityCount; ++i) {
+    const bool interactive = i == kInteractiveLane;
+    priorities[i] = interactive ? 0 : 1;
+    weights[i] = interactive ? 1
+                             : static_cast<uint16>(std::min<uint32_t>(
+                                   classes_[i].weight, 0xFFFF));
+  }
+  const EResult result = steamInterface_->ConfigureConnectionLanes(
+      steamConn_, static_cast<int>(kPriorityCount), priorities, weights);
+  const bool configured = result == k_EResultOK;
+  if (lanesConfigured_.exchange(configured) != configured && !configured) {
+    std::cerr << "[Multiplex] Steam lanes unavailable (result "
+              << static_cast<int>(result) << "), sending on one lane"
+              << std::endl;
+  }
+}
+
+std::size_t MultiplexManager::laneFor(const Stream *stream,
+                                      tunnel::FrameType type) const {
+  // Credit and Hello are unordered control frames; everything else keeps
+  // its stream's order.
+  if (!stream || type == tunnel::FrameType::Credit ||
+      type == tunnel::FrameType::Hello) {
+    return kInteractiveLane;
+  }
+  return stream->lane;
+}
+
+MultiplexManager::LaneStats
+MultiplexManager::getLaneStats(StreamPriority priority) const {
+  const auto lane = static_cast<std::size_t>(priority);
+  LaneStats stats;
+  stats.configured = lanesConfigured_.load(std::memory_order_relaxed);
   {
-    std::lock_guard<std::mutex> lock(queueMutex_);
-    auto &queue = pendingPackets_[id];
-    const bool wasEmpty = queue.empty();
-    queue.push_back(std::move(packet));
-    if (wasEmpty) {
-      if (sendOrderSet_.insert(id).second) {
-        sendOrder_.push_back(id);
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    stats.messagesSent = lanes_[lane].messagesSent;
+    stats.bytesSent = lanes_[lane].bytesSent;
+  }
+  SteamNetConnectionRealTimeStatus_t status{};
+  SteamNetConnectionRealTimeLaneStatus_t laneStatus[kPriorityCount]{};
+  if (stats.configured &&
+      steamInterface_->GetConnectionRealTimeStatus(
+          steamConn_, &status, static_cast<int>(kPriorityCount),
+          laneStatus) == k_EResultOK) {
+    stats.pendingReliableBytes = laneStatus[lane].m_cbPendingReliable;
+    stats.pendingUnreliableBytes = laneStatus[lane].m_cbPendingUnreliable;
+    stats.sentUnackedBytes = laneStatus[lane].m_cbSentUnackedReliable;
+    stats.queueTimeUs = laneStatus[lane].m_usecQueueTime;
+  }
+  return stats;
+}
+
+void MultiplexManager::armBatchTimer() {
+  if (batchTimerArmed_) {
+    return;
+  }
+  batchTimerArmed_ = true;
+  batchTimer_->expires_after(std::chrono::microseconds(
+      batchDelayUs_.load(std::memory_order_relaxed)));
+  batchTimer_->async_wait([this](const boost::system::error_code &ec) {
+    if (ec) {
+      return;
+    }
+    bool needFlush = false;
+    {
+      std::lock_guard<std::mutex> lock(streamsMutex_);
+      batchTimerArmed_ = false;
+      for (std::size_t lane = 0; lane < lanes_.size(); ++lane) {
+        if (lanes_[lane].openFrames == 0) {
+          continue;
+        }
+        deadlineFlushes_.fetch_add(1, std::memory_order_relaxed);
+        if (!sealBatch(lane)) {
+          sendBlocked_.store(true, std::memory_order_relaxed);
+          needFlush = true;
+        }
+      }
+      if (!submitOutbox()) {
+        needFlush = true;
       }
     }
+    if (needFlush) {
+      scheduleFlush();
+    }
+  });
+}
+
+bool MultiplexManager::hasBacklog() const {
+  for (const auto &cls : classes_) {
+    if (cls.head != kNoSlot) {
+      return true;
+    }
   }
-  scheduleFlush();
+  return !resumeBacklog_.empty() || anyLaneStalled();
 }
 
-void MultiplexManager::flushPendingPackets() {
-  if (isSendSaturated()) {
+void MultiplexManager::setBatchDelay(std::chrono::microseconds delay) {
+  batchDelayUs_.store(std::max<int64_t>(0, delay.count()),
+                      std::memory_order_relaxed);
+}
+
+void MultiplexManager::setTransportProfile(const TransportProfile &profile) {
+  {
+    std::lock_guard<std::mutex> lock(tuningMutex_);
+    profile_ = profile;
+    // Keep the current sample; the next status check retunes within the
+    // new bounds.
+    chunkBytes_.store(std::clamp(chunkBytes_.load(std::memory_order_relaxed),
+                                 profile.minChunkBytes, profile.maxChunkBytes),
+                      std::memory_order_relaxed);
+    lastTuneUs_.store(0, std::memory_order_relaxed);
+  }
+  setBatchDelay(profile.batchDelay);
+  // Socket options are set from the thread that owns the sockets.
+  boost::asio::post(io_context_, [this]() {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    for (auto &stream : streams_) {
+      if (stream.active && stream.socket && !stream.connecting) {
+        applySocketProfile(*stream.socket);
+      }
+    }
+    for (auto &entry : warmPools_) {
+      for (auto &warm : entry.second.idle) {
+        applySocketProfile(*warm.socket);
+      }
+    }
+  });
+}
+
+void MultiplexManager::applySocketProfile(tcp::socket &socket) const {
+  TransportProfile profile;
+  {
+    std::lock_guard<std::mutex> lock(tuningMutex_);
+    profile = profile_;
+  }
+  profile.applyTo(socket);
+}
+
+MultiplexManager::BatchStats MultiplexManager::getBatchStats() const {
+  BatchStats stats;
+  stats.framesSent = framesSent_.load(std::memory_order_relaxed);
+  stats.messagesSent = messagesSent_.load(std::memory_order_relaxed);
+  stats.sizeFlushes = sizeFlushes_.load(std::memory_order_relaxed);
+  stats.deadlineFlushes = deadlineFlushes_.load(std::memory_order_relaxed);
+  stats.submits = submits_.load(std::memory_order_relaxed);
+  stats.refused = refusedMessages_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void MultiplexManager::enqueuePacket(Stream &stream, PooledBuffer packet,
+                                     uint64_t end) {
+  stream.pending.push_back(
+      PendingFrame{std::move(packet), std::chrono::steady_clock::now(), end});
+  appendToOrder(tunnel::streamSlot(stream.id));
+}
+
+void MultiplexManager::recordSend(StreamPriority priority, std::size_t bytes,
+                                  std::chrono::steady_clock::duration delay) {
+  PriorityStats &stats = classes_[static_cast<std::size_t>(priority)].stats;
+  const uint64_t delayUs = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(delay).count());
+  ++stats.frames;
+  stats.bytes += bytes;
+  stats.totalDelayUs += delayUs;
+  stats.maxDelayUs = std::max(stats.maxDelayUs, delayUs);
+  std::size_t bucket = 0;
+  while (bucket + 1 < kDelayBuckets && (uint64_t{1} << bucket) <= delayUs) {
+    ++bucket;
+  }
+  ++stats.delayHistogram[bucket];
+}
+
+uint64_t
+MultiplexManager::PriorityStats::percentileDelayUs(double quantile) const {
+  const uint64_t target = static_cast<uint64_t>(quantile * frames);
+  uint64_t seen = 0;
+  for (std::size_t i = 0; i < kDelayBuckets; ++i) {
+    seen += delayHistogram[i];
+    if (seen > target || seen == frames) {
+      return uint64_t{1} << i;
+    }
+  }
+  return maxDelayUs;
+}
+
+MultiplexManager::StreamPriority
+MultiplexManager::priorityForPort(uint16_t port) const {
+  auto it = portPriorities_.find(port);
+  return it != portPriorities_.end() ? it->second : StreamPriority::Normal;
+}
+
+void MultiplexManager::setPortPriority(uint16_t port,
+                                       StreamPriority priority) {
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  portPriorities_[port] = priority;
+}
+
+void MultiplexManager::setStreamPriority(uint32_t id,
+                                         StreamPriority priority) {
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  Stream *stream = findStream(id);
+  if (!stream || stream->priority == priority) {
     return;
   }
+  const bool wasQueued = stream->queued;
+  removeFromOrder(tunnel::streamSlot(id));
+  stream->priority = priority;
+  if (wasQueued) {
+    appendToOrder(tunnel::streamSlot(id));
+  }
+}
 
-  std::unique_lock<std::mutex> lock(queueMutex_);
-  while (!sendOrder_.empty()) {
-    const std::string id = sendOrder_.front();
-    sendOrder_.pop_front();
-    auto it = pendingPackets_.find(id);
-    if (it == pendingPackets_.end()) {
-      sendOrderSet_.erase(id);
-      continue;
+void MultiplexManager::setPriorityWeight(StreamPriority priority,
+                                         uint32_t weight) {
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  classes_[static_cast<std::size_t>(priority)].weight = std::max(weight, 1u);
+  configureLanes();
+}
+
+MultiplexManager::PriorityStats
+MultiplexManager::getPriorityStats(StreamPriority priority) const {
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  return classes_[static_cast<std::size_t>(priority)].stats;
+}
+
+void MultiplexManager::flushPendingPackets() {
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    // Over the watermark only the interactive lane may still send.
+    const bool saturated = isSendSaturated();
+    // Older bytes first: each lane's refused batch, then its open one, then
+    // the queues. A lane that cannot send is skipped; the others go on.
+    std::array<bool, kPriorityCount> laneBlocked{};
+    bool anyBlocked = false;
+    for (std::size_t lane = 0; lane < lanes_.size(); ++lane) {
+      laneBlocked[lane] = (saturated && lane != kInteractiveLane) ||
+                          !retryStalledBatch(lane) || !sealBatch(lane);
+      anyBlocked = anyBlocked || laneBlocked[lane];
     }
-    auto &queue = it->second;
-    if (queue.empty()) {
-      pendingPackets_.erase(it);
-      sendOrderSet_.erase(id);
-      continue;
+    // Handshake frames, and tails of streams that closed before a resume,
+    // go first: a stream reusing one of their slots must not overtake them.
+    while (!resumeBacklog_.empty()) {
+      auto &entry = resumeBacklog_.front();
+      if (laneBlocked[entry.first] ||
+          !appendToBatch(entry.first, entry.second)) {
+        laneBlocked.fill(true);
+        anyBlocked = true;
+        break;
+      }
+      resumeBacklog_.pop_front();
     }
-
-    const std::vector<char> &packet = queue.front();
-    lock.unlock();
-    const bool sent = trySendPacket(packet);
-    lock.lock();
-    if (!sent) {
-      sendBlocked_.store(true, std::memory_order_relaxed);
-      sendOrder_.push_front(id); // retry this id first when unblocked
+    if (resumePending_) {
+      // Stream traffic waits for the peer's Resume.
+      const bool sealed = sealAllBatches();
+      if (!submitOutbox() || !sealed) {
+        anyBlocked = true;
+      }
+      sendBlocked_.store(anyBlocked, std::memory_order_relaxed);
       return;
     }
-    queue.pop_front();
-    if (!queue.empty()) {
-      sendOrder_.push_back(id);
-    } else {
-      pendingPackets_.erase(it);
-      sendOrderSet_.erase(id);
+    // Deficit round robin across classes, plain round robin within one.
+    // Every round adds at least one quantum, so each round makes progress;
+    // streams whose lane is blocked are rotated past.
+    const auto now = std::chrono::steady_clock::now();
+    bool backlog = true;
+    while (backlog) {
+      backlog = false;
+      for (std::size_t c = 0; c < kPriorityCount; ++c) {
+        PriorityClass &cls = classes_[c];
+        if (cls.head == kNoSlot) {
+          cls.deficit = 0;
+          continue;
+        }
+        cls.deficit += cls.weight * kDrrQuantum;
+        std::size_t skipped = 0;
+        bool deficitSpent = false;
+        while (cls.head != kNoSlot && skipped < cls.queuedSlots) {
+          const uint32_t slot = cls.head;
+          Stream &stream = streams_[slot];
+          if (stream.pending.empty()) {
+            removeFromOrder(slot);
+            continue;
+          }
+          if (laneBlocked[stream.lane]) {
+            removeFromOrder(slot);
+            appendToOrder(slot);
+            ++skipped;
+            continue;
+          }
+
+          const PendingFrame &head = stream.pending.front();
+          const std::size_t size = head.frame.size();
+          if (size > cls.deficit) {
+            deficitSpent = true;
+            break;
+          }
+          if (!appendToBatch(stream.lane, head.frame)) {
+            // The slot stays in place for the next flush.
+            laneBlocked[stream.lane] = true;
+            anyBlocked = true;
+            continue;
+          }
+          skipped = 0;
+          cls.deficit -= size;
+          recordSend(stream.priority, size, now - head.queuedAt);
+          recordReplay(stream, std::move(stream.pending.front()));
+          stream.pending.pop_front();
+          removeFromOrder(slot);
+          if (!stream.pending.empty()) {
+            appendToOrder(slot);
+          } else if (stream.draining) {
+            releaseIfDone(stream); // its Disconnect just went out
+          }
+          if (!lanes_[stream.lane].stalled.empty()) {
+            laneBlocked[stream.lane] = true;
+            anyBlocked = true;
+          }
+        }
+        if (cls.head == kNoSlot || !deficitSpent) {
+          // Drained, or only blocked lanes left: nothing to save up for.
+          cls.deficit = 0;
+        } else {
+          backlog = true;
+        }
+      }
+    }
+    // Everything sealed this round goes to Steam in one call.
+    const bool sealed = sealAllBatches();
+    if (!submitOutbox() || !sealed) {
+      anyBlocked = true;
     }
+    sendBlocked_.store(anyBlocked, std::memory_order_relaxed);
   }
-  sendBlocked_.store(false, std::memory_order_relaxed);
-  lock.unlock();
-  resumePausedReads();
 }
 
 void MultiplexManager::scheduleFlush(std::chrono::milliseconds delay) {
   bool needSchedule = false;
   {
-    std::lock_guard<std::mutex> lock(queueMutex_);
-    if (!flushScheduled_ && !sendOrder_.empty()) {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    if (!flushScheduled_ && hasBacklog()) {
       flushScheduled_ = true;
       needSchedule = true;
     }
@@ -257,9 +1070,9 @@ void MultiplexManager::scheduleFlush(std::chrono::milliseconds delay) {
     bool shouldReschedule = false;
     auto rescheduleDelay = std::chrono::milliseconds(5);
     {
-      std::lock_guard<std::mutex> lock(queueMutex_);
+      std::lock_guard<std::mutex> lock(streamsMutex_);
       flushScheduled_ = false;
-      shouldReschedule = !sendOrder_.empty();
+      shouldReschedule = hasBacklog();
       if (sendBlocked_.load(std::memory_order_relaxed)) {
         rescheduleDelay = std::chrono::milliseconds(
             backoffMs_.load(std::memory_order_relaxed));
@@ -271,195 +1084,1826 @@ void MultiplexManager::scheduleFlush(std::chrono::milliseconds delay) {
   });
 }
 
-void MultiplexManager::sendTunnelPacket(const std::string &id, const char *data,
-                                        size_t len, int type) {
-  bool blocked = false;
-  auto pushPacket = [this, &id, &blocked](const char *ptr, size_t amount,
-                                          int packetType) {
-    auto packet = buildPacket(id, ptr, amount, packetType);
-    if (blocked || isSendSaturated()) {
-      blocked = true;
-      enqueuePacket(id, std::move(packet));
-      return;
-    }
-    if (!trySendPacket(packet)) {
-      blocked = true;
-      enqueuePacket(id, std::move(packet));
+void MultiplexManager::sendTunnelPacket(uint32_t id, const char *data,
+                                        size_t len, tunnel::FrameType type) {
+  if (closed_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    // Frames of a stream that already has a backlog must queue behind it.
+    Stream *stream = isStreamFrame(type) ? findStream(id) : nullptr;
+    auto pushPacket = [this, id, stream, &queued](const char *ptr,
+                                                  size_t amount,
+                                                  tunnel::FrameType frameType) {
+      const size_t payloadLen = (ptr ? amount : 0);
+      // The direct path writes header and payload straight into the batch;
+      // only frames that have to wait, or are kept for replay, are copied
+      // into a pooled buffer.
+      uint8_t header[tunnel::kMaxFrameHeaderBytes];
+      const size_t headerLen = tunnel::writeFrameHeader(header, frameType, id);
+      const std::size_t lane = laneFor(stream, frameType);
+      const bool ordered = frameType != tunnel::FrameType::Credit;
+      // While a resume is pending only the handshake itself goes out.
+      const bool held = resumePending_ &&
+                        frameType != tunnel::FrameType::Hello &&
+                        frameType != tunnel::FrameType::Resume;
+      const bool keep = stream && isReplayed(frameType) && replayEnabled();
+      uint64_t end = 0;
+      if (stream) {
+        stream->sentBytes += rawBytesOf(frameType, ptr, amount);
+        end = stream->sentBytes;
+      }
+      PooledBuffer packet;
+      if (keep) {
+        packet = buildPacket(id, ptr, amount, frameType);
+      }
+      if (!queued && !held && !(ordered && stream && !stream->pending.empty()) &&
+          lanes_[lane].stalled.empty() &&
+          (lane == kInteractiveLane || !isSendSaturated()) &&
+          (keep ? appendToBatch(lane, packet)
+                : appendToBatch(lane, reinterpret_cast<const char *>(header),
+                                headerLen, ptr, payloadLen))) {
+        recordSend(stream ? stream->priority : StreamPriority::Normal,
+                   headerLen + payloadLen, {});
+        if (keep) {
+          recordReplay(*stream, PendingFrame{std::move(packet),
+                                             std::chrono::steady_clock::now(),
+                                             end});
+        }
+        return;
+      }
+      queued = true;
+      if (stream) {
+        enqueuePacket(*stream,
+                      keep ? std::move(packet)
+                           : buildPacket(id, ptr, amount, frameType),
+                      end);
+      } else if (frameType == tunnel::FrameType::Hello ||
+                 frameType == tunnel::FrameType::Resume) {
+        // The handshake has no stream to queue on, but must not be lost.
+        resumeBacklog_.emplace_back(lane,
+                                    buildPacket(id, ptr, amount, frameType));
+      }
+    };
+
+    const size_t chunkBytes = chunkBytes_.load(std::memory_order_relaxed);
+    if (type == tunnel::FrameType::Data && data && len > chunkBytes) {
+      size_t offset = 0;
+      while (offset < len) {
+        const size_t chunk = std::min(chunkBytes, len - offset);
+        pushPacket(data + offset, chunk, tunnel::FrameType::Data);
+        offset += chunk;
+      }
+    } else {
+      pushPacket(data, len, type);
     }
-  };
 
-  if (type == 0 && data && len > kTunnelChunkBytes) {
-    size_t offset = 0;
-    while (offset < len) {
-      const size_t chunk = std::min(kTunnelChunkBytes, len - offset);
-      pushPacket(data + offset, chunk, 0);
-      offset += chunk;
+    bool batchOpen = false;
+    for (const auto &batch : lanes_) {
+      batchOpen = batchOpen || batch.openFrames > 0;
+    }
+    if (batchOpen) {
+      if (batchDelayUs_.load(std::memory_order_relaxed) == 0) {
+        if (!sealAllBatches()) {
+          queued = true;
+        }
+      } else {
+        armBatchTimer();
+      }
+    }
+    if (!submitOutbox() || anyLaneStalled()) {
+      queued = true;
     }
-  } else {
-    pushPacket(data, len, type);
   }
 
-  if (blocked) {
+  if (queued) {
     sendBlocked_.store(true, std::memory_order_relaxed);
     lastBlocked_ = std::chrono::steady_clock::now();
+    scheduleFlush();
   }
 }
 
 void MultiplexManager::handleTunnelPacket(const char *data, size_t len) {
-  size_t idLen = 7; // 6 + null
-  if (len < idLen + sizeof(uint32_t)) {
-    std::cerr << "Invalid tunnel packet size" << std::endl;
+  handlePacket(data, len, nullptr);
+}
+
+void MultiplexManager::handlePacket(const char *data, size_t len,
+                                    InboundMessage *inbound) {
+  if (closed_.load(std::memory_order_relaxed)) {
     return;
   }
-  std::string id(data, 6);
-  uint32_t type = *reinterpret_cast<const uint32_t *>(data + idLen);
-  if (type == 0) {
-    // Data packet
-    size_t dataLen = len - idLen - sizeof(uint32_t);
-    const char *packetData = data + idLen + sizeof(uint32_t);
-    auto socket = getClient(id);
-    if (!socket && isHost_ && localPort_ > 0) {
-      // 如果是主持且没有对应的 TCP Client，创建一个连接到本地端口
-      std::cout << "Creating new TCP client for id " << id
-                << " connecting to localhost:" << localPort_ << std::endl;
-      try {
-        const auto now = std::chrono::steady_clock::now();
-        auto it = recentConnectFail_.find(id);
-        if (it != recentConnectFail_.end() &&
-            now - it->second < std::chrono::seconds(1)) {
-          return; // 最近失败过，避免频繁重试占用 CPU
-        }
-        auto newSocket = std::make_shared<tcp::socket>(io_context_);
-        boost::system::error_code ec;
-        newSocket->set_option(tcp::no_delay(true), ec);
-        tcp::resolver resolver(io_context_);
-        auto endpoints =
-            resolver.resolve("127.0.0.1", std::to_string(localPort_));
-        boost::asio::connect(*newSocket, endpoints);
-
-        std::string tempId = id;
-        {
-          std::lock_guard<std::mutex> lock(mapMutex_);
-          clientMap_[id] = newSocket;
-          readBuffers_[id].resize(1048576);
-          socket = newSocket;
-        }
-        std::cout << "Successfully created TCP client for id " << id
-                  << std::endl;
-        startAsyncRead(tempId);
-        recentConnectFail_.erase(id);
-      } catch (const std::exception &e) {
-        std::cerr << "Failed to create TCP client for id " << id << ": "
-                  << e.what() << std::endl;
-        recentConnectFail_[id] = std::chrono::steady_clock::now();
-        sendTunnelPacket(id, nullptr, 0, 1);
-        return;
-      }
-    }
-    if (socket) {
-      missingClients_.erase(id);
-      auto payload =
-          std::make_shared<std::vector<char>>(packetData, packetData + dataLen);
-      boost::asio::async_write(
-          *socket, boost::asio::buffer(*payload),
-          [this, id, payload](const boost::system::error_code &writeEc,
-                              std::size_t) {
-            if (writeEc) {
-              std::cout << "Error writing to TCP client " << id << ": "
-                        << writeEc.message() << std::endl;
-              removeClient(id);
-            }
-          });
-    } else {
-      if (missingClients_.insert(id).second) {
-        std::cerr << "No client found for id " << id << std::endl;
-      }
-      sendTunnelPacket(id, nullptr, 0, 1);
-    }
-  } else if (type == 1) {
-    // Disconnect packet
-    if (removeClient(id)) {
-      std::cout << "Client " << id << " disconnected" << std::endl;
+  tunnel::FrameView frame;
+  if (!tunnel::parseFrame(data, len, frame)) {
+    std::cerr << "Invalid tunnel packet (size " << len << ")" << std::endl;
+    return;
+  }
+  if (frame.type != tunnel::FrameType::Batch) {
+    handleFrame(frame, inbound);
+    return;
+  }
+
+  const auto *p = reinterpret_cast<const uint8_t *>(frame.payload);
+  const auto *end = p + frame.payloadLen;
+  while (p < end) {
+    uint32_t frameLen = 0;
+    tunnel::FrameView inner;
+    if (!tunnel::decodeVarint(p, end, frameLen) ||
+        frameLen > static_cast<size_t>(end - p) ||
+        !tunnel::parseFrame(reinterpret_cast<const char *>(p), frameLen,
+                            inner) ||
+        inner.type == tunnel::FrameType::Batch) {
+      std::cerr << "Malformed tunnel batch (size " << len << ")" << std::endl;
+      return;
     }
-  } else {
-    std::cerr << "Unknown packet type " << type << std::endl;
+    handleFrame(inner, inbound);
+    p += frameLen;
   }
 }
 
-void MultiplexManager::startAsyncRead(const std::string &id) {
-  auto socket = getClient(id);
-  if (!socket) {
+void MultiplexManager::handleMessage(SteamNetworkingMessage_t *message) {
+  InboundMessage inbound;
+  inbound.message = message;
+  handlePacket(static_cast<const char *>(message->m_pData),
+               static_cast<size_t>(message->m_cbSize), &inbound);
+  // A held message is released by the last write that uses it.
+  if (!inbound.held) {
+    message->Release();
+  }
+}
+
+void MultiplexManager::receiveTunnelMessages(
+    SteamNetworkingMessage_t **messages, int count) {
+  if (count <= 0) {
+    return;
+  }
+  if (io_context_.get_executor().running_in_this_thread()) {
+    for (int i = 0; i < count; ++i) {
+      handleMessage(messages[i]);
+    }
+    return;
+  }
+  inboundMessages_.fetch_add(count, std::memory_order_relaxed);
+  std::vector<SteamNetworkingMessage_t *> batch(messages, messages + count);
+  boost::asio::post(io_context_, [this, batch = std::move(batch)]() {
+    for (SteamNetworkingMessage_t *message : batch) {
+      handleMessage(message);
+    }
+    inboundMessages_.fetch_sub(static_cast<int>(batch.size()),
+                               std::memory_order_relaxed);
+  });
+}
+
+void MultiplexManager::sendDatagram(uint32_t flowId, const char *data,
+                                    size_t len) {
+  PooledBuffer packet =
+      buildPacket(flowId, data, len, tunnel::FrameType::Datagram);
+  // Stale datagrams are worthless to games, so nothing is queued or retried.
+  const EResult result = steamInterface_->SendMessageToConnection(
+      steamConn_, packet.data(), static_cast<uint32>(packet.size()),
+      k_nSteamNetworkingSend_UnreliableNoNagle, nullptr);
+  if (result != k_EResultOK) {
+    datagramsDropped_.fetch_add(1, std::memory_order_relaxed);
+  } else if (UploadScheduler *scheduler =
+                 uploadScheduler_.load(std::memory_order_relaxed)) {
+    scheduler->consume(uploadClient_.load(std::memory_order_relaxed),
+                       packet.size());
+  }
+}
+
+void MultiplexManager::setDatagramHandler(DatagramSendCallback handler) {
+  std::lock_guard<std::mutex> lock(datagramMutex_);
+  datagramHandler_ = std::move(handler);
+}
+
+bool MultiplexManager::hasDatagramHandler() const {
+  std::lock_guard<std::mutex> lock(datagramMutex_);
+  return static_cast<bool>(datagramHandler_);
+}
+
+void MultiplexManager::handleFrame(const tunnel::FrameView &frame,
+                                   InboundMessage *inbound,
+                                   PooledBuffer decoded) {
+  const uint32_t id = frame.streamId;
+  if (frame.type == tunnel::FrameType::Hello) {
+    const auto *p = reinterpret_cast<const uint8_t *>(frame.payload);
+    const auto *end = p + frame.payloadLen;
+    uint32_t caps = 0;
+    if (!tunnel::decodeVarint(p, end, caps)) {
+      std::cerr << "Malformed hello frame" << std::endl;
+      return;
+    }
+    const bool compression = (caps & tunnel::kCapCompression) != 0;
+    if (compression && !peerCompression_.exchange(true)) {
+      std::cout << "[Multiplex] Peer supports compression" << std::endl;
+    }
+    // The client's token identifies the session; the host's carries none
+    // until it has seen the client's.
+    uint64_t token = 0;
+    bool resume = (caps & tunnel::kCapResume) != 0 &&
+                  tunnel::decodeVarint64(p, end, token);
+    if (isHost_) {
+      resume = resume && token != 0;
+      if (resume) {
+        sessionToken_.store(token, std::memory_order_relaxed);
+      }
+    }
+    peerResume_.store(resume, std::memory_order_relaxed);
+    if (!peerHelloSeen_.exchange(true) && !resume) {
+      // Nothing will ever be replayed to this peer.
+      std::lock_guard<std::mutex> lock(streamsMutex_);
+      for (auto &stream : streams_) {
+        dropReplay(stream);
+      }
+    }
+    return;
+  }
+  if (frame.type == tunnel::FrameType::Resume) {
+    applyResume(frame.payload, frame.payloadLen);
+    return;
+  }
+  if (frame.type == tunnel::FrameType::CompressedData) {
+    const auto *p = reinterpret_cast<const uint8_t *>(frame.payload);
+    const auto *end = p + frame.payloadLen;
+    uint32_t rawLen = 0;
+    PooledBuffer raw;
+    if (tunnel::decodeVarint(p, end, rawLen) && rawLen > 0 &&
+        rawLen <= lz::kMaxInputBytes) {
+      raw = BufferPool::instance().acquire(rawLen);
+      const auto started = std::chrono::steady_clock::now();
+      if (!lz::decompress(p, static_cast<std::size_t>(end - p),
+                          reinterpret_cast<uint8_t *>(raw.data()), rawLen)) {
+        raw.reset();
+      }
+      decompressNs_.fetch_add(elapsedNs(started), std::memory_order_relaxed);
+    }
+    if (!raw) {
+      // The byte stream is broken past this point; drop it on both ends.
+      std::cerr << "Corrupt compressed frame for id " << id << std::endl;
+      removeClient(id);
+      sendTunnelPacket(id, nullptr, 0, tunnel::FrameType::Disconnect);
+      return;
+    }
+    tunnel::FrameView plain = frame;
+    plain.type = tunnel::FrameType::Data;
+    plain.payload = raw.data();
+    plain.payloadLen = rawLen;
+    handleFrame(plain, nullptr, std::move(raw));
+    return;
+  }
+  if (frame.type == tunnel::FrameType::Datagram) {
+    DatagramSendCallback handler;
+    {
+      std::lock_guard<std::mutex> lock(datagramMutex_);
+      handler = datagramHandler_;
+    }
+    if (handler) {
+      handler(id, frame.payload, frame.payloadLen);
+    } else if (isHost_) {
+      if (!hostUdp_) {
+        hostUdp_ = std::make_shared<UdpForwarder>(
+            io_context_, [this](uint32_t flowId, const char *data, size_t len) {
+              sendDatagram(flowId, data, len);
+            });
+        hostUdp_->setTargetResolver([this](uint32_t flowId) {
+          std::lock_guard<std::mutex> lock(streamsMutex_);
+          return targetPortForTag(tunnel::flowServiceTag(flowId));
+        });
+      }
+      hostUdp_->deliver(id, frame.payload, frame.payloadLen);
+    }
+    return;
+  }
+  if (tunnel::streamSlot(id) >= tunnel::kMaxStreamSlots) {
+    std::cerr << "Tunnel stream id out of range: " << id << std::endl;
+    return;
+  }
+
+  if (frame.type == tunnel::FrameType::Data ||
+      frame.type == tunnel::FrameType::Open) {
+    // Only an Open frame, which names the service, starts a stream. Data
+    // for a stream that is not live (released here while the peer was
+    // still sending) is dropped, and the peer told once to stop.
+    const bool open = frame.type == tunnel::FrameType::Open;
+    const std::string service =
+        open ? std::string(frame.payload, frame.payloadLen) : std::string();
+    bool known = false;
+    bool reportMissing = false;
+    uint16_t port = 0;
+    std::shared_ptr<tcp::socket> connectSocket;
+    bool refused = false;
+    {
+      std::lock_guard<std::mutex> lock(streamsMutex_);
+      const std::size_t slotIndex = tunnel::streamSlot(id);
+      if (findStream(id)) {
+        known = true;
+      } else if (slotIndex >= streams_.size() &&
+                 (!open || slotIndex >= streams_.size() + kMaxSlotLead)) {
+        refused = true;
+      } else if (!open) {
+        // An active slot belongs to a newer stream; leave its state alone.
+        if (!streams_[slotIndex].active) {
+          Stream &slot = slotFor(id);
+          reportMissing = !slot.missingReported;
+          slot.missingReported = true;
+        }
+      } else {
+        Stream &slot = slotFor(id);
+        if (slot.active) {
+          if (slot.local) {
+            return; // late frame for a stream we already replaced
+          }
+          // The peer recycled this slot, so its previous stream is gone.
+          releaseStream(slot);
+          slotFor(id);
+        }
+        port = isHost_ ? targetPortFor(service) : 0;
+        if (port != 0) {
+          connectSocket = openLocalStream(slot, port, service);
+          if (!connectSocket) {
+            return; // 最近失败过，避免频繁重试占用 CPU
+          }
+          known = true;
+        } else {
+          reportMissing = !slot.missingReported;
+          slot.missingReported = true;
+        }
+      }
+    }
+
+    if (refused) {
+      std::cerr << "Tunnel stream id not opened: " << id << std::endl;
+      sendTunnelPacket(id, nullptr, 0, tunnel::FrameType::Disconnect);
+      return;
+    }
+    if (connectSocket) {
+      startLocalConnect(id, connectSocket, port);
+      refillWarmPool(port);
+    }
+    if (known) {
+      if (!open) {
+        // While the connect is pending this only queues the payload.
+        writeToClient(id, receivedChunk(frame.payload, frame.payloadLen,
+                                        inbound, std::move(decoded)));
+      }
+    } else {
+      if (reportMissing) {
+        if (open && isHost_) {
+          std::cerr << "No service '" << service << "' for id " << id
+                    << std::endl;
+        } else {
+          std::cerr << "No client found for id " << id << std::endl;
+        }
+        sendTunnelPacket(id, nullptr, 0, tunnel::FrameType::Disconnect);
+      }
+    }
+  } else if (frame.type == tunnel::FrameType::Disconnect) {
+    if (closeFromPeer(id)) {
+      std::cout << "Client " << id << " disconnected" << std::endl;
+    }
+  } else if (frame.type == tunnel::FrameType::Credit) {
+    const auto *p = reinterpret_cast<const uint8_t *>(frame.payload);
+    uint32_t grant = 0;
+    if (!tunnel::decodeVarint(p, p + frame.payloadLen, grant)) {
+      std::cerr << "Malformed credit frame for id " << id << std::endl;
+      return;
+    }
+    bool resume = false;
+    {
+      std::lock_guard<std::mutex> lock(streamsMutex_);
+      Stream *stream = findStream(id);
+      if (!stream) {
+        return;
+      }
+      stream->sendCredit += grant;
+      stream->creditReceived += grant;
+      trimReplay(*stream, stream->creditReceived);
+      if (stream->paused) {
+        stream->paused = false;
+        resume = true;
+      }
+    }
+    if (resume) {
+      startAsyncRead(id);
+    }
+  } else {
+    std::cerr << "Unknown packet type " << static_cast<int>(frame.type)
+              << std::endl;
+  }
+}
+
+void MultiplexManager::setServices(
+    const std::vector<tunnel::TunnelService> &services) {
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  servicePorts_.clear();
+  tagPorts_.clear();
+  for (const auto &service : services) {
+    if (service.name.empty() || service.targetPort == 0) {
+      continue;
+    }
+    servicePorts_[service.name] = service.targetPort;
+    tagPorts_[tunnel::serviceTag(service.name)] = service.targetPort;
+  }
+}
+
+uint16_t MultiplexManager::targetPortFor(const std::string &service) const {
+  if (service.empty()) {
+    return localPort_ > 0 ? static_cast<uint16_t>(localPort_) : 0;
+  }
+  auto it = servicePorts_.find(service);
+  return it != servicePorts_.end() ? it->second : 0;
+}
+
+uint16_t MultiplexManager::targetPortForTag(uint16_t tag) const {
+  if (tag == 0) {
+    return localPort_ > 0 ? static_cast<uint16_t>(localPort_) : 0;
+  }
+  auto it = tagPorts_.find(tag);
+  return it != tagPorts_.end() ? it->second : 0;
+}
+
+void MultiplexManager::attachService(Stream &stream,
+                                     const std::string &service) {
+  ServiceStats &stats = serviceStats_[service];
+  ++stats.streamsOpened;
+  ++stats.activeStreams;
+  stream.service = &stats;
+}
+
+std::map<std::string, MultiplexManager::ServiceStats>
+MultiplexManager::getServiceStats() const {
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  return serviceStats_;
+}
+
+std::shared_ptr<tcp::socket>
+MultiplexManager::openLocalStream(Stream &slot, uint16_t port,
+                                  const std::string &service) {
+  const auto now = std::chrono::steady_clock::now();
+  if (slot.lastConnectFail.time_since_epoch().count() != 0 &&
+      now - slot.lastConnectFail < std::chrono::seconds(1)) {
+    return nullptr;
+  }
+  slot.active = true;
+  activeStreams_.fetch_add(1, std::memory_order_relaxed);
+  slot.local = false;
+  slot.connecting = true;
+  slot.connectStarted = now;
+  slot.sendCredit = tunnel::kStreamWindowBytes;
+  slot.priority = priorityForPort(port);
+  slot.lane = static_cast<uint8_t>(slot.priority);
+  attachService(slot, service);
+  slot.socket = takeWarmSocket(port, now);
+  if (!slot.socket) {
+    slot.socket = std::make_shared<tcp::socket>(io_context_);
+  }
+  return slot.socket;
+}
+
+void MultiplexManager::startLocalConnect(uint32_t id,
+                                         std::shared_ptr<tcp::socket> socket,
+                                         uint16_t port) {
+  if (socket->is_open()) {
+    // Adopted from the warm pool: already connected.
+    onLocalConnected(id, socket, {});
+    return;
+  }
+  // 如果是主持且没有对应的 TCP Client，创建一个连接到本地端口
+  std::cout << "Creating new TCP client for id " << id
+            << " connecting to localhost:" << port << std::endl;
+  const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+  socket->async_connect(endpoint, [this, id, socket](
+                                      const boost::system::error_code &ec) {
+    onLocalConnected(id, socket, ec);
+  });
+}
+
+void MultiplexManager::onLocalConnected(
+    uint32_t id, const std::shared_ptr<tcp::socket> &socket,
+    const boost::system::error_code &ec) {
+  bool startWriting = false;
+  bool peerClosed = false;
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    Stream *stream = findStream(id);
+    if (!stream || stream->socket != socket) {
+      return; // closed by the peer while connecting
+    }
+    peerClosed = stream->peerClosed;
+    const auto latency =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - stream->connectStarted)
+            .count();
+    if (ec) {
+      connectFailures_.fetch_add(1, std::memory_order_relaxed);
+      releaseStream(*stream);
+      stream->lastConnectFail = std::chrono::steady_clock::now();
+    } else {
+      connectsCompleted_.fetch_add(1, std::memory_order_relaxed);
+      connectLatencyTotalUs_.fetch_add(static_cast<uint64_t>(latency),
+                                       std::memory_order_relaxed);
+      lastConnectLatencyUs_.store(static_cast<uint64_t>(latency),
+                                  std::memory_order_relaxed);
+      applySocketProfile(*socket);
+      stream->connecting = false;
+      stream->lastConnectFail = {};
+      setReadBuffer(*stream, kReadBufferSizes[0], true);
+      if (!stream->writeQueue.empty() && !stream->writing) {
+        stream->writing = true;
+        startWriting = true;
+      }
+    }
+  }
+
+  if (ec) {
+    std::cerr << "Failed to create TCP client for id " << id << ": "
+              << ec.message() << std::endl;
+    if (!peerClosed) {
+      sendTunnelPacket(id, nullptr, 0, tunnel::FrameType::Disconnect);
+    }
+    return;
+  }
+  std::cout << "Successfully created TCP client for id " << id << std::endl;
+  if (startWriting) {
+    startWrite(id);
+  }
+  if (!peerClosed) {
+    startAsyncRead(id);
+  }
+}
+
+std::shared_ptr<tcp::socket>
+MultiplexManager::takeWarmSocket(uint16_t port,
+                                 std::chrono::steady_clock::time_point now) {
+  WarmPool &pool = warmPools_[port];
+  pool.recentOpens.push_back(now);
+  updateWarmTarget(pool, now);
+  while (!pool.idle.empty()) {
+    // Newest first: the least likely to have been timed out by the service.
+    std::shared_ptr<tcp::socket> socket = std::move(pool.idle.back().socket);
+    pool.idle.pop_back();
+    // A non-blocking peek tells a live connection (would_block, or a
+    // greeting already waiting) from one the service has since closed.
+    boost::system::error_code ec;
+    char byte = 0;
+    socket->non_blocking(true, ec);
+    const std::size_t peeked =
+        ec ? 0
+           : socket->receive(boost::asio::buffer(&byte, 1),
+                             tcp::socket::message_peek, ec);
+    if (ec == boost::asio::error::would_block || (!ec && peeked > 0)) {
+      warmHits_.fetch_add(1, std::memory_order_relaxed);
+      return socket;
+    }
+    warmStale_.fetch_add(1, std::memory_order_relaxed);
+    socket->close(ec);
+  }
+  return nullptr;
+}
+
+void MultiplexManager::updateWarmTarget(
+    WarmPool &pool, std::chrono::steady_clock::time_point now) {
+  while (!pool.recentOpens.empty() &&
+         now - pool.recentOpens.front() > kWarmRateWindow) {
+    pool.recentOpens.pop_front();
+  }
+  const std::size_t opens = pool.recentOpens.size();
+  pool.target = opens < kWarmMinOpens
+                    ? 0
+                    : std::min(opens, warmLimit_.load(std::memory_order_relaxed));
+}
+
+void MultiplexManager::refillWarmPool(uint16_t port) {
+  std::size_t toOpen = 0;
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    auto it = warmPools_.find(port);
+    if (it == warmPools_.end() || closed_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    WarmPool &pool = it->second;
+    const std::size_t have = pool.idle.size() + pool.connecting;
+    if (have >= pool.target) {
+      return;
+    }
+    toOpen = pool.target - have;
+    pool.connecting += toOpen;
+    warmConnectsInFlight_.fetch_add(toOpen, std::memory_order_relaxed);
+    armWarmTimer();
+  }
+
+  const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+  for (std::size_t i = 0; i < toOpen; ++i) {
+    auto socket = std::make_shared<tcp::socket>(io_context_);
+    socket->async_connect(endpoint, [this, port, socket](
+                                        const boost::system::error_code &ec) {
+      std::lock_guard<std::mutex> lock(streamsMutex_);
+      warmConnectsInFlight_.fetch_sub(1, std::memory_order_relaxed);
+      boost::system::error_code closeEc;
+      auto it = warmPools_.find(port);
+      if (it == warmPools_.end()) {
+        socket->close(closeEc);
+        return;
+      }
+      WarmPool &pool = it->second;
+      --pool.connecting;
+      if (ec || pool.idle.size() >= pool.target) {
+        // A failing service gets no retries from here; the next stream
+        // open pays (and reports) the connect as usual.
+        socket->close(closeEc);
+        return;
+      }
+      applySocketProfile(*socket);
+      pool.idle.push_back({socket, std::chrono::steady_clock::now()});
+    });
+  }
+}
+
+// Called with streamsMutex_ held, from the periodic sweep.
+void MultiplexManager::trimWarmPools() {
+  const auto now = std::chrono::steady_clock::now();
+  boost::system::error_code ec;
+  for (auto it = warmPools_.begin(); it != warmPools_.end();) {
+    WarmPool &pool = it->second;
+    updateWarmTarget(pool, now);
+    // Oldest sockets sit at the front; drop the expired ones and any
+    // surplus left after the open rate fell.
+    while (!pool.idle.empty() &&
+           (pool.idle.size() > pool.target ||
+            now - pool.idle.front().connectedAt > kWarmIdleTimeout)) {
+      pool.idle.front().socket->close(ec);
+      pool.idle.pop_front();
+    }
+    if (pool.idle.empty() && pool.connecting == 0 &&
+        pool.recentOpens.empty()) {
+      it = warmPools_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// Called with streamsMutex_ held.
+void MultiplexManager::armWarmTimer() {
+  if (warmTimerArmed_) {
+    return;
+  }
+  warmTimerArmed_ = true;
+  warmTimer_->expires_after(kWarmSweepInterval);
+  warmTimer_->async_wait([this](const boost::system::error_code &ec) {
+    if (ec) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    warmTimerArmed_ = false;
+    trimWarmPools();
+    if (!warmPools_.empty()) {
+      armWarmTimer();
+    }
+  });
+}
+
+void MultiplexManager::setWarmPoolLimit(std::size_t limit) {
+  warmLimit_.store(limit, std::memory_order_relaxed);
+}
+
+MultiplexManager::ConnectStats MultiplexManager::getConnectStats() const {
+  ConnectStats stats;
+  stats.completed = connectsCompleted_.load(std::memory_order_relaxed);
+  stats.failed = connectFailures_.load(std::memory_order_relaxed);
+  stats.totalLatencyUs = connectLatencyTotalUs_.load(std::memory_order_relaxed);
+  stats.lastLatencyUs = lastConnectLatencyUs_.load(std::memory_order_relaxed);
+  stats.warmHits = warmHits_.load(std::memory_order_relaxed);
+  stats.warmStale = warmStale_.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  for (const auto &entry : warmPools_) {
+    stats.warmIdle += entry.second.idle.size();
+  }
+  return stats;
+}
+
+struct MultiplexManager::MessageHolder {
+  std::atomic<uint32_t> refs{0};
+  SteamNetworkingMessage_t *message = nullptr;
+  std::size_t bytes = 0;
+  MessageHolder *nextFree = nullptr;
+
+  // reserveHeldMessage never admits more than kMaxHeldMessages, so one
+  // table shared by every manager always has a holder free.
+  static std::mutex tableMutex;
+  static MessageHolder table[kMaxHeldMessages];
+  static std::size_t tableUsed; // entries ever handed out
+  static MessageHolder *freeList;
+};
+
+std::mutex MultiplexManager::MessageHolder::tableMutex;
+MultiplexManager::MessageHolder
+    MultiplexManager::MessageHolder::table[kMaxHeldMessages];
+std::size_t MultiplexManager::MessageHolder::tableUsed = 0;
+MultiplexManager::MessageHolder *MultiplexManager::MessageHolder::freeList =
+    nullptr;
+
+MultiplexManager::HeldMessage::HeldMessage(const HeldMessage &other)
+    : holder_(other.holder_) {
+  if (holder_) {
+    holder_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+MultiplexManager::HeldMessage &
+MultiplexManager::HeldMessage::operator=(const HeldMessage &other) {
+  if (this != &other) {
+    HeldMessage copy(other);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+MultiplexManager::HeldMessage &
+MultiplexManager::HeldMessage::operator=(HeldMessage &&other) noexcept {
+  if (this != &other) {
+    reset();
+    holder_ = other.holder_;
+    other.holder_ = nullptr;
+  }
+  return *this;
+}
+
+MultiplexManager::HeldMessage
+MultiplexManager::HeldMessage::hold(SteamNetworkingMessage_t *message) {
+  const std::size_t bytes = static_cast<std::size_t>(message->m_cbSize);
+  if (!reserveHeldMessage(bytes)) {
+    return HeldMessage();
+  }
+  MessageHolder *holder = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(MessageHolder::tableMutex);
+    if (MessageHolder::freeList) {
+      holder = MessageHolder::freeList;
+      MessageHolder::freeList = holder->nextFree;
+    } else {
+      holder = &MessageHolder::table[MessageHolder::tableUsed++];
+    }
+  }
+  holder->refs.store(1, std::memory_order_relaxed);
+  holder->message = message;
+  holder->bytes = bytes;
+  return HeldMessage(holder);
+}
+
+void MultiplexManager::HeldMessage::reset() {
+  if (holder_ && holder_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    holder_->message->Release();
+    const std::size_t bytes = holder_->bytes;
+    {
+      std::lock_guard<std::mutex> lock(MessageHolder::tableMutex);
+      holder_->message = nullptr;
+      holder_->nextFree = MessageHolder::freeList;
+      MessageHolder::freeList = holder_;
+    }
+    // Back on the free list before the cap admits another.
+    g_heldMessages.fetch_sub(1, std::memory_order_relaxed);
+    g_heldMessageBytes.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+  holder_ = nullptr;
+}
+
+MultiplexManager::WriteChunk
+MultiplexManager::receivedChunk(const char *data, size_t len,
+                                InboundMessage *inbound, PooledBuffer decoded) {
+  WriteChunk chunk;
+  chunk.data = data;
+  chunk.size = len;
+  if (len == 0) {
+    return chunk;
+  }
+  if (decoded) {
+    // Decompressed into a buffer of its own already.
+    chunk.buffer = std::move(decoded);
+    return chunk;
+  }
+  if (inbound && len >= kMinZeroCopyBytes) {
+    if (!inbound->held) {
+      inbound->held = HeldMessage::hold(inbound->message);
+      if (!inbound->held) {
+        g_heldCapReached.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    if (inbound->held) {
+      chunk.message = inbound->held;
+      g_zeroCopyBytes.fetch_add(len, std::memory_order_relaxed);
+      return chunk;
+    }
+  }
+  chunk.buffer = BufferPool::instance().copy(data, len);
+  chunk.data = chunk.buffer.data();
+  g_copiedBytes.fetch_add(len, std::memory_order_relaxed);
+  return chunk;
+}
+
+void MultiplexManager::writeToClient(uint32_t id, WriteChunk chunk) {
+  const std::size_t len = chunk.size;
+  if (len == 0) {
+    return;
+  }
+  bool start = false;
+  bool overrun = false;
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    Stream *stream = findStream(id);
+    if (!stream) {
+      return;
+    }
+    // Credit is only granted for written bytes, so a peer within its window
+    // never has more than the window queued here.
+    overrun = stream->writeQueuedBytes + len > tunnel::kStreamWindowBytes;
+    if (!overrun) {
+      stream->writeQueue.push_back(std::move(chunk));
+      stream->writeQueuedBytes += len;
+      stream->receivedBytes += len;
+      if (!stream->writing && !stream->connecting) {
+        stream->writing = true;
+        start = true;
+      }
+    }
+  }
+  if (overrun) {
+    std::cerr << "[Multiplex] Peer overran the stream window for id " << id
+              << std::endl;
+    removeClient(id);
+    sendTunnelPacket(id, nullptr, 0, tunnel::FrameType::Disconnect);
+    return;
+  }
+  if (start) {
+    startWrite(id);
+  }
+}
+
+void MultiplexManager::startWrite(uint32_t id) {
+  std::shared_ptr<tcp::socket> socket;
+  GatherWrite<WriteChunk> batch;
+  std::array<boost::asio::const_buffer, kMaxGatherBuffers> buffers;
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    Stream *stream = findStream(id);
+    if (!stream || !stream->socket) {
+      return;
+    }
+    socket = stream->socket;
+    while (!stream->writeQueue.empty() && batch.count < kMaxGatherBuffers) {
+      WriteChunk &front = stream->writeQueue.front();
+      buffers[batch.count] = boost::asio::buffer(front.data, front.size);
+      batch.bytes += front.size;
+      batch.chunks[batch.count++] = std::move(front);
+      stream->writeQueue.pop_front();
+    }
+  }
+
+  // Unused trailing entries are empty and contribute nothing to the write.
+  boost::asio::async_write(
+      *socket, buffers,
+      [this, id, batch = std::move(batch)](
+          const boost::system::error_code &writeEc, std::size_t) {
+        bool more = false;
+        std::size_t grant = 0;
+        {
+          std::lock_guard<std::mutex> lock(streamsMutex_);
+          Stream *stream = findStream(id);
+          if (!stream) {
+            return;
+          }
+          stream->writeQueuedBytes -=
+              std::min(stream->writeQueuedBytes, batch.bytes);
+          if (!writeEc && releaseIfDone(*stream)) {
+            return; // the last of a closing stream's data is written
+          }
+          if (!writeEc) {
+            if (stream->service) {
+              stream->service->bytesFromTunnel += batch.bytes;
+            }
+            stream->creditOwed += batch.bytes;
+            // During a resume the owed credit is reported in the Resume.
+            if (stream->creditOwed >= kCreditUpdateBytes && !resumePending_ &&
+                !stream->peerClosed) {
+              grant = stream->creditOwed;
+              stream->creditOwed = 0;
+              stream->creditGranted += grant;
+            }
+          }
+          if (!writeEc) {
+            more = !stream->writeQueue.empty();
+            stream->writing = more;
+          }
+        }
+        if (writeEc) {
+          std::cout << "Error writing to TCP client " << id << ": "
+                    << writeEc.message() << std::endl;
+          removeClient(id);
+          return;
+        }
+        if (grant > 0) {
+          grantCredit(id, grant);
+        }
+        if (more) {
+          startWrite(id);
+        }
+      });
+}
+
+void MultiplexManager::grantCredit(uint32_t id, std::size_t bytes) {
+  uint8_t payload[tunnel::kMaxVarintBytes];
+  const size_t len =
+      tunnel::encodeVarint(static_cast<uint32_t>(bytes), payload);
+  sendTunnelPacket(id, reinterpret_cast<const char *>(payload), len,
+                   tunnel::FrameType::Credit);
+}
+
+void MultiplexManager::sendHello() {
+  uint8_t payload[tunnel::kMaxVarintBytes + tunnel::kMaxVarint64Bytes];
+  size_t len = tunnel::encodeVarint(
+      tunnel::kCapCompression | tunnel::kCapResume, payload);
+  // A host only has a token once its peer's Hello has arrived; until then
+  // it advertises the capability with token 0.
+  len += tunnel::encodeVarint64(sessionToken_.load(std::memory_order_relaxed),
+                                payload + len);
+  sendTunnelPacket(0, reinterpret_cast<const char *>(payload), len,
+                   tunnel::FrameType::Hello);
+}
+
+bool MultiplexManager::replayEnabled() const {
+  // Until the peer's Hello arrives it may still turn out to support resume.
+  return !peerHelloSeen_.load(std::memory_order_relaxed) ||
+         peerResume_.load(std::memory_order_relaxed);
+}
+
+// The replay helpers below run with streamsMutex_ held.
+void MultiplexManager::recordReplay(Stream &stream, PendingFrame frame) {
+  if (!replayEnabled() || !isReplayed(frameTypeOf(frame.frame))) {
+    return;
+  }
+  const std::size_t size = frame.frame.size();
+  stream.replay.push_back(std::move(frame));
+  stream.replayBytes += size;
+  replayBytes_.fetch_add(size, std::memory_order_relaxed);
+}
+
+void MultiplexManager::trimReplay(Stream &stream, uint64_t acked) {
+  const std::size_t bytes = trimAcked(stream.replay, acked);
+  stream.replayBytes -= bytes;
+  replayBytes_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void MultiplexManager::dropReplay(Stream &stream) {
+  replayBytes_.fetch_sub(stream.replayBytes, std::memory_order_relaxed);
+  stream.replay.clear();
+  stream.replayBytes = 0;
+}
+
+void MultiplexManager::eraseLingering(
+    std::map<uint32_t, Lingering>::iterator it) {
+  lingeringBytes_ -= it->second.bytes;
+  replayBytes_.fetch_sub(it->second.bytes, std::memory_order_relaxed);
+  lingering_.erase(it);
+}
+
+void MultiplexManager::pruneLingering(
+    std::chrono::steady_clock::time_point now) {
+  for (auto it = lingering_.begin(); it != lingering_.end();) {
+    auto next = std::next(it);
+    if (it->second.expires <= now) {
+      eraseLingering(it);
+    }
+    it = next;
+  }
+  while (lingering_.size() > kMaxLingering ||
+         lingeringBytes_ > kMaxLingeringBytes) {
+    eraseLingering(std::min_element(
+        lingering_.begin(), lingering_.end(),
+        [](const auto &a, const auto &b) {
+          return a.second.expires < b.second.expires;
+        }));
+  }
+}
+
+std::vector<uint8_t> MultiplexManager::resumePayloadLocked() {
+  std::vector<uint8_t> payload;
+  // Lingering streams are listed too, so the peer keeps its side open
+  // until their tails have been replayed.
+  uint32_t count = static_cast<uint32_t>(lingering_.size());
+  for (const auto &stream : streams_) {
+    count += stream.active ? 1 : 0;
+  }
+  payload.resize(tunnel::kMaxVarintBytes +
+                 count * (tunnel::kMaxVarintBytes +
+                          2 * tunnel::kMaxVarint64Bytes));
+  uint8_t *out = payload.data();
+  out += tunnel::encodeVarint(count, out);
+  for (auto &stream : streams_) {
+    if (!stream.active) {
+      continue;
+    }
+    // Credit still owed is granted here rather than in a Credit frame.
+    stream.creditGranted += stream.creditOwed;
+    stream.creditOwed = 0;
+    out += tunnel::encodeVarint(stream.id, out);
+    out += tunnel::encodeVarint64(stream.receivedBytes, out);
+    out += tunnel::encodeVarint64(stream.creditGranted, out);
+  }
+  for (const auto &entry : lingering_) {
+    out += tunnel::encodeVarint(entry.first, out);
+    out += tunnel::encodeVarint64(entry.second.receivedBytes, out);
+    out += tunnel::encodeVarint64(entry.second.creditGranted, out);
+  }
+  payload.resize(static_cast<std::size_t>(out - payload.data()));
+  return payload;
+}
+
+void MultiplexManager::sendResume() {
+  std::vector<uint8_t> payload;
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    payload = resumePayloadLocked();
+  }
+  sendTunnelPacket(0, reinterpret_cast<const char *>(payload.data()),
+                   payload.size(), tunnel::FrameType::Resume);
+}
+
+void MultiplexManager::applyResume(const char *payload, size_t len) {
+  struct PeerStream {
+    uint64_t received = 0;
+    uint64_t granted = 0;
+  };
+  std::map<uint32_t, PeerStream> peer;
+  const auto *p = reinterpret_cast<const uint8_t *>(payload);
+  const auto *end = p + len;
+  uint32_t count = 0;
+  bool valid = tunnel::decodeVarint(p, end, count);
+  for (uint32_t i = 0; valid && i < count; ++i) {
+    uint32_t id = 0;
+    PeerStream state;
+    valid = tunnel::decodeVarint(p, end, id) &&
+            tunnel::decodeVarint64(p, end, state.received) &&
+            tunnel::decodeVarint64(p, end, state.granted);
+    peer[id] = state;
+  }
+  if (!valid) {
+    std::cerr << "Malformed resume frame" << std::endl;
+    return;
+  }
+
+  std::vector<uint32_t> reads;
+  std::vector<std::pair<uint32_t, std::size_t>> grants;
+  uint64_t resumed = 0;
+  uint64_t lost = 0;
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+  const bool reply = isHost_;
+  std::vector<uint8_t> answer;
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    if (!resumePending_ && !isHost_) {
+      return; // the answer to a resume that already timed out
+    }
+    const auto now = std::chrono::steady_clock::now();
+    for (auto &stream : streams_) {
+      if (!stream.active) {
+        continue;
+      }
+      auto it = peer.find(stream.id);
+      if (it != peer.end()) {
+        trimReplay(stream, it->second.received);
+        stream.creditReceived =
+            std::max(stream.creditReceived, it->second.granted);
+        ++resumed;
+      } else if (!stream.local || stream.receivedBytes != 0 ||
+                 stream.creditReceived != 0) {
+        // The peer closed it, or lost it with its side of the session.
+        releaseStream(stream);
+        ++lost;
+        continue;
+      }
+      // Otherwise our Open never arrived; the whole replay goes again.
+      const uint64_t inFlight =
+          stream.sentBytes - std::min(stream.sentBytes, stream.creditReceived);
+      stream.sendCredit = static_cast<std::size_t>(
+          tunnel::kStreamWindowBytes -
+          std::min<uint64_t>(tunnel::kStreamWindowBytes, inFlight));
+      if (!stream.replay.empty()) {
+        frames += stream.replay.size();
+        bytes += stream.replayBytes;
+        // Back in front of anything queued since; sent and recorded again.
+        for (auto r = stream.replay.rbegin(); r != stream.replay.rend(); ++r) {
+          r->queuedAt = now;
+          stream.pending.push_front(std::move(*r));
+        }
+        dropReplay(stream);
+        appendToOrder(tunnel::streamSlot(stream.id));
+      }
+      if (stream.paused && stream.sendCredit > 0) {
+        stream.paused = false;
+        reads.push_back(stream.id);
+      }
+      if (!reply && stream.creditOwed >= kCreditUpdateBytes) {
+        grants.emplace_back(stream.id, stream.creditOwed);
+        stream.creditGranted += stream.creditOwed;
+        stream.creditOwed = 0;
+      }
+    }
+    if (reply) {
+      // Taken before the lingering tails are handed to the backlog.
+      answer = resumePayloadLocked();
+    }
+    for (auto &entry : lingering_) {
+      auto it = peer.find(entry.first);
+      if (it == peer.end()) {
+        continue; // the peer has its Disconnect
+      }
+      trimAcked(entry.second.replay, it->second.received);
+      for (auto &frame : entry.second.replay) {
+        ++frames;
+        bytes += frame.frame.size();
+        resumeBacklog_.emplace_back(entry.second.lane, std::move(frame.frame));
+      }
+    }
+    replayBytes_.fetch_sub(lingeringBytes_, std::memory_order_relaxed);
+    lingering_.clear();
+    lingeringBytes_ = 0;
+    resumePending_ = false;
+    resumeTimer_->cancel();
+  }
+  streamsResumed_.fetch_add(resumed, std::memory_order_relaxed);
+  streamsLost_.fetch_add(lost, std::memory_order_relaxed);
+  framesReplayed_.fetch_add(frames, std::memory_order_relaxed);
+  bytesReplayed_.fetch_add(bytes, std::memory_order_relaxed);
+  std::cout << "[Multiplex] Session resumed: " << resumed << " streams kept, "
+            << lost << " lost, " << frames << " frames (" << bytes
+            << " bytes) replayed" << std::endl;
+  if (reply) {
+    sendTunnelPacket(0, reinterpret_cast<const char *>(answer.data()),
+                     answer.size(), tunnel::FrameType::Resume);
+  }
+  for (const auto &grant : grants) {
+    grantCredit(grant.first, grant.second);
+  }
+  for (uint32_t id : reads) {
+    startAsyncRead(id);
+  }
+  scheduleFlush();
+}
+
+void MultiplexManager::resumeOn(HSteamNetConnection conn, bool initiator) {
+  boost::asio::dispatch(io_context_, [this, conn, initiator]() {
+    {
+      std::lock_guard<std::mutex> lock(streamsMutex_);
+      steamConn_.store(conn);
+      // Whatever was batched for the old connection is in the replay; tails
+      // still waiting from an earlier resume are given up.
+      resumeBacklog_.clear();
+      for (auto &batch : lanes_) {
+        batch.open.reset();
+        batch.openFrames = 0;
+        batch.stalled.clear();
+      }
+      // Queued Credit frames are reported in the Resume instead.
+      for (auto &stream : streams_) {
+        for (auto it = stream.pending.begin(); it != stream.pending.end();) {
+          tunnel::FrameView frame;
+          uint32_t grant = 0;
+          if (frameTypeOf(it->frame) != tunnel::FrameType::Credit ||
+              !tunnel::parseFrame(it->frame.data(), it->frame.size(), frame)) {
+            ++it;
+            continue;
+          }
+          const auto *p = reinterpret_cast<const uint8_t *>(frame.payload);
+          if (tunnel::decodeVarint(p, p + frame.payloadLen, grant)) {
+            stream.creditGranted -= std::min<uint64_t>(stream.creditGranted,
+                                                       grant);
+            stream.creditOwed += grant;
+          }
+          it = stream.pending.erase(it);
+        }
+      }
+      sendBlocked_.store(false, std::memory_order_relaxed);
+      backoffMs_.store(5, std::memory_order_relaxed);
+      resumePending_ = true;
+      configureLanes();
+    }
+    resumes_.fetch_add(1, std::memory_order_relaxed);
+    std::cout << "[Multiplex] Moving session to connection " << conn
+              << std::endl;
+    sendHello();
+    if (initiator) {
+      sendResume();
+    }
+    resumeTimer_->expires_after(kResumeTimeout);
+    resumeTimer_->async_wait([this](const boost::system::error_code &ec) {
+      if (ec) {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(streamsMutex_);
+      if (!resumePending_) {
+        return;
+      }
+      std::cerr << "[Multiplex] Peer did not resume the session, closing "
+                   "its streams"
+                << std::endl;
+      for (auto &stream : streams_) {
+        if (stream.active) {
+          releaseStream(stream);
+        }
+      }
+      resumePending_ = false;
+    });
+    scheduleFlush();
+  });
+}
+
+bool MultiplexManager::canResume() const {
+  return peerResume_.load(std::memory_order_relaxed) &&
+         sessionToken_.load(std::memory_order_relaxed) != 0;
+}
+
+void MultiplexManager::closeSession() {
+  boost::asio::dispatch(io_context_, [this]() {
+    if (hostUdp_) {
+      hostUdp_->stop();
+      hostUdp_.reset();
+    }
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    closed_ = true;
+    for (auto &stream : streams_) {
+      if (stream.active) {
+        releaseStream(stream);
+      }
+    }
+    replayBytes_.fetch_sub(lingeringBytes_, std::memory_order_relaxed);
+    lingering_.clear();
+    lingeringBytes_ = 0;
+    resumeBacklog_.clear();
+    resumePending_ = false;
+    for (auto &batch : lanes_) {
+      batch.open.reset();
+      batch.openFrames = 0;
+      batch.stalled.clear();
+    }
+    sendTimer_->cancel();
+    batchTimer_->cancel();
+    warmTimer_->cancel();
+    resumeTimer_->cancel();
+    reapTimer_->cancel();
+    // Connects still in flight find no pool and close their sockets.
+    boost::system::error_code ec;
+    for (auto &entry : warmPools_) {
+      for (auto &warm : entry.second.idle) {
+        warm.socket->close(ec);
+      }
+    }
+    warmPools_.clear();
+  });
+}
+
+bool MultiplexManager::isDrained() const {
+  return closed_.load(std::memory_order_relaxed) &&
+         warmConnectsInFlight_.load(std::memory_order_relaxed) == 0;
+}
+
+void MultiplexManager::setStreamIdleTimeout(std::chrono::seconds timeout) {
+  streamIdleTimeoutSec_.store(std::max<int64_t>(0, timeout.count()),
+                              std::memory_order_relaxed);
+}
+
+void MultiplexManager::setUploadScheduler(UploadScheduler *scheduler,
+                                          uint64_t client) {
+  uploadClient_.store(client, std::memory_order_relaxed);
+  uploadScheduler_.store(scheduler, std::memory_order_relaxed);
+}
+
+void MultiplexManager::armReapTimer() {
+  reapTimer_->expires_after(kReapInterval);
+  reapTimer_->async_wait([this](const boost::system::error_code &ec) {
+    if (ec || closed_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    reapIdleStreams();
+    armReapTimer();
+  });
+}
+
+void MultiplexManager::reapIdleStreams() {
+  const auto now = std::chrono::steady_clock::now();
+  const std::chrono::seconds timeout(
+      streamIdleTimeoutSec_.load(std::memory_order_relaxed));
+  std::vector<uint32_t> idle;
+  std::vector<uint32_t> stuck;
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    // Lingering replays otherwise only expire when another stream closes.
+    pruneLingering(now);
+    for (auto &stream : streams_) {
+      if (!stream.active) {
+        continue;
+      }
+      if (stream.draining || stream.peerClosed) {
+        // Closing: progress is data written to the host or sent on.
+        const uint64_t progress = stream.creditGranted + stream.creditOwed +
+                                  stream.pending.size();
+        if (progress != stream.activityMark) {
+          stream.activityMark = progress;
+          stream.idleSince = now;
+        } else if (now - stream.idleSince >= kCloseDrainTimeout) {
+          stuck.push_back(stream.id);
+        }
+        continue;
+      }
+      const uint64_t activity = stream.sentBytes + stream.receivedBytes;
+      if (activity != stream.activityMark || stream.queued ||
+          stream.connecting || stream.writeQueuedBytes > 0 ||
+          stream.idleSince == std::chrono::steady_clock::time_point{}) {
+        stream.activityMark = activity;
+        stream.idleSince = now;
+        continue;
+      }
+      if (timeout.count() > 0 && now - stream.idleSince >= timeout) {
+        idle.push_back(stream.id);
+      }
+    }
+  }
+  for (uint32_t id : idle) {
+    std::cout << "[Multiplex] Closing stream " << id << " after "
+              << timeout.count() << "s without traffic" << std::endl;
+    streamsReaped_.fetch_add(1, std::memory_order_relaxed);
+    finishLocalStream(id);
+  }
+  for (uint32_t id : stuck) {
+    std::cout << "[Multiplex] Dropping stream " << id << " after "
+              << kCloseDrainTimeout.count() << "s closing" << std::endl;
+    streamsReaped_.fetch_add(1, std::memory_order_relaxed);
+    removeClient(id);
+  }
+}
+
+MultiplexManager::HeldStats MultiplexManager::getHeldStats() const {
+  HeldStats stats;
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  for (const auto &stream : streams_) {
+    if (!stream.active) {
+      continue;
+    }
+    ++stats.streams;
+    stats.bytes += stream.readBuffer.capacity() + stream.writeQueuedBytes +
+                   stream.replayBytes;
+    for (const auto &pending : stream.pending) {
+      stats.queuedBytes += pending.frame.size();
+    }
+    if (!stream.pending.empty()) {
+      stats.queueDelayUs = std::max<uint64_t>(
+          stats.queueDelayUs,
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              now - stream.pending.front().queuedAt)
+              .count());
+    }
+  }
+  stats.bytes += stats.queuedBytes;
+  stats.bytes += lingeringBytes_;
+  for (const auto &entry : resumeBacklog_) {
+    stats.bytes += entry.second.size();
+  }
+  for (const auto &batch : lanes_) {
+    stats.bytes += batch.open.capacity();
+    for (const auto &packet : batch.stalled) {
+      stats.bytes += packet.size;
+    }
+  }
+  stats.streamsReaped = streamsReaped_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+MultiplexManager::ResumeStats MultiplexManager::getResumeStats() const {
+  ResumeStats stats;
+  stats.resumes = resumes_.load(std::memory_order_relaxed);
+  stats.streamsResumed = streamsResumed_.load(std::memory_order_relaxed);
+  stats.streamsLost = streamsLost_.load(std::memory_order_relaxed);
+  stats.framesReplayed = framesReplayed_.load(std::memory_order_relaxed);
+  stats.bytesReplayed = bytesReplayed_.load(std::memory_order_relaxed);
+  stats.replayBytes = replayBytes_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void MultiplexManager::sendStreamData(uint32_t id, const char *data,
+                                      size_t len, bool compress) {
+  if (!compress || len < kMinCompressBytes) {
+    sendTunnelPacket(id, data, len, tunnel::FrameType::Data);
+    return;
+  }
+  const size_t chunkBytes = chunkBytes_.load(std::memory_order_relaxed);
+  PooledBuffer scratch = BufferPool::instance().acquire(
+      tunnel::kMaxVarintBytes + lz::compressBound(chunkBytes));
+  auto *out = reinterpret_cast<uint8_t *>(scratch.data());
+  bool probed = false;
+  size_t offset = 0;
+  while (offset < len) {
+    const size_t chunk = std::min(chunkBytes, len - offset);
+    size_t packed = 0;
+    size_t head = 0;
+    if (chunk >= kMinCompressBytes) {
+      head = tunnel::encodeVarint(static_cast<uint32_t>(chunk), out);
+      const size_t budget = chunk - chunk / kMinCompressSavings - head;
+      const auto started = std::chrono::steady_clock::now();
+      packed = lz::compress(reinterpret_cast<const uint8_t *>(data + offset),
+                            chunk, out + head, budget);
+      compressNs_.fetch_add(elapsedNs(started), std::memory_order_relaxed);
+    }
+    if (packed == 0 && !probed) {
+      // The first chunk is the probe: if it does not shrink, the rest of
+      // this read goes out raw and the stream backs off.
+      compressProbesFailed_.fetch_add(1, std::memory_order_relaxed);
+      compressBytesSkipped_.fetch_add(len - offset, std::memory_order_relaxed);
+      sendTunnelPacket(id, data + offset, len - offset,
+                       tunnel::FrameType::Data);
+      std::lock_guard<std::mutex> lock(streamsMutex_);
+      if (Stream *stream = findStream(id)) {
+        stream->compressBackoff =
+            std::min(stream->compressBackoff + 1, kMaxCompressBackoff);
+        stream->compressSkip = kCompressSkipBase << stream->compressBackoff;
+      }
+      return;
+    }
+    if (!probed) {
+      probed = true;
+      std::lock_guard<std::mutex> lock(streamsMutex_);
+      if (Stream *stream = findStream(id)) {
+        stream->compressBackoff = 0;
+      }
+    }
+    if (packed > 0) {
+      chunksCompressed_.fetch_add(1, std::memory_order_relaxed);
+      compressBytesIn_.fetch_add(chunk, std::memory_order_relaxed);
+      compressBytesOut_.fetch_add(head + packed, std::memory_order_relaxed);
+      sendTunnelPacket(id, scratch.data(), head + packed,
+                       tunnel::FrameType::CompressedData);
+    } else {
+      compressBytesSkipped_.fetch_add(chunk, std::memory_order_relaxed);
+      sendTunnelPacket(id, data + offset, chunk, tunnel::FrameType::Data);
+    }
+    offset += chunk;
+  }
+}
+
+void MultiplexManager::setCompressionEnabled(bool enabled) {
+  compressionEnabled_.store(enabled, std::memory_order_relaxed);
+}
+
+MultiplexManager::CompressionStats
+MultiplexManager::getCompressionStats() const {
+  CompressionStats stats;
+  stats.negotiated = peerCompression_.load(std::memory_order_relaxed);
+  stats.chunksCompressed = chunksCompressed_.load(std::memory_order_relaxed);
+  stats.bytesIn = compressBytesIn_.load(std::memory_order_relaxed);
+  stats.bytesOut = compressBytesOut_.load(std::memory_order_relaxed);
+  stats.bytesSkipped = compressBytesSkipped_.load(std::memory_order_relaxed);
+  stats.probesFailed = compressProbesFailed_.load(std::memory_order_relaxed);
+  stats.compressNs = compressNs_.load(std::memory_order_relaxed);
+  stats.decompressNs = decompressNs_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void MultiplexManager::startAsyncRead(uint32_t id) {
+  std::shared_ptr<tcp::socket> socket;
+  PooledBuffer buffer;
+  std::size_t readLimit = 0;
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    if (Stream *stream = findStream(id)) {
+      if (stream->peerClosed) {
+        return;
+      }
+      if (stream->sendCredit == 0) {
+        // Out of credit: only this stream waits for the peer to drain.
+        stream->paused = true;
+        return;
+      }
+      socket = stream->socket;
+      buffer = stream->readBuffer;
+      readLimit = std::min(buffer.size(), stream->sendCredit);
+    }
+  }
+  if (!socket || !buffer) {
     std::cout << "Error: Socket is null for id " << id << std::endl;
     return;
   }
   socket->async_read_some(
-      boost::asio::buffer(readBuffers_[id]),
-      [this, id](const boost::system::error_code &ec,
-                 std::size_t bytes_transferred) {
+      boost::asio::buffer(buffer.data(), readLimit),
+      [this, id, buffer](const boost::system::error_code &ec,
+                         std::size_t bytes_transferred) {
         if (!ec) {
           if (bytes_transferred > 0) {
-            sendTunnelPacket(id, readBuffers_[id].data(), bytes_transferred, 0);
-            if (sendBlocked_.load(std::memory_order_relaxed)) {
-              std::lock_guard<std::mutex> lock(pausedMutex_);
-              pausedReads_.insert(id);
-              return;
+            bool compress = peerCompression_.load(std::memory_order_relaxed) &&
+                            compressionEnabled_.load(std::memory_order_relaxed);
+            {
+              std::lock_guard<std::mutex> lock(streamsMutex_);
+              if (Stream *stream = findStream(id)) {
+                if (stream->peerClosed) {
+                  return; // the peer takes nothing more
+                }
+                stream->sendCredit -=
+                    std::min(stream->sendCredit, bytes_transferred);
+                if (stream->service) {
+                  stream->service->bytesToTunnel += bytes_transferred;
+                }
+                adaptReadBuffer(*stream, bytes_transferred);
+                if (compress && stream->compressSkip > 0) {
+                  --stream->compressSkip;
+                  compressBytesSkipped_.fetch_add(bytes_transferred,
+                                                  std::memory_order_relaxed);
+                  compress = false;
+                }
+              }
             }
+            sendStreamData(id, buffer.data(), bytes_transferred, compress);
           }
           startAsyncRead(id);
-        } else {
-          std::cout << "Error reading from TCP client " << id << ": "
-                    << ec.message() << std::endl;
-          removeClient(id);
+        } else if (ec != boost::asio::error::operation_aborted) {
+          std::cout << "TCP client " << id << " closed: " << ec.message()
+                    << std::endl;
+          finishLocalStream(id);
         }
       });
 }
 
-void MultiplexManager::resumePausedReads() {
-  std::vector<std::string> toResume;
+void MultiplexManager::finishLocalStream(uint32_t id) {
+  {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    Stream *stream = findStream(id);
+    if (!stream || stream->draining || stream->peerClosed) {
+      return;
+    }
+    stream->draining = true;
+    stream->idleSince = std::chrono::steady_clock::now();
+  }
+  // The Disconnect queues behind data still waiting for the link, and the
+  // slot is released once it has gone out and the host socket has taken
+  // what the peer sent before it saw the Disconnect.
+  sendTunnelPacket(id, nullptr, 0, tunnel::FrameType::Disconnect);
   {
-    std::lock_guard<std::mutex> lock(pausedMutex_);
-    toResume.assign(pausedReads_.begin(), pausedReads_.end());
-    pausedReads_.clear();
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    if (Stream *stream = findStream(id)) {
+      releaseIfDone(*stream);
+    }
   }
-  for (const auto &pausedId : toResume) {
-    startAsyncRead(pausedId);
+}
+
+bool MultiplexManager::setReadBuffer(Stream &stream, std::size_t bytes,
+                                     bool force) {
+  const std::size_t old = stream.readBuffer.size();
+  if (bytes > old) {
+    const std::size_t delta = bytes - old;
+    std::size_t used = g_readBufferBytes.load(std::memory_order_relaxed);
+    do {
+      if (!force &&
+          used + delta > g_readBufferBudget.load(std::memory_order_relaxed)) {
+        g_readBufferDenied.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+    } while (!g_readBufferBytes.compare_exchange_weak(
+        used, used + delta, std::memory_order_relaxed));
+  } else {
+    g_readBufferBytes.fetch_sub(old - bytes, std::memory_order_relaxed);
   }
+  // A read in flight keeps its own reference to the old buffer.
+  stream.readBuffer =
+      bytes > 0 ? BufferPool::instance().acquire(bytes) : PooledBuffer();
+  return true;
+}
+
+void MultiplexManager::adaptReadBuffer(Stream &stream, std::size_t bytes) {
+  const std::size_t size = stream.readBuffer.size();
+  constexpr std::size_t kSteps = std::size(kReadBufferSizes);
+  std::size_t step = 0;
+  while (step + 1 < kSteps && kReadBufferSizes[step] < size) {
+    ++step;
+  }
+  if (bytes >= size) {
+    stream.shortReads = 0;
+    if (++stream.fullReads >= kReadGrowAfter && step + 1 < kSteps) {
+      stream.fullReads = 0;
+      if (setReadBuffer(stream, kReadBufferSizes[step + 1], false)) {
+        g_readBufferGrows.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  } else if (bytes < size / 4) {
+    stream.fullReads = 0;
+    if (++stream.shortReads >= kReadShrinkAfter && step > 0) {
+      stream.shortReads = 0;
+      setReadBuffer(stream, kReadBufferSizes[step - 1], true);
+      g_readBufferShrinks.fetch_add(1, std::memory_order_relaxed);
+    }
+  } else {
+    stream.fullReads = 0;
+    stream.shortReads = 0;
+  }
+}
+
+MultiplexManager::ReadBufferStats MultiplexManager::getReadBufferStats() {
+  ReadBufferStats stats;
+  stats.bytesInUse = g_readBufferBytes.load(std::memory_order_relaxed);
+  stats.budgetBytes = g_readBufferBudget.load(std::memory_order_relaxed);
+  stats.grows = g_readBufferGrows.load(std::memory_order_relaxed);
+  stats.shrinks = g_readBufferShrinks.load(std::memory_order_relaxed);
+  stats.budgetDenied = g_readBufferDenied.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void MultiplexManager::setReadBufferBudget(std::size_t bytes) {
+  g_readBufferBudget.store(bytes, std::memory_order_relaxed);
+}
+
+MultiplexManager::ReceiveStats MultiplexManager::getReceiveStats() {
+  ReceiveStats stats;
+  stats.messagesHeld = g_heldMessages.load(std::memory_order_relaxed);
+  stats.bytesHeld = g_heldMessageBytes.load(std::memory_order_relaxed);
+  stats.bytesZeroCopy = g_zeroCopyBytes.load(std::memory_order_relaxed);
+  stats.bytesCopied = g_copiedBytes.load(std::memory_order_relaxed);
+  stats.capReached = g_heldCapReached.load(std::memory_order_relaxed);
+  return stats;
 }
 
 bool MultiplexManager::isSendSaturated() {
+  sampleRound();
+  return roundSaturated_;
+}
+
+void MultiplexManager::sampleRound() {
+  if (roundSampled_) {
+    return;
+  }
+  roundSampled_ = true;
+  roundPendingReliable_ = 0;
+  roundPendingTotal_ = 0;
+  // A failed status call leaves the tuning and the blocked state as they
+  // are; a zeroed status would collapse the BDP estimate.
+  SteamNetConnectionRealTimeStatus_t status{};
+  const bool sampled =
+      steamInterface_->GetConnectionRealTimeStatus(steamConn_, &status, 0,
+                                                   nullptr) == k_EResultOK;
+  if (sampled) {
+    retuneLink(status);
+    roundPendingReliable_ =
+        static_cast<std::size_t>(std::max(status.m_cbPendingReliable, 0));
+    roundPendingTotal_ =
+        roundPendingReliable_ +
+        static_cast<std::size_t>(std::max(status.m_cbPendingUnreliable, 0));
+  }
+  {
+    std::lock_guard<std::mutex> lock(tuningMutex_);
+    roundSendBuffer_ = static_cast<std::size_t>(profile_.sendBufferBytes);
+  }
+
+  // Out of this client's share of the host upload: hold like a full link,
+  // without the backoff (the share refills on its own schedule).
+  if (UploadScheduler *scheduler =
+          uploadScheduler_.load(std::memory_order_relaxed)) {
+    if (!scheduler->maySend(uploadClient_.load(std::memory_order_relaxed))) {
+      roundSaturated_ = true;
+      return;
+    }
+  }
   if (sendBlocked_.load(std::memory_order_relaxed)) {
     auto elapsed = std::chrono::steady_clock::now() - lastBlocked_;
     if (elapsed < std::chrono::milliseconds(backoffMs_.load())) {
-      return true;
+      roundSaturated_ = true;
+      return;
     }
     // Time to retry; keep going but do not clear the flag yet until we send.
   }
-
-  SteamNetConnectionRealTimeStatus_t status{};
-  if (steamInterface_->GetConnectionRealTimeStatus(steamConn_, &status, 0,
-                                                   nullptr)) {
-    const std::size_t pending =
-        static_cast<std::size_t>(status.m_cbPendingReliable);
-    if (pending >= kHighWaterBytes) {
+  if (sampled) {
+    if (roundPendingReliable_ >= highWaterBytes_.load(std::memory_order_relaxed)) {
       lastBlocked_ = std::chrono::steady_clock::now();
       int current = backoffMs_.load(std::memory_order_relaxed);
       int next = std::min(current * 2, 200);
       backoffMs_.store(next, std::memory_order_relaxed);
       sendBlocked_.store(true, std::memory_order_relaxed);
-      return true;
+      roundSaturated_ = true;
+      return;
     }
-    if (pending <= kLowWaterBytes) {
+    if (roundPendingReliable_ <= lowWaterBytes_.load(std::memory_order_relaxed)) {
       sendBlocked_.store(false, std::memory_order_relaxed);
       backoffMs_.store(5, std::memory_order_relaxed);
-      return false;
+      roundSaturated_ = false;
+      return;
     }
   }
+  roundSaturated_ = sendBlocked_.load(std::memory_order_relaxed);
+}
+
+void MultiplexManager::retuneLink(
+    const SteamNetConnectionRealTimeStatus_t &status) {
+  const int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch())
+                            .count();
+  int64_t last = lastTuneUs_.load(std::memory_order_relaxed);
+  if (nowUs - last < std::chrono::microseconds(kTuneInterval).count() ||
+      !lastTuneUs_.compare_exchange_strong(last, nowUs)) {
+    return;
+  }
+
+  const int ping = std::max(status.m_nPing, 1);
+  const double rate =
+      std::max(static_cast<double>(status.m_nSendRateBytesPerSecond),
+               static_cast<double>(status.m_flOutBytesPerSec));
+  if (rate <= 0.0) {
+    return;
+  }
 
-  return sendBlocked_.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(tuningMutex_);
+  // Smooth both inputs so one noisy sample does not swing the watermarks.
+  if (tuning_.samples == 0) {
+    tuning_.pingMs = ping;
+    tuning_.sendRateBytesPerSec = rate;
+  } else {
+    tuning_.pingMs = (3 * tuning_.pingMs + ping) / 4;
+    tuning_.sendRateBytesPerSec = (3 * tuning_.sendRateBytesPerSec + rate) / 4;
+  }
+  ++tuning_.samples;
+
+  const std::size_t bdp = static_cast<std::size_t>(
+      tuning_.sendRateBytesPerSec * tuning_.pingMs / 1000.0);
+  // Two BDPs (the balanced profile) keep the pipe full across a round trip
+  // of rate changes, plus what the link drains while a blocked flush backs
+  // off (up to 200ms).
+  // Small chunks on thin links keep interactive frames close together.
+  const std::size_t backoffBytes =
+      static_cast<std::size_t>(tuning_.sendRateBytesPerSec / 5);
+  const std::size_t highWater =
+      std::clamp(profile_.highWaterBdps * bdp + backoffBytes,
+                 kMinHighWaterBytes,
+                 std::max(profile_.maxHighWaterBytes, kMinHighWaterBytes));
+  const std::size_t chunk =
+      std::clamp(bdp / 64, profile_.minChunkBytes, profile_.maxChunkBytes);
+
+  const std::size_t previousChunk = tuning_.chunkBytes;
+  const std::size_t previousHigh = tuning_.highWaterBytes;
+  tuning_.bdpBytes = bdp;
+  tuning_.chunkBytes = chunk;
+  tuning_.highWaterBytes = highWater;
+  tuning_.lowWaterBytes = highWater / 2;
+  chunkBytes_.store(chunk, std::memory_order_relaxed);
+  highWaterBytes_.store(highWater, std::memory_order_relaxed);
+  lowWaterBytes_.store(highWater / 2, std::memory_order_relaxed);
+
+  if (chunk != previousChunk || highWater > previousHigh + previousHigh / 4 ||
+      highWater < previousHigh - previousHigh / 4) {
+    std::cout << "[Multiplex] Link tuning: ping " << tuning_.pingMs
+              << "ms, rate " << static_cast<int64_t>(rate) << " B/s, BDP "
+              << bdp << " -> chunk " << chunk << ", watermarks " << highWater
+              << "/" << highWater / 2 << std::endl;
+  }
 }
 
-void MultiplexManager::removeFromOrder(const std::string &id) {
-  sendOrderSet_.erase(id);
-  sendOrder_.erase(std::remove(sendOrder_.begin(), sendOrder_.end(), id),
-                   sendOrder_.end());
+MultiplexManager::LinkTuning MultiplexManager::getLinkTuning() const {
+  std::lock_guard<std::mutex> lock(tuningMutex_);
+  return tuning_;
+}
+
+// Both run with streamsMutex_ held. A queued stream's priority only
+// changes while it is out of the list.
+void MultiplexManager::appendToOrder(uint32_t slot) {
+  Stream &stream = streams_[slot];
+  if (stream.queued) {
+    return;
+  }
+  PriorityClass &cls = classes_[static_cast<std::size_t>(stream.priority)];
+  stream.queued = true;
+  stream.prevQueued = cls.tail;
+  stream.nextQueued = kNoSlot;
+  if (cls.tail != kNoSlot) {
+    streams_[cls.tail].nextQueued = slot;
+  } else {
+    cls.head = slot;
+  }
+  cls.tail = slot;
+  ++cls.queuedSlots;
+}
+
+void MultiplexManager::removeFromOrder(uint32_t slot) {
+  if (slot >= streams_.size() || !streams_[slot].queued) {
+    return;
+  }
+  Stream &stream = streams_[slot];
+  PriorityClass &cls = classes_[static_cast<std::size_t>(stream.priority)];
+  if (stream.prevQueued != kNoSlot) {
+    streams_[stream.prevQueued].nextQueued = stream.nextQueued;
+  } else {
+    cls.head = stream.nextQueued;
+  }
+  if (stream.nextQueued != kNoSlot) {
+    streams_[stream.nextQueued].prevQueued = stream.prevQueued;
+  } else {
+    cls.tail = stream.prevQueued;
+  }
+  stream.prevQueued = kNoSlot;
+  stream.nextQueued = kNoSlot;
+  stream.queued = false;
+  --cls.queuedSlots;
 }
@@ -1,67 +1,583 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono>
-#include <unordered_map>
-#include <unordered_set>
 #include <deque>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
-#include <vector>
 #include <string>
+#include <vector>
 #include <boost/asio.hpp>
 #include <steam_api.h>
 #include <isteamnetworkingsockets.h>
 #include <steamnetworkingtypes.h>
 
+#include "buffer_pool.h"
+#include "udp_forwarder.h"
+#include "transport_profile.h"
+#include "tunnel_protocol.h"
+#include "upload_scheduler.h"
+
 using boost::asio::ip::tcp;
 
 class MultiplexManager {
 public:
-    MultiplexManager(ISteamNetworkingSockets* steamInterface, HSteamNetConnection steamConn, 
-                     boost::asio::io_context& io_context, bool& isHost, int& localPort);
+    // Scheduling classes for queued frames, served by weighted deficit round
+    // robin when the Steam link is saturated.
+    enum class StreamPriority : uint8_t { Interactive = 0, Normal = 1, Bulk = 2 };
+    static constexpr std::size_t kPriorityCount = 3;
+    static constexpr std::size_t kDelayBuckets = 24;
+    // Messages handed to receiveTunnelMessages but not yet handled.
+    static constexpr int kMaxInboundMessages = 4096;
+
+    struct PriorityStats {
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        uint64_t totalDelayUs = 0;
+        uint64_t maxDelayUs = 0;
+        // Bucket i counts delays below 2^i microseconds (bucket 0: under 1us).
+        std::array<uint64_t, kDelayBuckets> delayHistogram{};
+        uint64_t averageDelayUs() const { return frames ? totalDelayUs / frames : 0; }
+        // Upper bound of the bucket holding the given quantile (0..1).
+        uint64_t percentileDelayUs(double quantile) const;
+    };
+
+    // `steamUtils` defaults to SteamNetworkingUtils(); benches pass a stand-in.
+    MultiplexManager(ISteamNetworkingSockets* steamInterface, HSteamNetConnection steamConn,
+                     boost::asio::io_context& io_context, bool& isHost, int& localPort,
+                     ISteamNetworkingUtils* steamUtils = nullptr);
     ~MultiplexManager();
 
-    std::string addClient(std::shared_ptr<tcp::socket> socket);
-    bool removeClient(const std::string& id);
-    std::shared_ptr<tcp::socket> getClient(const std::string& id);
+    // `service` names the port-map entry the socket was accepted on; it is
+    // sent in the stream's Open frame. The manager is the socket's only
+    // reader; `onClosed` is posted to the io_context once the stream ends.
+    uint32_t addClient(std::shared_ptr<tcp::socket> socket, const std::string& service = {},
+                       std::function<void()> onClosed = {});
+    bool removeClient(uint32_t id);
+    std::shared_ptr<tcp::socket> getClient(uint32_t id);
 
-    void sendTunnelPacket(const std::string& id, const char* data, size_t len, int type);
+    void sendTunnelPacket(uint32_t id, const char* data, size_t len, tunnel::FrameType type);
 
     void handleTunnelPacket(const char* data, size_t len);
+    // Runs handleTunnelPacket for each message on the manager's io_context
+    // and releases it there. Called from the Steam poll loop; messages keep
+    // their order because one context runs a connection's handlers.
+    void receiveTunnelMessages(SteamNetworkingMessage_t** messages, int count);
+    boost::asio::io_context& ioContext() { return io_context_; }
+
+    // Host side: named services and their local target ports. The default
+    // (unnamed) service always maps to localPort.
+    void setServices(const std::vector<tunnel::TunnelService>& services);
+
+    struct ServiceStats {
+        uint64_t streamsOpened = 0;
+        uint64_t activeStreams = 0;
+        uint64_t bytesToTunnel = 0;   // read from local sockets
+        uint64_t bytesFromTunnel = 0; // written to local sockets
+    };
+    std::map<std::string, ServiceStats> getServiceStats() const;
+
+    // UDP forwarding: datagrams travel as unreliable messages keyed by flow.
+    // Without a handler, a host forwards them to localPort itself.
+    void sendDatagram(uint32_t flowId, const char* data, size_t len);
+    void setDatagramHandler(DatagramSendCallback handler);
+    bool hasDatagramHandler() const;
+
+    // True while too many received messages wait for this manager's
+    // context; the Steam poll loop stops draining this connection until it
+    // catches up. Local write queues need no such check: stream credit
+    // bounds each one to the window. Never during a resume: nothing drains
+    // until the peer's Resume is read.
+    bool isReceiveBlocked() const {
+        return !resumePending_.load(std::memory_order_relaxed) &&
+               inboundMessages_.load(std::memory_order_relaxed) >= kMaxInboundMessages;
+    }
+
+    // Small frames from any stream are coalesced into one Steam message until
+    // the batch is full or the batch deadline expires.
+    struct BatchStats {
+        uint64_t framesSent = 0;
+        uint64_t messagesSent = 0;
+        uint64_t sizeFlushes = 0;
+        uint64_t deadlineFlushes = 0;
+        uint64_t submits = 0;  // SendMessages calls; a flush round makes one
+        uint64_t refused = 0;  // messages Steam turned away, kept for retry
+        double batchFactor() const {
+            return messagesSent ? static_cast<double>(framesSent) / messagesSent : 0.0;
+        }
+    };
+    BatchStats getBatchStats() const;
+
+    // Host-side connects to the local service, which run asynchronously.
+    struct ConnectStats {
+        uint64_t completed = 0;
+        uint64_t failed = 0;
+        uint64_t totalLatencyUs = 0;
+        uint64_t lastLatencyUs = 0;
+        uint64_t warmHits = 0;   // streams that adopted a pre-connected socket
+        uint64_t warmStale = 0;  // pooled sockets found closed by the service
+        std::size_t warmIdle = 0;
+        uint64_t averageLatencyUs() const { return completed ? totalLatencyUs / completed : 0; }
+    };
+    ConnectStats getConnectStats() const;
+    // Streams currently open in either direction; used to spread new
+    // streams across parallel connections to the same peer.
+    std::size_t activeStreamCount() const { return activeStreams_.load(std::memory_order_relaxed); }
+    // Upper bound on pre-connected sockets kept per target port (0 disables).
+    // The pool sizes itself to the recent stream open rate below this.
+    void setWarmPoolLimit(std::size_t limit);
+
+    // New streams take the class configured for their local port (the
+    // listen port on the client, the service port on the host).
+    void setPortPriority(uint16_t port, StreamPriority priority);
+    void setStreamPriority(uint32_t id, StreamPriority priority);
+    void setPriorityWeight(StreamPriority priority, uint32_t weight);
+    PriorityStats getPriorityStats(StreamPriority priority) const;
+
+    // Each class sends on its own Steam lane, so a bulk transfer no longer
+    // head-of-line blocks interactive frames in Steam's reliable ordering.
+    // Interactive has strict priority; Normal and Bulk share by class weight.
+    struct LaneStats {
+        bool configured = false; // false: Steam refused lanes, all share lane 0
+        int pendingReliableBytes = 0;
+        int pendingUnreliableBytes = 0;
+        int sentUnackedBytes = 0;
+        int64_t queueTimeUs = 0; // Steam's estimate for a message queued now
+        uint64_t messagesSent = 0;
+        uint64_t bytesSent = 0;
+    };
+    LaneStats getLaneStats(StreamPriority priority) const;
+
+    // Chunk size and send watermarks derived from the measured
+    // bandwidth-delay product of the Steam connection.
+    struct LinkTuning {
+        int pingMs = 0;
+        double sendRateBytesPerSec = 0.0;
+        std::size_t bdpBytes = 0;
+        std::size_t chunkBytes = 0;
+        std::size_t highWaterBytes = 0;
+        std::size_t lowWaterBytes = 0;
+        uint64_t samples = 0;
+    };
+    LinkTuning getLinkTuning() const;
+    void setBatchDelay(std::chrono::microseconds delay);
+    // Sets the chunk and watermark bounds, the batch delay and the options
+    // of local sockets, including those already open.
+    void setTransportProfile(const TransportProfile& profile);
+
+    // Stream data is compressed per chunk once the peer's Hello advertises
+    // support. A stream whose data does not shrink backs off and re-probes
+    // later, so already-compressed traffic costs one trial per probe.
+    struct CompressionStats {
+        bool negotiated = false;
+        uint64_t chunksCompressed = 0;
+        uint64_t bytesIn = 0;      // raw size of compressed chunks
+        uint64_t bytesOut = 0;     // their size on the wire
+        uint64_t bytesSkipped = 0; // sent raw while negotiated
+        uint64_t probesFailed = 0;
+        uint64_t compressNs = 0;
+        uint64_t decompressNs = 0;
+        uint64_t bytesSaved() const { return bytesIn > bytesOut ? bytesIn - bytesOut : 0; }
+    };
+    CompressionStats getCompressionStats() const;
+    void setCompressionEnabled(bool enabled);
+
+    // Read buffers start small and grow with the reads a stream actually
+    // sees. Growth across all managers stays within one process-wide budget;
+    // every stream always keeps its minimum buffer.
+    struct ReadBufferStats {
+        std::size_t bytesInUse = 0;
+        std::size_t budgetBytes = 0;
+        uint64_t grows = 0;
+        uint64_t shrinks = 0;
+        uint64_t budgetDenied = 0;
+    };
+    static ReadBufferStats getReadBufferStats();
+    static void setReadBufferBudget(std::size_t bytes);
+
+    // Stream payloads received from Steam are written to local sockets
+    // straight out of the Steam message, which is released once the last
+    // write from it completes. Small payloads are copied, and so is
+    // everything while the process-wide cap on held messages is reached,
+    // so held messages cannot starve Steam's receive buffers.
+    struct ReceiveStats {
+        std::size_t messagesHeld = 0;
+        std::size_t bytesHeld = 0;   // size of the held messages
+        uint64_t bytesZeroCopy = 0;  // written from a held message
+        uint64_t bytesCopied = 0;
+        uint64_t capReached = 0;     // payloads copied because of the cap
+    };
+    static ReceiveStats getReceiveStats();
+
+    // Session resumption: streams outlive their Steam connection. When the
+    // client reaches the same host again (ICE-to-relay fallback, or a drop
+    // and rejoin within kResumeWindow), both managers are moved to the new
+    // connection, exchange per-stream byte counts and resend what the other
+    // side never received. Each stream keeps the frames its peer has not
+    // credited yet, so its replay buffer is bounded by the stream window.
+    static constexpr std::chrono::seconds kResumeWindow{30};
+    struct ResumeStats {
+        uint64_t resumes = 0;
+        uint64_t streamsResumed = 0;
+        uint64_t streamsLost = 0; // closed because the peer no longer had them
+        uint64_t framesReplayed = 0;
+        uint64_t bytesReplayed = 0;
+        std::size_t replayBytes = 0; // retained right now
+    };
+    ResumeStats getResumeStats() const;
+    // The client's random token; a host adopts its peer's from the Hello.
+    uint64_t sessionToken() const { return sessionToken_.load(std::memory_order_relaxed); }
+    bool canResume() const;
+    // Moves the session to `conn` and holds stream traffic until the peer's
+    // Resume arrives. The initiator (the client) sends its Resume at once;
+    // the host answers the one it receives.
+    void resumeOn(HSteamNetConnection conn, bool initiator);
+    // Ends every stream, for a session that will not be resumed, and stops
+    // the manager's timers; frames arriving afterwards are ignored.
+    void closeSession();
+    // True once closed and no local connect is still outstanding. Handlers
+    // refer to the manager by pointer, so it is only destroyed after this.
+    bool isDrained() const;
+
+    // Streams without traffic in either direction for this long are closed
+    // (0 keeps them open). Streams with queued or connecting data are busy.
+    void setStreamIdleTimeout(std::chrono::seconds timeout);
+    struct HeldStats {
+        std::size_t streams = 0;
+        std::size_t bytes = 0; // queued, buffered or kept for replay
+        std::size_t queuedBytes = 0; // frames waiting for the link
+        uint64_t queueDelayUs = 0;   // age of the oldest of them
+        uint64_t streamsReaped = 0;
+    };
+    HeldStats getHeldStats() const;
+
+    // Host side: stream traffic also waits for `client`'s share of the
+    // host upload. The scheduler must outlive the manager.
+    void setUploadScheduler(UploadScheduler *scheduler, uint64_t client);
 
 private:
+    // Per-stream state lives in a flat table indexed by the slot part of the
+    // stream ID, so the per-message path never builds or hashes strings.
+    struct PendingFrame {
+        PooledBuffer frame;
+        std::chrono::steady_clock::time_point queuedAt;
+        uint64_t end = 0; // stream bytes sent up to and including this frame
+    };
+
+    struct MessageHolder;
+    // Intrusively refcounted hold on a received Steam message, released by
+    // the last write from it. Holders come from a fixed table sized to the
+    // held-message cap, so holding a message never allocates.
+    class HeldMessage {
+    public:
+        HeldMessage() = default;
+        HeldMessage(const HeldMessage& other);
+        HeldMessage(HeldMessage&& other) noexcept : holder_(other.holder_) {
+            other.holder_ = nullptr;
+        }
+        HeldMessage& operator=(const HeldMessage& other);
+        HeldMessage& operator=(HeldMessage&& other) noexcept;
+        ~HeldMessage() { reset(); }
+
+        // Takes over `message`; empty, and `message` untouched, once the
+        // process-wide cap on held messages is reached.
+        static HeldMessage hold(SteamNetworkingMessage_t* message);
+        explicit operator bool() const { return holder_ != nullptr; }
+        void reset();
+
+    private:
+        explicit HeldMessage(MessageHolder* holder) : holder_(holder) {}
+
+        MessageHolder* holder_ = nullptr;
+    };
+    // The Steam message a received packet came in; taken into a
+    // HeldMessage by the first payload written from it.
+    struct InboundMessage {
+        SteamNetworkingMessage_t* message = nullptr;
+        HeldMessage held;
+    };
+    // Payload waiting for a local write, in a buffer of its own or inside
+    // the Steam message it arrived in.
+    struct WriteChunk {
+        const char* data = nullptr;
+        std::size_t size = 0;
+        PooledBuffer buffer;
+        HeldMessage message;
+    };
+
+    static constexpr uint32_t kNoSlot = 0xffffffffu;
+
+    // Slots with pending frames form an intrusive list threaded through
+    // their streams, so queueing, rotating and removing are O(1).
+    struct PriorityClass {
+        uint32_t head = kNoSlot;
+        uint32_t tail = kNoSlot;
+        std::size_t queuedSlots = 0;
+        uint32_t weight = 1;
+        std::size_t deficit = 0;
+        PriorityStats stats;
+    };
+
+    struct Stream {
+        uint32_t id = 0;
+        bool active = false;
+        bool local = false; // slot allocated by us (returned to freeSlots_)
+        uint32_t generation = 0;
+        std::shared_ptr<tcp::socket> socket;
+        PooledBuffer readBuffer;
+        std::deque<PendingFrame> pending;
+        StreamPriority priority = StreamPriority::Normal;
+        // Lane of the class at open. It never changes: Steam only orders
+        // messages within a lane.
+        uint8_t lane = 0;
+        ServiceStats *service = nullptr; // node in serviceStats_
+        bool queued = false; // present in its class's order
+        uint32_t prevQueued = kNoSlot;
+        uint32_t nextQueued = kNoSlot;
+        bool paused = false;        // read parked until the peer grants credit
+        std::size_t sendCredit = 0; // bytes we may still read and send
+        std::size_t creditOwed = 0; // bytes drained locally, not yet granted
+        std::deque<WriteChunk> writeQueue;   // payloads not yet handed to the socket
+        std::size_t writeQueuedBytes = 0;    // queued plus in flight
+        bool writing = false;                // one gather write in flight at most
+        bool connecting = false; // host connect in progress; writes are held
+        std::chrono::steady_clock::time_point connectStarted;
+        bool missingReported = false;
+        std::chrono::steady_clock::time_point lastConnectFail;
+        uint32_t compressSkip = 0;   // reads to send raw before probing again
+        uint32_t compressBackoff = 0;
+        uint32_t fullReads = 0;  // consecutive reads that filled the buffer
+        uint32_t shortReads = 0; // consecutive reads under a quarter of it
+        bool draining = false;   // local side closed; Disconnect still queued
+        bool peerClosed = false; // peer's Disconnect seen; writes still drain
+        std::function<void()> onClosed;
+        // Resumption state. Byte counts are of raw (uncompressed) data.
+        uint64_t sentBytes = 0;      // handed to the tunnel
+        uint64_t creditReceived = 0; // total credit the peer granted
+        uint64_t receivedBytes = 0;  // taken from the tunnel
+        uint64_t creditGranted = 0;  // total credit granted to the peer
+        std::deque<PendingFrame> replay; // sent, not yet credited
+        std::size_t replayBytes = 0;
+        uint64_t activityMark = 0; // sentBytes + receivedBytes at last sweep
+        std::chrono::steady_clock::time_point idleSince;
+    };
+
+    // Replay of a stream released after its Disconnect went out, kept in
+    // case the connection died before the tail arrived.
+    struct Lingering {
+        std::deque<PendingFrame> replay;
+        std::size_t bytes = 0;
+        uint64_t receivedBytes = 0; // as listed in a Resume
+        uint64_t creditGranted = 0;
+        uint8_t lane = 0;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    struct WarmSocket {
+        std::shared_ptr<tcp::socket> socket;
+        std::chrono::steady_clock::time_point connectedAt;
+    };
+    // Host-side sockets already connected to one target port.
+    struct WarmPool {
+        std::deque<WarmSocket> idle;
+        std::size_t connecting = 0;
+        std::size_t target = 0;
+        std::deque<std::chrono::steady_clock::time_point> recentOpens;
+    };
+
     ISteamNetworkingSockets* steamInterface_;
-    HSteamNetConnection steamConn_;
-    std::unordered_map<std::string, std::shared_ptr<tcp::socket>> clientMap_;
-    std::mutex mapMutex_;
+    ISteamNetworkingUtils* steamUtils_; // allocates the messages we send
+    std::atomic<HSteamNetConnection> steamConn_; // changes on resume
     boost::asio::io_context& io_context_;
     bool& isHost_;
     int& localPort_;
-    std::unordered_map<std::string, std::vector<char>> readBuffers_;
-    std::unordered_set<std::string> missingClients_;
-    std::map<std::string, std::deque<std::vector<char>>> pendingPackets_;
-    std::mutex queueMutex_;
+    std::vector<Stream> streams_;
+    std::array<std::deque<uint32_t>, kPriorityCount> freeSlots_; // per lane
+    std::array<PriorityClass, kPriorityCount> classes_;
+    std::map<uint16_t, StreamPriority> portPriorities_;
+    std::map<std::string, uint16_t> servicePorts_;
+    std::map<uint16_t, uint16_t> tagPorts_; // service tag -> target port
+    std::map<std::string, ServiceStats> serviceStats_;
+    std::map<uint16_t, WarmPool> warmPools_;
+    mutable std::mutex streamsMutex_;
     std::unique_ptr<boost::asio::steady_timer> sendTimer_;
     bool flushScheduled_ = false;
+    // A sealed message: `size` bytes at `offset` in `buffer`, which Steam
+    // sends from directly and drops its reference to once done.
+    struct Outgoing {
+        PooledBuffer buffer;
+        std::size_t offset = 0;
+        std::size_t size = 0;
+        std::size_t frames = 0;
+        std::size_t lane = 0;
+    };
+    // Frames are batched per lane, since one message travels on one lane.
+    struct LaneBatch {
+        PooledBuffer open; // batch being assembled
+        std::size_t openFrames = 0;
+        std::deque<Outgoing> stalled; // sealed but refused, sent first
+        uint64_t messagesSent = 0;
+        uint64_t bytesSent = 0;
+    };
+    std::array<LaneBatch, kPriorityCount> lanes_;
+    // Messages sealed in the current round, handed to Steam together by
+    // submitOutbox(); empty whenever streamsMutex_ is free. The connection
+    // status, and whether it is saturated, is sampled once per round by
+    // sampleRound() and shared by every frame and message of the round.
+    std::vector<Outgoing> outbox_;
+    std::size_t outboxBytes_ = 0;
+    bool roundSampled_ = false;
+    std::size_t roundPendingReliable_ = 0;
+    std::size_t roundPendingTotal_ = 0;
+    std::size_t roundSendBuffer_ = 0;
+    bool roundSaturated_ = false;
+    std::vector<SteamNetworkingMessage_t *> submitMessages_;
+    std::vector<int64> submitResults_;
+    std::atomic<bool> lanesConfigured_{false};
+    std::unique_ptr<boost::asio::steady_timer> batchTimer_;
+    bool batchTimerArmed_ = false;
+    std::unique_ptr<boost::asio::steady_timer> warmTimer_;
+    bool warmTimerArmed_ = false;
+    std::map<uint32_t, Lingering> lingering_;
+    std::size_t lingeringBytes_ = 0;
+    // Frames with no stream to queue behind (the resume handshake and
+    // lingering tails being replayed), with their lanes.
+    std::deque<std::pair<std::size_t, PooledBuffer>> resumeBacklog_;
+    // Stream traffic is held until the peer's Resume; written under
+    // streamsMutex_, read without it by isReceiveBlocked().
+    std::atomic<bool> resumePending_{false};
+    std::unique_ptr<boost::asio::steady_timer> resumeTimer_;
+    std::unique_ptr<boost::asio::steady_timer> reapTimer_;
+    std::atomic<bool> closed_{false};
+    // Warm connects capture the manager and cannot be cancelled.
+    std::atomic<std::size_t> warmConnectsInFlight_{0};
 
-    void startAsyncRead(const std::string& id);
-    std::vector<char> buildPacket(const std::string &id, const char *data, size_t len, int type) const;
-    bool trySendPacket(const std::vector<char> &packet);
-    void enqueuePacket(const std::string &id, std::vector<char> packet);
+    Stream* findStream(uint32_t id);
+    Stream& slotFor(uint32_t id);
+    void releaseStream(Stream& stream);
+    bool releaseIfDone(Stream& stream);
+    bool closeFromPeer(uint32_t id);
+    void startAsyncRead(uint32_t id);
+    void finishLocalStream(uint32_t id);
+    bool setReadBuffer(Stream &stream, std::size_t bytes, bool force);
+    void adaptReadBuffer(Stream &stream, std::size_t bytes);
+    void sendStreamData(uint32_t id, const char *data, size_t len, bool compress);
+    void sendHello();
+    PooledBuffer buildPacket(uint32_t id, const char *data, size_t len, tunnel::FrameType type) const;
+    bool stagePacket(Outgoing &packet);
+    bool submitOutbox();
+    bool appendToBatch(std::size_t lane, const char *head, size_t headLen,
+                       const char *body = nullptr, size_t bodyLen = 0);
+    bool appendToBatch(std::size_t lane, const PooledBuffer &frame);
+    bool sealBatch(std::size_t lane);
+    bool sealAllBatches();
+    bool retryStalledBatch(std::size_t lane);
+    bool anyLaneStalled() const;
+    void configureLanes();
+    std::size_t laneFor(const Stream *stream, tunnel::FrameType type) const;
+    void armBatchTimer();
+    bool hasBacklog() const;
+    void handlePacket(const char *data, size_t len, InboundMessage *inbound);
+    void handleMessage(SteamNetworkingMessage_t *message);
+    void handleFrame(const tunnel::FrameView &frame, InboundMessage *inbound,
+                     PooledBuffer decoded = {});
+    WriteChunk receivedChunk(const char *data, size_t len,
+                             InboundMessage *inbound, PooledBuffer decoded);
+    void enqueuePacket(Stream &stream, PooledBuffer packet, uint64_t end);
     void flushPendingPackets();
     void scheduleFlush(std::chrono::milliseconds delay = std::chrono::milliseconds(5));
-    void resumePausedReads();
+    void grantCredit(uint32_t id, std::size_t bytes);
     bool isSendSaturated();
-    void removeFromOrder(const std::string &id);
+    void sampleRound();
+    void retuneLink(const SteamNetConnectionRealTimeStatus_t &status);
+    void appendToOrder(uint32_t slot);
+    void removeFromOrder(uint32_t slot);
+    StreamPriority priorityForPort(uint16_t port) const;
+    void recordSend(StreamPriority priority, std::size_t bytes,
+                    std::chrono::steady_clock::duration delay);
+    uint16_t targetPortFor(const std::string &service) const;
+    uint16_t targetPortForTag(uint16_t tag) const;
+    void attachService(Stream &stream, const std::string &service);
+    std::shared_ptr<tcp::socket> openLocalStream(Stream &slot, uint16_t port,
+                                                 const std::string &service);
+    void startLocalConnect(uint32_t id, std::shared_ptr<tcp::socket> socket,
+                           uint16_t port);
+    void onLocalConnected(uint32_t id, const std::shared_ptr<tcp::socket> &socket,
+                          const boost::system::error_code &ec);
+    std::shared_ptr<tcp::socket> takeWarmSocket(uint16_t port,
+                                                std::chrono::steady_clock::time_point now);
+    void updateWarmTarget(WarmPool &pool, std::chrono::steady_clock::time_point now);
+    void refillWarmPool(uint16_t port);
+    void trimWarmPools();
+    void armWarmTimer();
+    bool replayEnabled() const;
+    void recordReplay(Stream &stream, PendingFrame frame);
+    void trimReplay(Stream &stream, uint64_t acked);
+    void dropReplay(Stream &stream);
+    void eraseLingering(std::map<uint32_t, Lingering>::iterator it);
+    void pruneLingering(std::chrono::steady_clock::time_point now);
+    std::vector<uint8_t> resumePayloadLocked();
+    void sendResume();
+    void applyResume(const char *payload, size_t len);
+    void armReapTimer();
+    void reapIdleStreams();
+    void writeToClient(uint32_t id, WriteChunk chunk);
+    void startWrite(uint32_t id);
+    void applySocketProfile(tcp::socket& socket) const;
 
     std::atomic<bool> sendBlocked_{false};
     std::atomic<int> backoffMs_{5};
     std::chrono::steady_clock::time_point lastBlocked_;
-    std::unordered_set<std::string> pausedReads_;
-    std::mutex pausedMutex_;
-    std::unordered_set<std::string> sendOrderSet_;
-    std::deque<std::string> sendOrder_;
-    std::unordered_map<std::string, std::chrono::steady_clock::time_point> recentConnectFail_;
+    std::atomic<int64_t> batchDelayUs_;
+    std::atomic<std::size_t> chunkBytes_;
+    std::atomic<std::size_t> highWaterBytes_;
+    std::atomic<std::size_t> lowWaterBytes_;
+    std::atomic<int64_t> lastTuneUs_{0};
+    mutable std::mutex tuningMutex_;
+    LinkTuning tuning_;
+    TransportProfile profile_; // guarded by tuningMutex_
+    std::atomic<uint64_t> framesSent_{0};
+    std::atomic<uint64_t> messagesSent_{0};
+    std::atomic<uint64_t> sizeFlushes_{0};
+    std::atomic<uint64_t> deadlineFlushes_{0};
+    std::atomic<uint64_t> submits_{0};
+    std::atomic<uint64_t> refusedMessages_{0};
+    std::atomic<int> inboundMessages_{0};
+    mutable std::mutex datagramMutex_;
+    DatagramSendCallback datagramHandler_;
+    std::shared_ptr<UdpForwarder> hostUdp_; // io thread only
+    std::atomic<uint64_t> datagramsDropped_{0};
+    std::atomic<uint64_t> connectsCompleted_{0};
+    std::atomic<uint64_t> connectFailures_{0};
+    std::atomic<uint64_t> connectLatencyTotalUs_{0};
+    std::atomic<uint64_t> lastConnectLatencyUs_{0};
+    std::atomic<std::size_t> warmLimit_;
+    std::atomic<uint64_t> warmHits_{0};
+    std::atomic<uint64_t> warmStale_{0};
+    std::atomic<std::size_t> activeStreams_{0};
+    std::atomic<bool> compressionEnabled_{true};
+    std::atomic<bool> peerCompression_{false};
+    std::atomic<uint64_t> chunksCompressed_{0};
+    std::atomic<uint64_t> compressBytesIn_{0};
+    std::atomic<uint64_t> compressBytesOut_{0};
+    std::atomic<uint64_t> compressBytesSkipped_{0};
+    std::atomic<uint64_t> compressProbesFailed_{0};
+    std::atomic<uint64_t> compressNs_{0};
+    std::atomic<uint64_t> decompressNs_{0};
+    std::atomic<uint64_t> sessionToken_{0};
+    std::atomic<bool> peerHelloSeen_{false};
+    std::atomic<bool> peerResume_{false};
+    std::atomic<uint64_t> resumes_{0};
+    std::atomic<uint64_t> streamsResumed_{0};
+    std::atomic<uint64_t> streamsLost_{0};
+    std::atomic<uint64_t> framesReplayed_{0};
+    std::atomic<uint64_t> bytesReplayed_{0};
+    std::atomic<std::size_t> replayBytes_{0};
+    std::atomic<int64_t> streamIdleTimeoutSec_;
+    std::atomic<uint64_t> streamsReaped_{0};
+    std::atomic<UploadScheduler *> uploadScheduler_{nullptr};
+    std::atomic<uint64_t> uploadClient_{0};
 };
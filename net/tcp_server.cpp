@@ -3,7 +3,7 @@
 #include <iostream>
 #include <algorithm>
 
-TCPServer::TCPServer(int port, SteamNetworkingManager* manager) : port_(port), running_(false), acceptor_(io_context_), work_(boost::asio::make_work_guard(io_context_)), manager_(manager) {}
+TCPServer::TCPServer(int port, SteamNetworkingManager* manager) : port_(port), running_(false), acceptor_(io_context_), work_(boost::asio::make_work_guard(io_context_)), clients_(std::make_shared<ClientList>()), manager_(manager) {}
 
 TCPServer::~TCPServer() { stop(); }
 
@@ -21,8 +21,29 @@ bool TCPServer::start() {
             io_context_.run(); 
             std::cout << "Server thread stopped" << std::endl;
         });
-        start_accept();
+        start_accept(acceptor_, std::string());
         std::cout << "TCP server started on port " << port_ << std::endl;
+
+        std::vector<std::pair<std::string, uint16_t>> udpPorts{{std::string(), static_cast<uint16_t>(port_)}};
+        for (const auto& service : manager_->getServices()) {
+            if (startServiceListener(service)) {
+                udpPorts.emplace_back(service.name, service.bindPort);
+            }
+        }
+
+        // The route table is complete before any forwarder starts listening,
+        // so it is never modified while datagrams flow.
+        auto routes = std::make_shared<UdpRoutes>();
+        for (const auto& entry : udpPorts) {
+            (*routes)[tunnel::serviceTag(entry.first)] = std::make_shared<UdpForwarder>(io_context_, [this](uint32_t flowId, const char* data, size_t len) {
+                forwardDatagram(flowId, data, len);
+            });
+        }
+        udpRoutes_ = routes;
+        for (const auto& entry : udpPorts) {
+            // Failing to bind UDP leaves TCP forwarding for the port intact.
+            (*routes)[tunnel::serviceTag(entry.first)]->listen(entry.second, tunnel::serviceTag(entry.first));
+        }
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Failed to start TCP server: " << e.what() << std::endl;
@@ -37,6 +58,17 @@ void TCPServer::stop() {
         serverThread_.join();
     }
     acceptor_.close();
+    for (auto& listener : serviceListeners_) {
+        boost::system::error_code ec;
+        listener.acceptor->close(ec);
+    }
+    serviceListeners_.clear();
+    if (udpRoutes_) {
+        for (auto& route : *udpRoutes_) {
+            route.second->stop();
+        }
+        udpRoutes_.reset();
+    }
 }
 
 void TCPServer::sendToAll(const std::string& message, std::shared_ptr<tcp::socket> excludeSocket) {
@@ -44,8 +76,8 @@ void TCPServer::sendToAll(const std::string& message, std::shared_ptr<tcp::socke
 }
 
 void TCPServer::sendToAll(const char* data, size_t size, std::shared_ptr<tcp::socket> excludeSocket) {
-    std::lock_guard<std::mutex> lock(clientsMutex_);
-    for (auto& client : clients_) {
+    std::lock_guard<std::mutex> lock(clients_->mutex);
+    for (auto& client : clients_->sockets) {
         if (client != excludeSocket) {
             boost::asio::async_write(*client, boost::asio::buffer(data, size), [](const boost::system::error_code&, std::size_t) {});
         }
@@ -53,73 +85,121 @@ void TCPServer::sendToAll(const char* data, size_t size, std::shared_ptr<tcp::so
 }
 
 int TCPServer::getClientCount() {
-    std::lock_guard<std::mutex> lock(clientsMutex_);
-    return clients_.size();
+    std::lock_guard<std::mutex> lock(clients_->mutex);
+    return clients_->sockets.size();
 }
 
 void TCPServer::setClientCountCallback(std::function<void(int)> callback) {
-    clientCountCallback_ = std::move(callback);
+    std::lock_guard<std::mutex> lock(clients_->mutex);
+    clients_->countCallback = std::move(callback);
 }
 
-void TCPServer::notifyClientCount(int count) {
-    if (clientCountCallback_) {
-        clientCountCallback_(count);
+void TCPServer::forwardDatagram(uint32_t flowId, const char* data, size_t len) {
+    if (!manager_->isConnected()) {
+        return;
     }
+    auto multiplexManager = manager_->getMessageHandler()->getMultiplexManager(manager_->getConnection());
+    if (!multiplexManager->hasDatagramHandler()) {
+        // Replies from the host come back through the manager; the weak
+        // reference keeps a stopped server from being called.
+        std::weak_ptr<UdpRoutes> weakRoutes = udpRoutes_;
+        multiplexManager->setDatagramHandler([weakRoutes](uint32_t id, const char* payload, size_t payloadLen) {
+            auto routes = weakRoutes.lock();
+            if (!routes) {
+                return;
+            }
+            auto it = routes->find(tunnel::flowServiceTag(id));
+            if (it != routes->end()) {
+                it->second->deliver(id, payload, payloadLen);
+            }
+        });
+    }
+    multiplexManager->sendDatagram(flowId, data, len);
 }
 
-void TCPServer::start_accept() {
-    auto socket = std::make_shared<tcp::socket>(io_context_);
-    acceptor_.async_accept(*socket, [this, socket](const boost::system::error_code& error) {
+
+void TCPServer::updateClients(ClientList& clients, const std::shared_ptr<tcp::socket>& socket, bool added) {
+    std::function<void(int)> countCallback;
+    int currentCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(clients.mutex);
+        if (added) {
+            clients.sockets.push_back(socket);
+        } else {
+            clients.sockets.erase(std::remove(clients.sockets.begin(), clients.sockets.end(), socket), clients.sockets.end());
+        }
+        currentCount = static_cast<int>(clients.sockets.size());
+        countCallback = clients.countCallback;
+    }
+    if (countCallback) {
+        countCallback(currentCount);
+    }
+}
+
+bool TCPServer::startServiceListener(const tunnel::TunnelService& service) {
+    try {
+        auto acceptor = std::make_unique<tcp::acceptor>(io_context_);
+        tcp::endpoint endpoint(tcp::v4(), service.bindPort);
+        acceptor->open(endpoint.protocol());
+        acceptor->set_option(tcp::acceptor::reuse_address(true));
+        acceptor->bind(endpoint);
+        acceptor->listen();
+        serviceListeners_.push_back(ServiceListener{service.name, std::move(acceptor)});
+        ServiceListener& listener = serviceListeners_.back();
+        start_accept(*listener.acceptor, listener.name);
+        std::cout << "Service '" << service.name << "' listening on port " << service.bindPort << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to listen for service '" << service.name << "' on port " << service.bindPort << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+void TCPServer::start_accept(tcp::acceptor& acceptor, const std::string& service) {
+    acceptor.async_accept([this, &acceptor, service](const boost::system::error_code& error, tcp::socket peer) {
         if (!error) {
+            // The stream's connection (the primary or a parallel stripe) is
+            // chosen now that the client is here, from the connections and
+            // stream counts of this moment.
+            const HSteamNetConnection conn = manager_->connectionForNewStream();
+            auto socket = moveToContext(std::move(peer), manager_->getMessageHandler()->ioContextFor(conn));
             std::cout << "New client connected" << std::endl;
-            // Low latency between local TCP and Steam tunnel
-            boost::system::error_code ec;
-            socket->set_option(tcp::no_delay(true), ec);
-            auto multiplexManager = manager_->getMessageHandler()->getMultiplexManager(manager_->getConnection());
-            std::string id = multiplexManager->addClient(socket);
-            int currentCount = 0;
-            {
-                std::lock_guard<std::mutex> lock(clientsMutex_);
-                clients_.push_back(socket);
-                currentCount = static_cast<int>(clients_.size());
-            }
-            notifyClientCount(currentCount);
-            start_read(socket, id);
+            // Socket options (Nagle, buffers) follow the transport profile
+            // and are set by the multiplex manager.
+            updateClients(*clients_, socket, true);
+            auto multiplexManager = manager_->getMessageHandler()->getMultiplexManager(conn);
+            std::weak_ptr<ClientList> weakClients = clients_;
+            multiplexManager->addClient(socket, service, [weakClients, socket]() {
+                if (auto clients = weakClients.lock()) {
+                    updateClients(*clients, socket, false);
+                }
+            });
         }
         if (running_) {
-            start_accept();
+            start_accept(acceptor, service);
         }
     });
 }
 
-void TCPServer::start_read(std::shared_ptr<tcp::socket> socket, std::string id) {
-    auto buffer = std::make_shared<std::vector<char>>(1048576);
-    socket->async_read_some(boost::asio::buffer(*buffer), [this, socket, buffer, id](const boost::system::error_code& error, std::size_t bytes_transferred) {
-        if (!error) {
-            if (manager_->isConnected()) {
-                auto multiplexManager = manager_->getMessageHandler()->getMultiplexManager(manager_->getConnection());
-                multiplexManager->sendTunnelPacket(id, buffer->data(), bytes_transferred, 0);
-            } else {
-                std::cout << "Not connected to Steam, skipping forward" << std::endl;
-            }
-            sendToAll(buffer->data(), bytes_transferred, socket);
-            start_read(socket, id);
-        } else {
-            std::cout << "TCP client " << id << " disconnected or error: " << error.message() << std::endl;
-            // Send disconnect packet
-            if (manager_->isConnected()) {
-                auto multiplexManager = manager_->getMessageHandler()->getMultiplexManager(manager_->getConnection());
-                multiplexManager->sendTunnelPacket(id, nullptr, 0, 1);
-                // Remove client
-                multiplexManager->removeClient(id);
+std::shared_ptr<tcp::socket> TCPServer::moveToContext(tcp::socket peer, boost::asio::io_context& context) {
+    // Rebinding the descriptor puts the socket's reads and writes on the
+    // connection's worker, next to its tunnel traffic. Where the platform
+    // cannot release a socket it stays on the server thread, which only
+    // costs that locality.
+    if (&context != &io_context_) {
+        boost::system::error_code ec;
+        const tcp::socket::native_handle_type handle = peer.release(ec);
+        if (!ec) {
+            auto moved = std::make_shared<tcp::socket>(context);
+            moved->assign(tcp::v4(), handle, ec);
+            if (!ec) {
+                return moved;
             }
-            int currentCount = 0;
-            {
-                std::lock_guard<std::mutex> lock(clientsMutex_);
-                clients_.erase(std::remove(clients_.begin(), clients_.end(), socket), clients_.end());
-                currentCount = static_cast<int>(clients_.size());
-            }
-            notifyClientCount(currentCount);
+            peer.assign(tcp::v4(), handle, ec);
         }
-    });
+        if (ec) {
+            std::cerr << "Client socket stays on the server thread: " << ec.message() << std::endl;
+        }
+    }
+    return std::make_shared<tcp::socket>(std::move(peer));
 }
@@ -2,6 +2,7 @@
 
 #include <boost/asio.hpp>
 #include <functional>
+#include <map>
 #include <memory>
 #include <vector>
 #include <string>
@@ -12,6 +13,7 @@
 #include <isteamnetworkingutils.h>
 #include <steamnetworkingtypes.h>
 #include "multiplex_manager.h"
+#include "udp_forwarder.h"
 
 class SteamNetworkingManager;
 
@@ -31,18 +33,34 @@ public:
     void setClientCountCallback(std::function<void(int)> callback);
 
 private:
-    void start_accept();
-    void start_read(std::shared_ptr<tcp::socket> socket, std::string id);
-    void notifyClientCount(int count);
+    void start_accept(tcp::acceptor& acceptor, const std::string& service);
+    std::shared_ptr<tcp::socket> moveToContext(tcp::socket peer, boost::asio::io_context& context);
+    bool startServiceListener(const tunnel::TunnelService& service);
+    void forwardDatagram(uint32_t flowId, const char* data, size_t len);
 
     int port_;
     bool running_;
     boost::asio::io_context io_context_;
     boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
     tcp::acceptor acceptor_;
-    std::vector<std::shared_ptr<tcp::socket>> clients_;
-    std::mutex clientsMutex_;
+    // Accepted sockets are read only by the MultiplexManager; its close
+    // notification may outlive the server, so this state is shared.
+    struct ClientList {
+        std::vector<std::shared_ptr<tcp::socket>> sockets;
+        std::mutex mutex;
+        std::function<void(int)> countCallback;
+    };
+    std::shared_ptr<ClientList> clients_;
+    static void updateClients(ClientList& clients, const std::shared_ptr<tcp::socket>& socket, bool added);
     std::thread serverThread_;
     SteamNetworkingManager* manager_;
-    std::function<void(int)> clientCountCallback_;
+    // Extra listeners from the port map, one per named service.
+    struct ServiceListener {
+        std::string name;
+        std::unique_ptr<tcp::acceptor> acceptor;
+    };
+    std::vector<ServiceListener> serviceListeners_;
+    // UDP shares each listener's port; replies are routed by service tag.
+    using UdpRoutes = std::map<uint16_t, std::shared_ptr<UdpForwarder>>;
+    std::shared_ptr<UdpRoutes> udpRoutes_;
 };
@@ -0,0 +1,122 @@
+#include "transport_profile.h"
+
+#if !defined(_WIN32)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+TransportProfile TransportProfile::forKind(Kind kind) {
+  TransportProfile profile;
+  profile.kind = kind;
+  switch (kind) {
+  case Kind::LowLatency:
+    // Shallow queues everywhere: small Steam buffers, near-MTU chunks, no
+    // batching wait, tight watermarks and polls, and little unsent data
+    // parked in local kernel buffers.
+    profile.sendBufferBytes = 512 * 1024;
+    profile.recvBufferBytes = 1024 * 1024;
+    profile.recvBufferMessages = 1024;
+    profile.maxChunkBytes = 4 * 1024;
+    profile.highWaterBdps = 1;
+    profile.maxHighWaterBytes = 1024 * 1024;
+    profile.batchDelay = std::chrono::microseconds{0};
+    profile.latencyBudget = std::chrono::microseconds{250};
+    profile.spinWindow = std::chrono::microseconds{500};
+    profile.vpnMinPollInterval = std::chrono::microseconds{50};
+    profile.vpnMaxPollInterval = std::chrono::microseconds{250};
+    profile.notSentLowatBytes = 16 * 1024;
+    break;
+  case Kind::Balanced:
+    break;
+  case Kind::Bulk:
+    // Deep queues and large chunks; latency may rise under load.
+    profile.sendBufferBytes = 8 * 1024 * 1024;
+    profile.recvBufferBytes = 8 * 1024 * 1024;
+    profile.recvBufferMessages = 8192;
+    profile.nagleTimeUs = 5000;
+    profile.minChunkBytes = 4 * 1024;
+    profile.maxChunkBytes = 32 * 1024;
+    profile.highWaterBdps = 4;
+    profile.maxHighWaterBytes = 16 * 1024 * 1024;
+    profile.batchDelay = std::chrono::microseconds{1000};
+    profile.latencyBudget = std::chrono::microseconds{2000};
+    profile.spinWindow = std::chrono::microseconds{0};
+    profile.vpnMinPollInterval = std::chrono::microseconds{200};
+    profile.vpnMaxPollInterval = std::chrono::microseconds{2000};
+    profile.noDelay = false;
+    profile.socketSendBufferBytes = 1024 * 1024;
+    profile.socketRecvBufferBytes = 1024 * 1024;
+    break;
+  }
+  return profile;
+}
+
+const char *TransportProfile::nameOf(Kind kind) {
+  switch (kind) {
+  case Kind::LowLatency:
+    return "low_latency";
+  case Kind::Bulk:
+    return "bulk";
+  case Kind::Balanced:
+    break;
+  }
+  return "balanced";
+}
+
+TransportProfile::Kind TransportProfile::kindFromName(const std::string &name) {
+  if (name == nameOf(Kind::LowLatency)) {
+    return Kind::LowLatency;
+  }
+  if (name == nameOf(Kind::Bulk)) {
+    return Kind::Bulk;
+  }
+  return Kind::Balanced;
+}
+
+void TransportProfile::applyToSteam(
+    ISteamNetworkingUtils *utils,
+    const std::vector<HSteamNetConnection> &connections) const {
+  if (!utils) {
+    return;
+  }
+  const auto setGlobal = [utils](ESteamNetworkingConfigValue key,
+                                 int32 value) {
+    utils->SetConfigValue(key, k_ESteamNetworkingConfig_Global, 0,
+                          k_ESteamNetworkingConfig_Int32, &value);
+  };
+  setGlobal(k_ESteamNetworkingConfig_SendBufferSize, sendBufferBytes);
+  setGlobal(k_ESteamNetworkingConfig_RecvBufferSize, recvBufferBytes);
+  setGlobal(k_ESteamNetworkingConfig_RecvBufferMessages, recvBufferMessages);
+  setGlobal(k_ESteamNetworkingConfig_NagleTime, nagleTimeUs);
+  for (HSteamNetConnection conn : connections) {
+    int32 sendBuffer = sendBufferBytes;
+    int32 nagle = nagleTimeUs;
+    utils->SetConfigValue(k_ESteamNetworkingConfig_SendBufferSize,
+                          k_ESteamNetworkingConfig_Connection, conn,
+                          k_ESteamNetworkingConfig_Int32, &sendBuffer);
+    utils->SetConfigValue(k_ESteamNetworkingConfig_NagleTime,
+                          k_ESteamNetworkingConfig_Connection, conn,
+                          k_ESteamNetworkingConfig_Int32, &nagle);
+  }
+}
+
+void TransportProfile::applyTo(boost::asio::ip::tcp::socket &socket) const {
+  boost::system::error_code ec;
+  socket.set_option(boost::asio::ip::tcp::no_delay(noDelay), ec);
+  if (socketSendBufferBytes > 0) {
+    socket.set_option(
+        boost::asio::socket_base::send_buffer_size(socketSendBufferBytes), ec);
+  }
+  if (socketRecvBufferBytes > 0) {
+    socket.set_option(
+        boost::asio::socket_base::receive_buffer_size(socketRecvBufferBytes),
+        ec);
+  }
+#if defined(TCP_NOTSENT_LOWAT)
+  // 0 restores the system default, so a socket can switch profiles.
+  using NotSentLowat =
+      boost::asio::detail::socket_option::integer<IPPROTO_TCP,
+                                                  TCP_NOTSENT_LOWAT>;
+  socket.set_option(NotSentLowat(notSentLowatBytes), ec);
+#endif
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <isteamnetworkingutils.h>
+#include <string>
+#include <vector>
+
+// Named sets of transport tuning, applied together at runtime: Steam socket
+// buffers and Nagle, tunnel chunking and send watermarks, poll intervals and
+// local socket options. Balanced matches the long-standing defaults.
+struct TransportProfile {
+  enum class Kind : uint8_t { LowLatency = 0, Balanced = 1, Bulk = 2 };
+
+  Kind kind = Kind::Balanced;
+
+  // Steam (global, and per connection where Steam allows it).
+  int sendBufferBytes = 2 * 1024 * 1024;
+  int recvBufferBytes = 2 * 1024 * 1024;
+  int recvBufferMessages = 2048;
+  int nagleTimeUs = 0;
+
+  // Tunnel: chunk size bounds for the BDP controller, send watermark as a
+  // multiple of the BDP (plus a backoff allowance) up to a ceiling, and how
+  // long small frames wait to be batched.
+  std::size_t minChunkBytes = 1100;
+  std::size_t maxChunkBytes = 16 * 1024;
+  std::size_t highWaterBdps = 2;
+  std::size_t maxHighWaterBytes = 4 * 1024 * 1024;
+  std::chrono::microseconds batchDelay{200};
+
+  // Poll loops: the TCP-mode handler's latency budget and spin window, and
+  // the TUN-mode handler's adaptive poll interval range.
+  std::chrono::microseconds latencyBudget{1000};
+  std::chrono::microseconds spinWindow{100};
+  std::chrono::microseconds vpnMinPollInterval{100};
+  std::chrono::microseconds vpnMaxPollInterval{1000};
+
+  // Local sockets. 0 leaves the OS default; TCP_NOTSENT_LOWAT is skipped on
+  // platforms without it.
+  bool noDelay = true;
+  int notSentLowatBytes = 0;
+  int socketSendBufferBytes = 0;
+  int socketRecvBufferBytes = 0;
+
+  static TransportProfile forKind(Kind kind);
+  // Stable names used in lobby metadata; unknown names give Balanced.
+  static const char *nameOf(Kind kind);
+  static Kind kindFromName(const std::string &name);
+  const char *name() const { return nameOf(kind); }
+
+  void applyTo(boost::asio::ip::tcp::socket &socket) const;
+  // Sets the Steam values globally, for connections made from now on, and
+  // the per-connection ones on `connections`.
+  void applyToSteam(ISteamNetworkingUtils *utils,
+                    const std::vector<HSteamNetConnection> &connections = {}) const;
+};
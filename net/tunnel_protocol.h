@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Binary framing used by MultiplexManager on TCP-mode Steam connections.
+//
+// Frame layout: [u8 version<<4 | type][varint stream id][payload]
+//
+// The high nibble carries the protocol version so frames from legacy peers
+// (which started with a 6-char ASCII id) are rejected instead of misparsed.
+namespace tunnel {
+
+constexpr uint8_t kFrameVersion = 0xA;
+constexpr std::size_t kMaxVarintBytes = 5;
+constexpr std::size_t kMaxVarint64Bytes = 10;
+constexpr std::size_t kMaxFrameHeaderBytes = 1 + kMaxVarintBytes;
+
+enum class FrameType : uint8_t {
+  Data = 0,
+  Disconnect = 1,
+  // Several frames packed into one Steam message:
+  // [header, stream id 0]{[varint frame length][frame]}*
+  Batch = 2,
+  // Payload: varint byte count the receiver has written to its local socket
+  // since its last grant; the sender may read that much more.
+  Credit = 3,
+  // A forwarded UDP datagram; the stream id field carries the flow id. Sent
+  // unreliable and never batched.
+  Datagram = 4,
+  // Opens a stream before any data flows. Payload: the service name (empty
+  // for the default service) selecting the host's target port.
+  Open = 5,
+  // Sent once per connection on stream id 0. Payload: varint capability
+  // bits (kCap*), then, with kCapResume, the varint64 session token.
+  // Peers that predate it log and ignore the frame.
+  Hello = 6,
+  // Data compressed with lz::compress. Payload: [varint raw length][block].
+  // Only sent to peers that advertised kCapCompression.
+  CompressedData = 7,
+  // Sent on stream id 0 when a session moves to a new Steam connection.
+  // Payload: varint stream count, then per stream [varint id][varint64 bytes
+  // received][varint64 credit granted]. Only sent to kCapResume peers.
+  Resume = 8,
+};
+
+constexpr uint32_t kCapCompression = 1u << 0;
+constexpr uint32_t kCapResume = 1u << 1;
+
+// Bytes a stream may have in flight before the receiver grants more credit.
+// Both ends start every stream with this window.
+constexpr uint32_t kStreamWindowBytes = 512 * 1024;
+
+// Stream IDs are allocated by the side that accepted the local connection.
+// The low bits carry a generation counter so a recycled slot is never
+// confused with the stream that previously used it.
+constexpr uint32_t kStreamGenerationBits = 4;
+constexpr uint32_t kStreamGenerationMask = (1u << kStreamGenerationBits) - 1;
+constexpr uint32_t kMaxStreamSlots = 1u << 16;
+
+inline uint32_t makeStreamId(uint32_t slot, uint32_t generation) {
+  return (slot << kStreamGenerationBits) |
+         (generation & kStreamGenerationMask);
+}
+inline uint32_t streamSlot(uint32_t id) { return id >> kStreamGenerationBits; }
+
+inline std::size_t encodeVarint(uint32_t value, uint8_t *out) {
+  std::size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = static_cast<uint8_t>(value);
+  return n;
+}
+
+inline bool decodeVarint(const uint8_t *&p, const uint8_t *end,
+                         uint32_t &value) {
+  value = 0;
+  for (std::size_t i = 0; i < kMaxVarintBytes && p < end; ++i) {
+    const uint8_t byte = *p++;
+    value |= static_cast<uint32_t>(byte & 0x7F) << (7 * i);
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline std::size_t encodeVarint64(uint64_t value, uint8_t *out) {
+  std::size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = static_cast<uint8_t>(value);
+  return n;
+}
+
+inline bool decodeVarint64(const uint8_t *&p, const uint8_t *end,
+                           uint64_t &value) {
+  value = 0;
+  for (std::size_t i = 0; i < kMaxVarint64Bytes && p < end; ++i) {
+    const uint8_t byte = *p++;
+    value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline std::size_t varintSize(uint32_t value) {
+  std::size_t n = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++n;
+  }
+  return n;
+}
+
+inline std::size_t frameHeaderSize(uint32_t streamId) {
+  return 1 + varintSize(streamId);
+}
+
+inline std::size_t writeFrameHeader(uint8_t *out, FrameType type,
+                                    uint32_t streamId) {
+  out[0] = static_cast<uint8_t>((kFrameVersion << 4) |
+                                (static_cast<uint8_t>(type) & 0x0F));
+  return 1 + encodeVarint(streamId, out + 1);
+}
+
+struct FrameView {
+  FrameType type = FrameType::Data;
+  uint32_t streamId = 0;
+  const char *payload = nullptr;
+  std::size_t payloadLen = 0;
+};
+
+// Returns false for truncated frames or frames from another protocol version.
+inline bool parseFrame(const char *data, std::size_t len, FrameView &out) {
+  if (!data || len < 2) {
+    return false;
+  }
+  const auto *p = reinterpret_cast<const uint8_t *>(data);
+  const auto *end = p + len;
+  if ((p[0] >> 4) != kFrameVersion) {
+    return false;
+  }
+  out.type = static_cast<FrameType>(p[0] & 0x0F);
+  ++p;
+  if (!decodeVarint(p, end, out.streamId)) {
+    return false;
+  }
+  out.payload = reinterpret_cast<const char *>(p);
+  out.payloadLen = static_cast<std::size_t>(end - p);
+  return true;
+}
+
+// Session token from a Hello frame at the start of a message (bare or first
+// in a batch), so a connection can be matched to a session before any of its
+// frames are handled. Returns false if there is none.
+inline bool findHelloToken(const char *data, std::size_t len,
+                           uint64_t &token) {
+  FrameView frame;
+  if (!parseFrame(data, len, frame)) {
+    return false;
+  }
+  if (frame.type == FrameType::Batch) {
+    const auto *p = reinterpret_cast<const uint8_t *>(frame.payload);
+    const auto *end = p + frame.payloadLen;
+    uint32_t innerLen = 0;
+    if (!decodeVarint(p, end, innerLen) ||
+        innerLen > static_cast<std::size_t>(end - p) ||
+        !parseFrame(reinterpret_cast<const char *>(p), innerLen, frame)) {
+      return false;
+    }
+  }
+  if (frame.type != FrameType::Hello) {
+    return false;
+  }
+  const auto *p = reinterpret_cast<const uint8_t *>(frame.payload);
+  const auto *end = p + frame.payloadLen;
+  uint32_t caps = 0;
+  return decodeVarint(p, end, caps) && (caps & kCapResume) != 0 &&
+         decodeVarint64(p, end, token);
+}
+
+// One entry of the port map: a named service that the client exposes on
+// bindPort and the host forwards to targetPort. The unnamed default service
+// keeps using the Backend's localBindPort/localPort.
+struct TunnelService {
+  std::string name;
+  uint16_t targetPort = 0;
+  uint16_t bindPort = 0;
+};
+
+// 16-bit tag for a service name; 0 is the default service. UDP flow ids
+// carry it in their high half, since datagrams have no open frame.
+inline uint16_t serviceTag(const std::string &name) {
+  if (name.empty()) {
+    return 0;
+  }
+  uint32_t hash = 2166136261u; // FNV-1a
+  for (const char c : name) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  const auto tag = static_cast<uint16_t>(hash ^ (hash >> 16));
+  return tag == 0 ? 1 : tag;
+}
+
+inline uint16_t flowServiceTag(uint32_t flowId) {
+  return static_cast<uint16_t>(flowId >> 16);
+}
+
+} // namespace tunnel
@@ -0,0 +1,243 @@
+#include "udp_forwarder.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+constexpr std::size_t kMaxDatagramBytes = 65536;
+constexpr std::size_t kMaxFlows = 1024;
+constexpr std::chrono::seconds kFlowIdleTimeout{60};
+constexpr std::chrono::seconds kSweepInterval{5};
+} // namespace
+
+UdpForwarder::UdpForwarder(boost::asio::io_context &io_context,
+                           DatagramSendCallback sendCallback)
+    : io_context_(io_context), sendCallback_(std::move(sendCallback)) {
+  sweepTimer_ = std::make_unique<boost::asio::steady_timer>(io_context_);
+}
+
+UdpForwarder::~UdpForwarder() { stop(); }
+
+bool UdpForwarder::listen(uint16_t port, uint16_t tag) {
+  flowTag_ = tag;
+  try {
+    listenSocket_ = std::make_unique<udp::socket>(
+        io_context_, udp::endpoint(udp::v4(), port));
+  } catch (const std::exception &e) {
+    std::cerr << "[UDP] Failed to listen on port " << port << ": " << e.what()
+              << std::endl;
+    listenSocket_.reset();
+    return false;
+  }
+  listenBuffer_ = BufferPool::instance().acquire(kMaxDatagramBytes);
+  std::cout << "[UDP] Forwarding datagrams on port " << port << std::endl;
+  startListenReceive();
+  scheduleSweep();
+  return true;
+}
+
+void UdpForwarder::setTargetResolver(
+    std::function<uint16_t(uint32_t flowId)> resolver) {
+  const bool first = !targetResolver_;
+  targetResolver_ = std::move(resolver);
+  if (first) {
+    scheduleSweep();
+  }
+}
+
+void UdpForwarder::stop() {
+  if (stopped_) {
+    return;
+  }
+  stopped_ = true;
+  boost::system::error_code ec;
+  if (listenSocket_) {
+    listenSocket_->close(ec);
+  }
+  for (auto &entry : flows_) {
+    if (entry.second.socket) {
+      entry.second.socket->close(ec);
+    }
+  }
+  if (sweepTimer_) {
+    sweepTimer_->cancel();
+  }
+}
+
+void UdpForwarder::startListenReceive() {
+  auto self = shared_from_this();
+  listenSocket_->async_receive_from(
+      boost::asio::buffer(listenBuffer_.data(), listenBuffer_.size()),
+      listenSender_,
+      [this, self](const boost::system::error_code &ec, std::size_t bytes) {
+        if (stopped_ || ec == boost::asio::error::operation_aborted) {
+          return;
+        }
+        if (!ec) {
+          auto it = flowByPeer_.find(listenSender_);
+          if (it == flowByPeer_.end() && flows_.size() < kMaxFlows) {
+            uint32_t flowId = 0;
+            do {
+              flowId =
+                  (static_cast<uint32_t>(flowTag_) << 16) | nextFlowIndex_;
+              if (++nextFlowIndex_ == 0) {
+                nextFlowIndex_ = 1;
+              }
+            } while (flows_.count(flowId) != 0);
+            Flow &flow = flows_[flowId];
+            flow.peer = listenSender_;
+            it = flowByPeer_.emplace(listenSender_, flowId).first;
+            activeFlows_.store(flows_.size(), std::memory_order_relaxed);
+          }
+          if (it != flowByPeer_.end()) {
+            flows_[it->second].lastActive = std::chrono::steady_clock::now();
+            datagramsOut_.fetch_add(1, std::memory_order_relaxed);
+            sendCallback_(it->second, listenBuffer_.data(), bytes);
+          } else {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            if (!flowLimitReported_) {
+              flowLimitReported_ = true;
+              std::cerr << "[UDP] Flow limit reached, dropping new senders"
+                        << std::endl;
+            }
+          }
+        }
+        // ICMP errors (e.g. port unreachable) surface here; keep listening.
+        startListenReceive();
+      });
+}
+
+void UdpForwarder::deliver(uint32_t flowId, const char *data, size_t len) {
+  PooledBuffer payload = BufferPool::instance().copy(data, len);
+  auto self = shared_from_this();
+  boost::asio::dispatch(io_context_,
+                        [this, self, flowId, payload = std::move(payload)]() {
+                          deliverOnIo(flowId, payload);
+                        });
+}
+
+void UdpForwarder::deliverOnIo(uint32_t flowId, PooledBuffer payload) {
+  if (stopped_) {
+    return;
+  }
+  auto it = flows_.find(flowId);
+  Flow *flow = it != flows_.end() ? &it->second : nullptr;
+  if (!flow && !listenSocket_ && targetResolver_) {
+    flow = openHostFlow(flowId);
+  }
+  if (!flow) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  flow->lastActive = std::chrono::steady_clock::now();
+  datagramsIn_.fetch_add(1, std::memory_order_relaxed);
+
+  auto self = shared_from_this();
+  auto onSent = [self, payload](const boost::system::error_code &,
+                                std::size_t) {};
+  const auto buffer = boost::asio::buffer(payload.data(), payload.size());
+  if (listenSocket_) {
+    listenSocket_->async_send_to(buffer, flow->peer, std::move(onSent));
+  } else {
+    flow->socket->async_send(buffer, std::move(onSent));
+  }
+}
+
+UdpForwarder::Flow *UdpForwarder::openHostFlow(uint32_t flowId) {
+  if (flows_.size() >= kMaxFlows) {
+    if (!flowLimitReported_) {
+      flowLimitReported_ = true;
+      std::cerr << "[UDP] Flow limit reached, dropping new flows" << std::endl;
+    }
+    return nullptr;
+  }
+  const uint16_t targetPort = targetResolver_(flowId);
+  if (targetPort == 0) {
+    return nullptr;
+  }
+  auto socket = std::make_shared<udp::socket>(io_context_);
+  boost::system::error_code ec;
+  socket->open(udp::v4(), ec);
+  if (!ec) {
+    socket->connect(
+        udp::endpoint(boost::asio::ip::address_v4::loopback(), targetPort), ec);
+  }
+  if (ec) {
+    std::cerr << "[UDP] Failed to open flow " << flowId << " to port "
+              << targetPort << ": " << ec.message() << std::endl;
+    return nullptr;
+  }
+
+  Flow &flow = flows_[flowId];
+  flow.socket = socket;
+  flow.recvBuffer = BufferPool::instance().acquire(kMaxDatagramBytes);
+  activeFlows_.store(flows_.size(), std::memory_order_relaxed);
+  startFlowReceive(flowId, socket, flow.recvBuffer);
+  return &flow;
+}
+
+void UdpForwarder::startFlowReceive(uint32_t flowId,
+                                    std::shared_ptr<udp::socket> socket,
+                                    PooledBuffer buffer) {
+  auto self = shared_from_this();
+  socket->async_receive(
+      boost::asio::buffer(buffer.data(), buffer.size()),
+      [this, self, flowId, socket, buffer](const boost::system::error_code &ec,
+                                           std::size_t bytes) {
+        if (stopped_ || ec == boost::asio::error::operation_aborted) {
+          return;
+        }
+        auto it = flows_.find(flowId);
+        if (it == flows_.end() || it->second.socket != socket) {
+          return; // expired
+        }
+        if (!ec) {
+          it->second.lastActive = std::chrono::steady_clock::now();
+          datagramsOut_.fetch_add(1, std::memory_order_relaxed);
+          sendCallback_(flowId, buffer.data(), bytes);
+        }
+        startFlowReceive(flowId, socket, buffer);
+      });
+}
+
+void UdpForwarder::scheduleSweep() {
+  auto self = shared_from_this();
+  sweepTimer_->expires_after(kSweepInterval);
+  sweepTimer_->async_wait([this, self](const boost::system::error_code &ec) {
+    if (ec || stopped_) {
+      return;
+    }
+    sweepIdleFlows();
+    scheduleSweep();
+  });
+}
+
+void UdpForwarder::sweepIdleFlows() {
+  const auto now = std::chrono::steady_clock::now();
+  for (auto it = flows_.begin(); it != flows_.end();) {
+    if (now - it->second.lastActive < kFlowIdleTimeout) {
+      ++it;
+      continue;
+    }
+    if (it->second.socket) {
+      boost::system::error_code ec;
+      it->second.socket->close(ec);
+    } else {
+      flowByPeer_.erase(it->second.peer);
+    }
+    it = flows_.erase(it);
+  }
+  activeFlows_.store(flows_.size(), std::memory_order_relaxed);
+  if (flows_.size() < kMaxFlows) {
+    flowLimitReported_ = false;
+  }
+}
+
+UdpForwarder::Stats UdpForwarder::stats() const {
+  Stats stats;
+  stats.datagramsOut = datagramsOut_.load(std::memory_order_relaxed);
+  stats.datagramsIn = datagramsIn_.load(std::memory_order_relaxed);
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  stats.activeFlows = activeFlows_.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "buffer_pool.h"
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+using boost::asio::ip::udp;
+
+using DatagramSendCallback =
+    std::function<void(uint32_t flowId, const char *data, size_t len)>;
+
+// Forwards local UDP traffic over the tunnel as per-flow datagrams.
+//
+// Client side (listen()): every distinct local sender on the listen port is
+// a flow; replies are sent back to that sender. Host side (setTargetPort()):
+// every flow gets its own UDP socket connected to the local service, so the
+// service sees one peer per remote flow. Idle flows expire on both ends.
+// All socket work runs on the io_context passed in; deliver() may be called
+// from any thread.
+class UdpForwarder : public std::enable_shared_from_this<UdpForwarder> {
+public:
+  struct Stats {
+    uint64_t datagramsOut = 0; // local socket -> tunnel
+    uint64_t datagramsIn = 0;  // tunnel -> local socket
+    uint64_t dropped = 0;
+    std::size_t activeFlows = 0;
+  };
+
+  UdpForwarder(boost::asio::io_context &io_context,
+               DatagramSendCallback sendCallback);
+  ~UdpForwarder();
+
+  // Client side; `tag` fills the high half of every flow id so the host can
+  // tell which service a flow belongs to.
+  bool listen(uint16_t port, uint16_t tag = 0);
+  // Host side; returns the local port for a flow, or 0 to drop it.
+  void setTargetResolver(std::function<uint16_t(uint32_t flowId)> resolver);
+  void stop();
+
+  void deliver(uint32_t flowId, const char *data, size_t len);
+  Stats stats() const;
+
+private:
+  struct Flow {
+    udp::endpoint peer;                  // client side: local sender
+    std::shared_ptr<udp::socket> socket; // host side: socket to the service
+    PooledBuffer recvBuffer;
+    std::chrono::steady_clock::time_point lastActive;
+  };
+
+  void startListenReceive();
+  void startFlowReceive(uint32_t flowId, std::shared_ptr<udp::socket> socket,
+                        PooledBuffer buffer);
+  void deliverOnIo(uint32_t flowId, PooledBuffer payload);
+  Flow *openHostFlow(uint32_t flowId);
+  void scheduleSweep();
+  void sweepIdleFlows();
+
+  boost::asio::io_context &io_context_;
+  DatagramSendCallback sendCallback_;
+  std::unique_ptr<udp::socket> listenSocket_;
+  PooledBuffer listenBuffer_;
+  udp::endpoint listenSender_;
+  std::function<uint16_t(uint32_t)> targetResolver_;
+  uint16_t flowTag_ = 0;
+  std::atomic<bool> stopped_{false};
+
+  // Touched only on io_context_.
+  std::unordered_map<uint32_t, Flow> flows_;
+  std::map<udp::endpoint, uint32_t> flowByPeer_;
+  uint16_t nextFlowIndex_ = 1;
+  bool flowLimitReported_ = false;
+  std::unique_ptr<boost::asio::steady_timer> sweepTimer_;
+
+  std::atomic<uint64_t> datagramsOut_{0};
+  std::atomic<uint64_t> datagramsIn_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<std::size_t> activeFlows_{0};
+};
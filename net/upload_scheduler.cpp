@@ -0,0 +1,187 @@
+#include "upload_scheduler.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+// A client that asked to send this recently still has data waiting.
+constexpr std::chrono::milliseconds kDemandWindow{100};
+// Refills happen at most this often, and time nobody asked for is not
+// saved up beyond kMaxRefillGap.
+constexpr std::chrono::milliseconds kMinRefillGap{1};
+constexpr std::chrono::milliseconds kMaxRefillGap{100};
+// Allowance a client may bank: this long at its rate, at least kMinBurst.
+constexpr double kBurstSeconds = 0.02;
+constexpr double kMinBurstBytes = 64 * 1024;
+constexpr std::chrono::seconds kRateWindow{1};
+// Clients left at the defaults are forgotten after this long idle.
+constexpr std::chrono::seconds kForgetAfter{60};
+
+double seconds(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+} // namespace
+
+void UploadScheduler::setTotalRate(int64_t bytesPerSec) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  totalRate_ = std::max<int64_t>(bytesPerSec, 0);
+}
+
+void UploadScheduler::setWeight(uint64_t client, uint32_t weight) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  clientLocked(client).weight = std::max(weight, 1u);
+}
+
+void UploadScheduler::setCap(uint64_t client, int64_t bytesPerSec) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  clientLocked(client).cap = std::max<int64_t>(bytesPerSec, 0);
+}
+
+UploadScheduler::Client &UploadScheduler::clientLocked(uint64_t client) {
+  auto it = clients_.find(client);
+  if (it == clients_.end()) {
+    it = clients_.emplace(client, Client{}).first;
+    it->second.tokens = kMinBurstBytes;
+    it->second.windowStart = std::chrono::steady_clock::now();
+  }
+  return it->second;
+}
+
+void UploadScheduler::refillLocked(std::chrono::steady_clock::time_point now) {
+  if (lastRefill_ == std::chrono::steady_clock::time_point{}) {
+    lastRefill_ = now;
+    return;
+  }
+  if (now - lastRefill_ < kMinRefillGap) {
+    return;
+  }
+  const double elapsed =
+      std::min(seconds(now - lastRefill_), seconds(kMaxRefillGap));
+  lastRefill_ = now;
+  const auto ceiling = [this](const Client &client) {
+    const double rate = static_cast<double>(
+        client.cap > 0 ? client.cap : totalRate_);
+    return std::max(kMinBurstBytes, rate * kBurstSeconds);
+  };
+
+  if (totalRate_ <= 0) {
+    for (auto &entry : clients_) {
+      Client &client = entry.second;
+      if (client.cap > 0) {
+        client.tokens = std::min(client.tokens + client.cap * elapsed,
+                                 ceiling(client));
+      }
+    }
+  } else {
+    // Water-filling: the budget is split by weight among clients with data
+    // waiting; what a capped or full client cannot take goes round again.
+    struct Share {
+      Client *client;
+      double room;
+    };
+    std::vector<Share> waiting;
+    for (auto &entry : clients_) {
+      Client &client = entry.second;
+      if (now - client.lastDemand > kDemandWindow) {
+        continue;
+      }
+      double room = ceiling(client) - client.tokens;
+      if (client.cap > 0) {
+        room = std::min(room, client.cap * elapsed);
+      }
+      if (room > 0.0) {
+        waiting.push_back({&client, room});
+      }
+    }
+    double budget = totalRate_ * elapsed;
+    while (budget >= 1.0 && !waiting.empty()) {
+      double weights = 0.0;
+      for (const Share &share : waiting) {
+        weights += share.client->weight;
+      }
+      double granted = 0.0;
+      for (Share &share : waiting) {
+        const double give =
+            std::min(share.room, budget * share.client->weight / weights);
+        share.client->tokens += give;
+        share.room -= give;
+        granted += give;
+      }
+      budget -= granted;
+      waiting.erase(std::remove_if(waiting.begin(), waiting.end(),
+                                   [](const Share &share) {
+                                     return share.room < 1.0;
+                                   }),
+                    waiting.end());
+      if (granted <= 0.0) {
+        break;
+      }
+    }
+  }
+
+  for (auto it = clients_.begin(); it != clients_.end();) {
+    const Client &client = it->second;
+    if (client.weight == kDefaultWeight && client.cap == 0 &&
+        now - client.lastDemand > kForgetAfter &&
+        now - client.windowStart > kForgetAfter) {
+      it = clients_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool UploadScheduler::maySend(uint64_t client) {
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  refillLocked(now);
+  Client &entry = clientLocked(client);
+  entry.lastDemand = now;
+  if (entry.tokens > 0.0 || (totalRate_ <= 0 && entry.cap <= 0)) {
+    return true;
+  }
+  ++entry.deferrals;
+  return false;
+}
+
+void UploadScheduler::consume(uint64_t client, std::size_t bytes) {
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  Client &entry = clientLocked(client);
+  if (totalRate_ > 0 || entry.cap > 0) {
+    // Unasked sends (interactive frames) may overdraw, by one burst at most.
+    const double floor = -std::max(
+        kMinBurstBytes,
+        static_cast<double>(entry.cap > 0 ? entry.cap : totalRate_) *
+            kBurstSeconds);
+    entry.tokens = std::max(entry.tokens - static_cast<double>(bytes), floor);
+  }
+  entry.bytesSent += bytes;
+  entry.windowBytes += bytes;
+  const double age = seconds(now - entry.windowStart);
+  if (age >= seconds(kRateWindow)) {
+    entry.rate = entry.windowBytes / age;
+    entry.windowBytes = 0;
+    entry.windowStart = now;
+  }
+}
+
+std::map<uint64_t, UploadScheduler::ClientStats>
+UploadScheduler::stats() const {
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<uint64_t, ClientStats> result;
+  for (const auto &entry : clients_) {
+    const Client &client = entry.second;
+    ClientStats &stats = result[entry.first];
+    stats.weight = client.weight;
+    stats.capBytesPerSec = client.cap;
+    stats.bytesSent = client.bytesSent;
+    stats.deferrals = client.deferrals;
+    // A client that stopped sending decays toward zero.
+    const double age = seconds(now - client.windowStart);
+    stats.sendRateBytesPerSec =
+        age >= seconds(kRateWindow) ? client.windowBytes / age : client.rate;
+  }
+  return result;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+// Shares the host's upload among its clients. A client is a remote
+// SteamID, so its stripes draw on one allowance. Clients with data waiting
+// split the host budget by weight; whatever an idle or capped client leaves
+// unused goes to the others. Without a host budget only the caps apply.
+// Throttling a client's sends also stalls the local reads feeding it (their
+// stream credit stops coming back), so it bounds its io time as well.
+class UploadScheduler {
+public:
+  static constexpr uint32_t kDefaultWeight = 4;
+
+  // Bytes per second; 0 lifts the limit.
+  void setTotalRate(int64_t bytesPerSec);
+  void setWeight(uint64_t client, uint32_t weight);
+  void setCap(uint64_t client, int64_t bytesPerSec);
+
+  // Whether `client` may send now; asking marks it as having data waiting.
+  bool maySend(uint64_t client);
+  // Charges bytes handed to Steam, including ones sent without asking.
+  void consume(uint64_t client, std::size_t bytes);
+
+  struct ClientStats {
+    uint32_t weight = kDefaultWeight;
+    int64_t capBytesPerSec = 0;
+    uint64_t bytesSent = 0;
+    double sendRateBytesPerSec = 0.0; // over the last rate window
+    uint64_t deferrals = 0;           // sends held back for lack of budget
+  };
+  std::map<uint64_t, ClientStats> stats() const;
+
+private:
+  struct Client {
+    uint32_t weight = kDefaultWeight;
+    int64_t cap = 0;
+    double tokens = 0.0;
+    std::chrono::steady_clock::time_point lastDemand;
+    uint64_t bytesSent = 0;
+    uint64_t deferrals = 0;
+    uint64_t windowBytes = 0;
+    std::chrono::steady_clock::time_point windowStart;
+    double rate = 0.0;
+  };
+
+  Client &clientLocked(uint64_t client);
+  void refillLocked(std::chrono::steady_clock::time_point now);
+
+  int64_t totalRate_ = 0;
+  std::chrono::steady_clock::time_point lastRefill_;
+  std::map<uint64_t, Client> clients_;
+  mutable std::mutex mutex_;
+};
@@ -516,6 +516,97 @@ ApplicationWindow {
                             Rectangle { Layout.fillWidth: true; color: "transparent" }
 
                         }
+
+                        RowLayout {
+                            visible: backend.connectionMode === 0
+                            Layout.fillWidth: true
+                            spacing: 10
+
+                            Label {
+                                text: qsTr("附加服务端口")
+                                color: "#a7b6d8"
+                            }
+
+                            TextField {
+                                id: portMapField
+                                Layout.fillWidth: true
+                                text: backend.portMap
+                                placeholderText: qsTr("名称=端口 或 名称=目标端口:绑定端口，如 voice=9987, map=8123:18123")
+                                enabled: backend.connectionMode === 0 && !(backend.isHost || backend.isConnected)
+                                onEditingFinished: backend.portMap = text
+                            }
+                        }
+
+                        RowLayout {
+                            visible: backend.connectionMode === 0
+                            Layout.fillWidth: true
+                            spacing: 10
+
+                            Label {
+                                text: qsTr("并行连接数")
+                                color: "#a7b6d8"
+                            }
+
+                            SpinBox {
+                                id: stripeCountField
+                                from: 1
+                                to: 4
+                                value: backend.stripeCount
+                                enabled: backend.connectionMode === 0 && !(backend.isHost || backend.isConnected)
+                                onValueChanged: backend.stripeCount = value
+                            }
+
+                            Rectangle { Layout.fillWidth: true; color: "transparent" }
+                        }
+
+                        RowLayout {
+                            Layout.fillWidth: true
+                            spacing: 10
+
+                            Label {
+                                text: qsTr("房主上传限速 (KB/s, 0=不限)")
+                                color: "#a7b6d8"
+                            }
+
+                            SpinBox {
+                                from: 0
+                                to: 1000000
+                                stepSize: 128
+                                editable: true
+                                value: backend.hostUploadLimit
+                                onValueModified: backend.hostUploadLimit = value
+                            }
+
+                            Rectangle { Layout.fillWidth: true; color: "transparent" }
+                        }
+
+                        RowLayout {
+                            Layout.fillWidth: true
+                            spacing: 10
+
+                            Label {
+                                text: qsTr("传输配置")
+                                color: "#a7b6d8"
+                            }
+
+                            ComboBox {
+                                id: transportProfileCombo
+                                Layout.preferredWidth: 180
+                                model: [
+                                    { text: qsTr("竞技低延迟"), value: 0 },
+                                    { text: qsTr("均衡"), value: 1 },
+                                    { text: qsTr("大流量传输"), value: 2 }
+                                ]
+                                textRole: "text"
+                                valueRole: "value"
+                                currentIndex: Math.max(0, Math.min(model.length - 1, backend.transportProfile))
+                                // Members follow the host's choice for the lobby.
+                                enabled: backend.isHost || !backend.isConnected
+                                onActivated: backend.transportProfile = model[currentIndex].value
+                            }
+
+                            Rectangle { Layout.fillWidth: true; color: "transparent" }
+                        }
                     }
                 }
 
@@ -1039,6 +1130,11 @@ ApplicationWindow {
                                                             required property string relay
                                                             required property bool isFriend
                                                             required property bool isSelf
+                                                            required property int uploadRate
+                                                            required property int uploadQueued
+                                                            required property int uploadDelay
+                                                            required property int uploadWeight
+                                                            required property int uploadCap
 
                                                             radius: 10
                                                             // 修改颜色逻辑：增加鼠标悬停变色效果，提示用户可交互
@@ -1064,6 +1160,19 @@ ApplicationWindow {
                                                                     onTriggered: backend.copyToClipboard(ip)
                                                                 }
 
+                                                                Menu {
+                                                                    id: uploadShareMenu
+                                                                    title: qsTr("上传份额")
+                                                                    enabled: backend.isHost && !isSelf
+                                                                    MenuItem { text: qsTr("高"); checkable: true; checked: uploadWeight === 8; onTriggered: backend.setMemberUploadShare(steamId, 8, uploadCap) }
+                                                                    MenuItem { text: qsTr("普通"); checkable: true; checked: uploadWeight === 4; onTriggered: backend.setMemberUploadShare(steamId, 4, uploadCap) }
+                                                                    MenuItem { text: qsTr("低"); checkable: true; checked: uploadWeight === 1; onTriggered: backend.setMemberUploadShare(steamId, 1, uploadCap) }
+                                                                    MenuSeparator {}
+                                                                    MenuItem { text: qsTr("不限速"); checkable: true; checked: uploadCap === 0; onTriggered: backend.setMemberUploadShare(steamId, uploadWeight, 0) }
+                                                                    MenuItem { text: qsTr("限速 256 KB/s"); checkable: true; checked: uploadCap === 256; onTriggered: backend.setMemberUploadShare(steamId, uploadWeight, 256) }
+                                                                    MenuItem { text: qsTr("限速 1 MB/s"); checkable: true; checked: uploadCap === 1024; onTriggered: backend.setMemberUploadShare(steamId, uploadWeight, 1024) }
+                                                                }
+
                                                             }
 
                                                             MouseArea {
@@ -1075,7 +1184,8 @@ ApplicationWindow {
                                                                     if (mouse.button === Qt.RightButton) {
                                                                         const hasMenu =
                                                                             addFriendItem.visible ||
-                                                                            (backend.connectionMode === 1 && ip && ip.length > 0)
+                                                                            (backend.connectionMode === 1 && ip && ip.length > 0) ||
+                                                                            uploadShareMenu.enabled
 
                                                                         if (hasMenu)
                                                                             memberMenu.popup()
@@ -1202,6 +1312,14 @@ ApplicationWindow {
                                                                         horizontalAlignment: Text.AlignRight
                                                                         Layout.alignment: Qt.AlignRight
                                                                     }
+                                                                    Label {
+                                                                        visible: backend.isHost && uploadRate >= 0
+                                                                        text: qsTr("↑ %1 KB/s · 排队 %2 KB / %3 ms").arg(uploadRate).arg(uploadQueued).arg(uploadDelay)
+                                                                        color: "#8ea4c8"
+                                                                        font.pixelSize: 12
+                                                                        horizontalAlignment: Text.AlignRight
+                                                                        Layout.alignment: Qt.AlignRight
+                                                                    }
                                                                 }
                                                             }
                                                         }
@@ -1,6 +1,7 @@
 #include "backend.h"
 
 #include "../net/tcp_server.h"
+#include "../steam/steam_message_handler.h"
 #include "../steam/steam_networking_manager.h"
 #include "../steam/steam_room_manager.h"
 #include "../steam/steam_utils.h"
@@ -23,6 +24,7 @@
 #include <QNetworkRequest>
 #include <QProcess>
 #include <QQmlEngine>
+#include <QRegularExpression>
 #include <QSaveFile>
 #include <QSettings>
 #include <QStandardPaths>
@@ -217,6 +219,37 @@ void fixSteamEnvForSudo() {
 }
 #endif
 
+// Parses "name=port" or "name=targetPort:bindPort" entries separated by
+// commas or whitespace. Malformed entries are skipped.
+std::vector<tunnel::TunnelService> parsePortMap(const QString &map) {
+  std::vector<tunnel::TunnelService> services;
+  const QStringList entries =
+      map.split(QRegularExpression(QStringLiteral("[,\\s]+")),
+                Qt::SkipEmptyParts);
+  for (const QString &entry : entries) {
+    const int eq = entry.indexOf(QLatin1Char('='));
+    if (eq <= 0) {
+      continue;
+    }
+    const QString name = entry.left(eq);
+    const QStringList ports = entry.mid(eq + 1).split(QLatin1Char(':'));
+    bool targetOk = false;
+    bool bindOk = ports.size() == 1;
+    const int target = ports.value(0).toInt(&targetOk);
+    const int bind = ports.size() == 2 ? ports[1].toInt(&bindOk) : target;
+    if (!targetOk || !bindOk || ports.size() > 2 || target < 1 ||
+        target > 65535 || bind < 1 || bind > 65535) {
+      continue;
+    }
+    tunnel::TunnelService service;
+    service.name = name.toStdString();
+    service.targetPort = static_cast<uint16_t>(target);
+    service.bindPort = static_cast<uint16_t>(bind);
+    services.push_back(std::move(service));
+  }
+  return services;
+}
+
 QString stripGhProxyPrefix(const QString &url) {
   const QString prefix = QStringLiteral("https://gh-proxy.org/");
   if (url.startsWith(prefix)) {
@@ -446,6 +479,102 @@ void Backend::setLocalBindPort(int port) {
   emit localBindPortChanged();
 }
 
+void Backend::setPortMap(const QString &map) {
+  if (portMap_ == map) {
+    return;
+  }
+  portMap_ = map;
+  if (steamManager_) {
+    steamManager_->setServices(parsePortMap(portMap_));
+  }
+  emit portMapChanged();
+}
+
+void Backend::setStripeCount(int count) {
+  count = std::clamp(count, 1, SteamNetworkingManager::kMaxStripes);
+  if (stripeCount_ == count) {
+    return;
+  }
+  stripeCount_ = count;
+  if (steamManager_) {
+    steamManager_->setStripeCount(stripeCount_);
+  }
+  emit stripeCountChanged();
+}
+
+void Backend::setHostUploadLimit(int kbps) {
+  kbps = std::max(kbps, 0);
+  if (hostUploadLimitKBps_ == kbps) {
+    return;
+  }
+  hostUploadLimitKBps_ = kbps;
+  applyUploadShares();
+  emit hostUploadLimitChanged();
+}
+
+void Backend::setTransportProfile(int profile) {
+  profile = std::clamp(profile, 0, 2);
+  if (transportProfile_ == profile) {
+    return;
+  }
+  transportProfile_ = profile;
+  applyTransportProfile();
+  // Members of our lobby switch with us.
+  if (roomManager_ && isHost()) {
+    roomManager_->refreshLobbyMetadata();
+  }
+  emit transportProfileChanged();
+}
+
+void Backend::applyTransportProfile() {
+  const TransportProfile profile = TransportProfile::forKind(
+      static_cast<TransportProfile::Kind>(transportProfile_));
+  if (roomManager_) {
+    roomManager_->setAdvertisedProfile(profile.name());
+  }
+  if (steamManager_) {
+    steamManager_->setTransportProfile(profile);
+  }
+  if (vpnManager_) {
+    vpnManager_->setTransportProfile(profile);
+  }
+}
+
+void Backend::handleLobbyTransportProfile(const QString &name) {
+  // The host's own lobby only echoes its setting back.
+  if (isHost()) {
+    return;
+  }
+  setTransportProfile(static_cast<int>(
+      TransportProfile::kindFromName(name.toStdString())));
+}
+
+void Backend::setMemberUploadShare(const QString &steamId, int weight,
+                                   int capKBps) {
+  bool ok = false;
+  const uint64_t id = steamId.toULongLong(&ok);
+  if (!ok || id == 0) {
+    return;
+  }
+  memberUploadShares_[id] = {std::max(weight, 1), std::max(capKBps, 0)};
+  applyUploadShares();
+  updateMembersList();
+}
+
+void Backend::applyUploadShares() {
+  SteamMessageHandler *handler =
+      steamManager_ ? steamManager_->getMessageHandler() : nullptr;
+  if (!handler) {
+    return;
+  }
+  handler->setHostUploadLimit(int64_t{hostUploadLimitKBps_} * 1024);
+  for (const auto &entry : memberUploadShares_) {
+    handler->setClientUploadShare(entry.first,
+                                  static_cast<uint32_t>(entry.second.first),
+                                  int64_t{entry.second.second} * 1024);
+  }
+}
+
 bool Backend::tryInitializeSteam() {
   if (steamReady_) {
     return true;
@@ -526,6 +655,12 @@ bool Backend::tryInitializeSteam() {
             this, [this, text]() { handlePinnedMessageMetadata(text); },
             Qt::QueuedConnection);
       });
+  roomManager_->setTransportProfileCallback([this](const std::string &name) {
+    const QString profile = QString::fromStdString(name);
+    QMetaObject::invokeMethod(
+        this, [this, profile]() { handleLobbyTransportProfile(profile); },
+        Qt::QueuedConnection);
+  });
   roomManager_->setLobbyListCallback(
       [this](const std::vector<SteamRoomManager::LobbyInfo> &lobbies) {
         QMetaObject::invokeMethod(
@@ -537,8 +672,12 @@ bool Backend::tryInitializeSteam() {
             Qt::QueuedConnection);
       });
 
+  steamManager_->setServices(parsePortMap(portMap_));
+  steamManager_->setStripeCount(stripeCount_);
   steamManager_->setMessageHandlerDependencies(ioContext_, server_, localPort_,
                                                localBindPort_);
+  applyTransportProfile();
+  applyUploadShares();
   steamManager_->startMessageHandler();
 
   refreshSelfSteamId();
@@ -665,6 +804,7 @@ void Backend::ensureVpnSetup() {
       vpnManager_.reset();
       return;
     }
+    applyTransportProfile();
   }
   if (!vpnBridge_) {
     vpnBridge_ = std::make_unique<SteamVpnBridge>(vpnManager_.get());
@@ -1979,6 +2119,25 @@ void Backend::updateMembersList() {
     return hostId.IsValid() && member == hostId;
   };
 
+  std::map<uint64_t, SteamMessageHandler::ClientUploadStats> uploadStats;
+  if (isHost() && steamManager_->getMessageHandler()) {
+    uploadStats = steamManager_->getMessageHandler()->getClientUploadStats();
+  }
+  const auto fillUpload = [&](MembersModel::Entry &entry, uint64_t member) {
+    auto it = uploadStats.find(member);
+    if (it == uploadStats.end()) {
+      return;
+    }
+    const auto &upload = it->second;
+    entry.uploadKBps =
+        static_cast<int>(upload.share.sendRateBytesPerSec / 1024.0);
+    entry.uploadQueuedKB = static_cast<int>(upload.queuedBytes / 1024);
+    entry.uploadDelayMs = static_cast<int>(upload.queueDelayUs / 1000);
+    entry.uploadWeight = static_cast<int>(upload.share.weight);
+    entry.uploadCapKBps =
+        static_cast<int>(upload.share.capBytesPerSec / 1024);
+  };
+
   for (const auto &memberId : lobbyMembers) {
     const uint64 memberValue = memberId.ConvertToUint64();
     seen.insert(memberValue);
@@ -2055,6 +2214,7 @@ void Backend::updateMembersList() {
       }
     }
 
+    fillUpload(entry, memberValue);
     entries.push_back(std::move(entry));
   }
 
@@ -2099,6 +2259,7 @@ void Backend::updateMembersList() {
         pingBroadcast.emplace_back(remoteValue, entry.ping, relayInfo);
       }
 
+      fillUpload(entry, remoteValue);
       entries.push_back(std::move(entry));
     }
   }
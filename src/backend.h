@@ -50,6 +50,15 @@ class Backend : public QObject {
       int localPort READ localPort WRITE setLocalPort NOTIFY localPortChanged)
   Q_PROPERTY(int localBindPort READ localBindPort WRITE setLocalBindPort NOTIFY
                  localBindPortChanged)
+  Q_PROPERTY(
+      QString portMap READ portMap WRITE setPortMap NOTIFY portMapChanged)
+  Q_PROPERTY(int stripeCount READ stripeCount WRITE setStripeCount NOTIFY
+                 stripeCountChanged)
+  Q_PROPERTY(int hostUploadLimit READ hostUploadLimit WRITE setHostUploadLimit
+                 NOTIFY hostUploadLimitChanged)
+  // 0 low latency, 1 balanced, 2 bulk transfer (TransportProfile::Kind).
+  Q_PROPERTY(int transportProfile READ transportProfile WRITE
+                 setTransportProfile NOTIFY transportProfileChanged)
   Q_PROPERTY(QVariantList friends READ friends NOTIFY friendsChanged)
   Q_PROPERTY(FriendsModel *friendsModel READ friendsModel NOTIFY friendsChanged)
   Q_PROPERTY(QString friendFilter READ friendFilter WRITE setFriendFilter NOTIFY
@@ -110,6 +119,10 @@ public:
   int tcpClients() const;
   int localPort() const { return localPort_; }
   int localBindPort() const { return localBindPort_; }
+  QString portMap() const { return portMap_; }
+  int stripeCount() const { return stripeCount_; }
+  int hostUploadLimit() const { return hostUploadLimitKBps_; }
+  int transportProfile() const { return transportProfile_; }
   QVariantList friends() const { return friends_; }
   FriendsModel *friendsModel() { return &friendsModel_; }
   LobbiesModel *lobbiesModel() { return &lobbiesModel_; }
@@ -142,6 +155,10 @@ public:
   void setPublishLobby(bool publish);
   void setLocalPort(int port);
   void setLocalBindPort(int port);
+  void setPortMap(const QString &map);
+  void setStripeCount(int count);
+  void setHostUploadLimit(int kbps);
+  void setTransportProfile(int profile);
   void setFriendFilter(const QString &text);
   void setRoomName(const QString &name);
   void setLobbyFilter(const QString &text);
@@ -158,6 +175,10 @@ public:
   Q_INVOKABLE void refreshMembers();
   Q_INVOKABLE void inviteFriend(const QString &steamId);
   Q_INVOKABLE void addFriend(const QString &steamId);
+  // Host only: the member's weight in the shared upload and its own cap
+  // (KB/s, 0 for none).
+  Q_INVOKABLE void setMemberUploadShare(const QString &steamId, int weight,
+                                        int capKBps);
   Q_INVOKABLE void copyToClipboard(const QString &text);
   Q_INVOKABLE void sendChatMessage(const QString &text);
   Q_INVOKABLE void pinChatMessage(const QString &steamId,
@@ -177,6 +198,10 @@ signals:
   void joinTargetChanged();
   void localPortChanged();
   void localBindPortChanged();
+  void portMapChanged();
+  void stripeCountChanged();
+  void hostUploadLimitChanged();
+  void transportProfileChanged();
   void friendsChanged();
   void serverChanged();
   void friendFilterChanged();
@@ -200,6 +225,9 @@ private:
   void tick();
   void updateStatus();
   void updateMembersList();
+  void applyUploadShares();
+  void applyTransportProfile();
+  void handleLobbyTransportProfile(const QString &name);
   void updateFriendsList();
   void
   updateLobbiesList(const std::vector<SteamRoomManager::LobbyInfo> &lobbies);
@@ -268,6 +296,12 @@ private:
   QString hostSteamId_;
   int localPort_;
   int localBindPort_;
+  QString portMap_; // extra services, e.g. "voice=9987, map=8123:18123"
+  int stripeCount_ = 1; // parallel Steam connections opened when joining
+  int hostUploadLimitKBps_ = 0; // shared by all clients while hosting
+  int transportProfile_ = 1; // set by the host for its lobby
+  // Per-member upload weight and cap (KB/s), reapplied on every session.
+  std::unordered_map<uint64_t, std::pair<int, int>> memberUploadShares_;
   int lastTcpClients_;
   int lastMemberLogCount_;
   QVariantList friends_;
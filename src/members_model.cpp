@@ -34,6 +34,16 @@ QVariant MembersModel::data(const QModelIndex &index, int role) const {
     return entry.isFriend;
   case IsSelfRole:
     return entry.isSelf;
+  case UploadRateRole:
+    return entry.uploadKBps;
+  case UploadQueuedRole:
+    return entry.uploadQueuedKB;
+  case UploadDelayRole:
+    return entry.uploadDelayMs;
+  case UploadWeightRole:
+    return entry.uploadWeight;
+  case UploadCapRole:
+    return entry.uploadCapKBps;
   default:
     return {};
   }
@@ -49,6 +59,11 @@ QHash<int, QByteArray> MembersModel::roleNames() const {
   roles[RelayRole] = "relay";
   roles[IsFriendRole] = "isFriend";
   roles[IsSelfRole] = "isSelf";
+  roles[UploadRateRole] = "uploadRate";
+  roles[UploadQueuedRole] = "uploadQueued";
+  roles[UploadDelayRole] = "uploadDelay";
+  roles[UploadWeightRole] = "uploadWeight";
+  roles[UploadCapRole] = "uploadCap";
   return roles;
 }
 
@@ -70,7 +85,12 @@ void MembersModel::setMembers(std::vector<Entry> entries) {
         entries[i].relay != entries_[i].relay ||
         entries[i].isFriend != entries_[i].isFriend ||
         entries[i].isSelf != entries_[i].isSelf ||
-        entries[i].ip != entries_[i].ip) {
+        entries[i].ip != entries_[i].ip ||
+        entries[i].uploadKBps != entries_[i].uploadKBps ||
+        entries[i].uploadQueuedKB != entries_[i].uploadQueuedKB ||
+        entries[i].uploadDelayMs != entries_[i].uploadDelayMs ||
+        entries[i].uploadWeight != entries_[i].uploadWeight ||
+        entries[i].uploadCapKBps != entries_[i].uploadCapKBps) {
       changed = true;
       break;
     }
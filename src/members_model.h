@@ -17,7 +17,12 @@ public:
     RelayRole,
     IsFriendRole,
     IsSelfRole,
-    IpRole
+    IpRole,
+    UploadRateRole,
+    UploadQueuedRole,
+    UploadDelayRole,
+    UploadWeightRole,
+    UploadCapRole
   };
 
   struct Entry {
@@ -29,6 +34,13 @@ public:
     bool isFriend = false;
     bool isSelf = false;
     QString ip;
+    // Host only: the member's share of the host upload; -1 rate when the
+    // member is not a connected client.
+    int uploadKBps = -1;
+    int uploadQueuedKB = 0;
+    int uploadDelayMs = 0; // oldest frame waiting to be sent
+    int uploadWeight = 0;
+    int uploadCapKBps = 0;
   };
 
   explicit MembersModel(QObject *parent = nullptr);
@@ -0,0 +1,188 @@
+#include "send_rate_controller.h"
+
+#include <algorithm>
+#include <iostream>
+#include <isteamnetworkingsockets.h>
+#include <isteamnetworkingutils.h>
+
+namespace {
+constexpr int kDefaultMinRate = 64 * 1024;
+constexpr int kDefaultMaxRate = 64 * 1024 * 1024;
+constexpr int kDefaultInitialRate = 1024 * 1024; // the old global pin
+// Congestion: ping this far above the path's baseline (queueing delay), or
+// quality below kMinQuality. Demand: more than 1/kPendingFraction of a
+// second queued, or sending at kBusyFraction of the allowed rate.
+constexpr int kMinQueueDelayMs = 25;
+constexpr float kMinQuality = 0.95f;
+constexpr int kPendingFraction = 8;
+constexpr double kBusyFraction = 0.85;
+constexpr double kSlowStartFactor = 1.5;
+constexpr double kIncreaseFactor = 1.15;
+constexpr double kDecreaseFactor = 0.75;
+// Consecutive samples required before acting; probing past 90% of the
+// rate that last triggered a backoff takes kPlateauSamples instead.
+constexpr int kSamplesToIncrease = 3;
+constexpr int kPlateauSamples = 8;
+constexpr int kSamplesToDecrease = 2;
+constexpr std::chrono::seconds kHoldAfterDecrease{2};
+// The baseline creeps up 1ms per this many samples so a route change is
+// eventually accepted as the new normal.
+constexpr int kBaselineDecaySamples = 4;
+constexpr std::size_t kTraceLength = 32;
+} // namespace
+
+SendRateController::SendRateController(ISteamNetworkingSockets *interface,
+                                       ISteamNetworkingUtils *utils)
+    : interface_(interface), utils_(utils ? utils : SteamNetworkingUtils()),
+      minRate_(kDefaultMinRate),
+      maxRate_(kDefaultMaxRate), initialRate_(kDefaultInitialRate) {}
+
+void SendRateController::setLimits(int minRate, int maxRate, int initialRate) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  minRate_ = std::max(minRate, 1);
+  maxRate_ = std::max(maxRate, minRate_);
+  initialRate_ = std::clamp(initialRate, minRate_, maxRate_);
+}
+
+void SendRateController::update(HSteamNetConnection conn,
+                                std::chrono::steady_clock::time_point now) {
+  SteamNetConnectionRealTimeStatus_t status{};
+  if (interface_->GetConnectionRealTimeStatus(conn, &status, 0, nullptr) !=
+          k_EResultOK ||
+      status.m_eState != k_ESteamNetworkingConnectionState_Connected) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto inserted = states_.emplace(conn, State{});
+  State &state = inserted.first->second;
+  if (inserted.second) {
+    apply(conn, state, initialRate_, "initial", status, now);
+  }
+
+  const int ping = std::max(status.m_nPing, 0);
+  if (state.baselinePingMs == 0 || ping < state.baselinePingMs) {
+    state.baselinePingMs = std::max(ping, 1);
+    state.baselineAge = 0;
+  } else if (++state.baselineAge >= kBaselineDecaySamples) {
+    ++state.baselinePingMs;
+    state.baselineAge = 0;
+  }
+
+  const float quality = status.m_flConnectionQualityLocal;
+  const int pending = status.m_cbPendingReliable + status.m_cbPendingUnreliable;
+  const bool lossy = quality >= 0.0f && quality < kMinQuality;
+  const bool delayed =
+      ping > state.baselinePingMs +
+                 std::max(kMinQueueDelayMs, state.baselinePingMs / 2);
+  const bool busy =
+      pending > state.rate / kPendingFraction ||
+      status.m_flOutBytesPerSec > kBusyFraction * state.rate;
+
+  if (lossy || delayed) {
+    state.goodSamples = 0;
+    if (++state.badSamples >= kSamplesToDecrease) {
+      state.badSamples = 0;
+      state.slowStart = false;
+      state.holdUntil = now + kHoldAfterDecrease;
+      state.backoffRate = state.rate;
+      const int next = std::max(
+          minRate_, static_cast<int>(state.rate * kDecreaseFactor));
+      if (next != state.rate) {
+        apply(conn, state, next, lossy ? "loss" : "queueing delay", status,
+              now);
+      }
+    }
+    return;
+  }
+  state.badSamples = 0;
+  if (!busy) {
+    // Idle or below the limit: no evidence either way.
+    state.goodSamples = 0;
+    return;
+  }
+  const double factor = state.slowStart ? kSlowStartFactor : kIncreaseFactor;
+  const int next = static_cast<int>(
+      std::min<double>(maxRate_, static_cast<double>(state.rate) * factor));
+  int needed = kSamplesToIncrease;
+  if (state.slowStart) {
+    needed = 1;
+  } else if (next > state.backoffRate - state.backoffRate / 10) {
+    needed = kPlateauSamples;
+  }
+  if (++state.goodSamples < needed || now < state.holdUntil) {
+    return;
+  }
+  state.goodSamples = 0;
+  if (next != state.rate) {
+    apply(conn, state, next, state.slowStart ? "slow start" : "probe", status,
+          now);
+  }
+}
+
+void SendRateController::apply(
+    HSteamNetConnection conn, State &state, int rate, const char *reason,
+    const SteamNetConnectionRealTimeStatus_t &status,
+    std::chrono::steady_clock::time_point now) {
+  Decision decision;
+  decision.at = now;
+  decision.previousRate = state.rate;
+  decision.rate = rate;
+  decision.reason = reason;
+  decision.pingMs = status.m_nPing;
+  decision.baselinePingMs = state.baselinePingMs;
+  decision.quality = status.m_flConnectionQualityLocal;
+  decision.pendingBytes =
+      status.m_cbPendingReliable + status.m_cbPendingUnreliable;
+  state.trace.push_back(decision);
+  if (state.trace.size() > kTraceLength) {
+    state.trace.pop_front();
+  }
+  state.rate = rate;
+
+  // Steam's own estimator may still back off within [rate/2, rate].
+  int32 minRate = std::max(minRate_, rate / 2);
+  int32 maxRate = rate;
+  if (utils_) {
+    utils_->SetConfigValue(k_ESteamNetworkingConfig_SendRateMin,
+                           k_ESteamNetworkingConfig_Connection, conn,
+                           k_ESteamNetworkingConfig_Int32, &minRate);
+    utils_->SetConfigValue(k_ESteamNetworkingConfig_SendRateMax,
+                           k_ESteamNetworkingConfig_Connection, conn,
+                           k_ESteamNetworkingConfig_Int32, &maxRate);
+  }
+  std::cout << "[RateCtl] Connection " << conn << " send rate "
+            << decision.previousRate / 1024 << " -> " << rate / 1024
+            << " KB/s (" << reason << ": ping " << decision.pingMs << "/"
+            << decision.baselinePingMs << "ms, quality " << decision.quality
+            << ", pending " << decision.pendingBytes / 1024 << "KB)"
+            << std::endl;
+}
+
+void SendRateController::retain(const std::set<HSteamNetConnection> &live) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = states_.begin(); it != states_.end();) {
+    if (live.count(it->first)) {
+      ++it;
+    } else {
+      it = states_.erase(it);
+    }
+  }
+}
+
+std::vector<SendRateController::Decision>
+SendRateController::trace(HSteamNetConnection conn) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = states_.find(conn);
+  if (it == states_.end()) {
+    return {};
+  }
+  return std::vector<Decision>(it->second.trace.begin(),
+                               it->second.trace.end());
+}
+
+int SendRateController::currentRate(HSteamNetConnection conn) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = states_.find(conn);
+  return it != states_.end() ? it->second.rate : 0;
+}
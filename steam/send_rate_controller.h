@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <steamnetworkingtypes.h>
+#include <vector>
+
+class ISteamNetworkingSockets;
+class ISteamNetworkingUtils;
+
+// Closed-loop send rate per Steam connection. Each sample compares ping
+// against the path's baseline and looks at connection quality and queued
+// bytes; the result is written to the connection's SendRateMin/Max config.
+// Rates grow quickly until the first sign of congestion (slow start), then
+// additively-increase/multiplicatively-decrease, and every change needs
+// consecutive agreeing samples and respects a hold time after a backoff.
+class SendRateController {
+public:
+  static constexpr std::chrono::milliseconds kSampleInterval{500};
+
+  // `utils` defaults to SteamNetworkingUtils().
+  explicit SendRateController(ISteamNetworkingSockets *interface,
+                              ISteamNetworkingUtils *utils = nullptr);
+
+  // Samples and, if warranted, retunes `conn`. Call every kSampleInterval.
+  void update(HSteamNetConnection conn,
+              std::chrono::steady_clock::time_point now);
+  // Drops state for connections that are gone.
+  void retain(const std::set<HSteamNetConnection> &live);
+
+  // Bounds in bytes per second; new connections start at `initial`.
+  void setLimits(int minRate, int maxRate, int initialRate);
+
+  struct Decision {
+    std::chrono::steady_clock::time_point at;
+    int previousRate = 0;
+    int rate = 0;
+    const char *reason = "";
+    int pingMs = 0;
+    int baselinePingMs = 0;
+    float quality = -1.0f; // -1 when Steam has no estimate yet
+    int pendingBytes = 0;
+  };
+  // The most recent decisions for `conn`, oldest first.
+  std::vector<Decision> trace(HSteamNetConnection conn) const;
+  int currentRate(HSteamNetConnection conn) const;
+
+private:
+  struct State {
+    int rate = 0;
+    int backoffRate = 0; // rate at the last decrease
+    bool slowStart = true;
+    int baselinePingMs = 0;
+    int baselineAge = 0;
+    int goodSamples = 0;
+    int badSamples = 0;
+    std::chrono::steady_clock::time_point holdUntil;
+    std::deque<Decision> trace;
+  };
+
+  void apply(HSteamNetConnection conn, State &state, int rate,
+             const char *reason, const SteamNetConnectionRealTimeStatus_t &status,
+             std::chrono::steady_clock::time_point now);
+
+  ISteamNetworkingSockets *interface_;
+  ISteamNetworkingUtils *utils_;
+  int minRate_;
+  int maxRate_;
+  int initialRate_;
+  std::map<HSteamNetConnection, State> states_;
+  mutable std::mutex mutex_;
+};
@@ -1,4 +1,5 @@
 #include "steam_message_handler.h"
+#include <algorithm>
 #include <chrono>
 #include <cstring>
 #include <iostream>
@@ -8,18 +9,35 @@
 SteamMessageHandler::SteamMessageHandler(
     boost::asio::io_context &io_context, ISteamNetworkingSockets *interface,
     std::vector<HSteamNetConnection> &connections, std::mutex &connectionsMutex,
-    bool &g_isHost, int &localPort)
-    : io_context_(io_context), m_pInterface_(interface),
+    bool &g_isHost, int &localPort, std::size_t workerThreads,
+    ISteamNetworkingUtils *utils)
+    : io_context_(io_context), m_pInterface_(interface), m_pUtils_(utils),
       connections_(connections), connectionsMutex_(connectionsMutex),
       g_isHost_(g_isHost), localPort_(localPort), running_(false),
-      currentPollInterval_(0) {}
+      rateController_(interface, utils) {
+  if (workerThreads > 0) {
+    workers_ = std::make_unique<IoContextPool>(workerThreads);
+  }
+  pollGroup_ = m_pInterface_->CreatePollGroup();
+  if (pollGroup_ == k_HSteamNetPollGroup_Invalid) {
+    std::cerr << "Failed to create Steam poll group" << std::endl;
+  }
+}
 
-SteamMessageHandler::~SteamMessageHandler() { stop(); }
+SteamMessageHandler::~SteamMessageHandler() {
+  stop();
+  if (pollGroup_ != k_HSteamNetPollGroup_Invalid) {
+    m_pInterface_->DestroyPollGroup(pollGroup_);
+  }
+}
 
 void SteamMessageHandler::start() {
   if (running_)
     return;
   running_ = true;
+  if (workers_) {
+    workers_->start();
+  }
   timer_ = std::make_unique<boost::asio::steady_timer>(io_context_);
   startAsyncPoll();
 }
@@ -31,15 +49,380 @@ void SteamMessageHandler::stop() {
   if (timer_) {
     timer_->cancel();
   }
+  if (workers_) {
+    workers_->stop();
+  }
+}
+
+boost::asio::io_context &
+SteamMessageHandler::ioContextFor(HSteamNetConnection conn) {
+  {
+    // A resumed session keeps the context it was created on.
+    std::lock_guard<std::mutex> lock(managersMutex_);
+    auto it = multiplexManagers_.find(conn);
+    if (it != multiplexManagers_.end()) {
+      return it->second->ioContext();
+    }
+  }
+  return workers_ ? workers_->contextFor(conn) : io_context_;
 }
 
 std::shared_ptr<MultiplexManager>
 SteamMessageHandler::getMultiplexManager(HSteamNetConnection conn) {
-  if (multiplexManagers_.find(conn) == multiplexManagers_.end()) {
-    multiplexManagers_[conn] = std::make_shared<MultiplexManager>(
-        m_pInterface_, conn, io_context_, g_isHost_, localPort_);
+  std::lock_guard<std::mutex> lock(managersMutex_);
+  auto it = multiplexManagers_.find(conn);
+  if (it != multiplexManagers_.end()) {
+    return it->second;
+  }
+  return createManagerLocked(conn);
+}
+
+std::shared_ptr<MultiplexManager>
+SteamMessageHandler::createManagerLocked(HSteamNetConnection conn) {
+  const uint64_t peer = peerOf(conn);
+  std::shared_ptr<MultiplexManager> manager;
+  if (!g_isHost_) {
+    detachDeadManagers();
+    auto it = std::find_if(detached_.begin(), detached_.end(),
+                           [peer](const Detached &entry) {
+                             return entry.peer == peer &&
+                                    entry.manager->canResume();
+                           });
+    if (it != detached_.end()) {
+      manager = it->manager;
+      detached_.erase(it);
+      std::cout << "[Multiplex] Resuming session on connection " << conn
+                << std::endl;
+      manager->resumeOn(conn, true);
+    }
+  }
+  if (!manager) {
+    manager = std::make_shared<MultiplexManager>(
+        m_pInterface_, conn,
+        workers_ ? workers_->contextFor(conn) : io_context_, g_isHost_,
+        localPort_, m_pUtils_);
+    manager->setServices(services_);
+    manager->setTransportProfile(profile_);
+    if (g_isHost_) {
+      manager->setUploadScheduler(&uploadScheduler_, peer);
+    }
+  }
+  multiplexManagers_[conn] = manager;
+  managerPeers_[conn] = peer;
+  return manager;
+}
+
+std::shared_ptr<MultiplexManager> SteamMessageHandler::managerForIncoming(
+    HSteamNetConnection conn, const ISteamNetworkingMessage *first) {
+  std::lock_guard<std::mutex> lock(managersMutex_);
+  auto it = multiplexManagers_.find(conn);
+  if (it != multiplexManagers_.end()) {
+    return it->second;
+  }
+  uint64_t token = 0;
+  if (!g_isHost_ ||
+      !tunnel::findHelloToken(static_cast<const char *>(first->m_pData),
+                              static_cast<std::size_t>(first->m_cbSize),
+                              token) ||
+      token == 0) {
+    return createManagerLocked(conn);
+  }
+  const uint64_t peer = peerOf(conn);
+  std::shared_ptr<MultiplexManager> manager;
+  for (auto live = multiplexManagers_.begin(); live != multiplexManagers_.end();
+       ++live) {
+    if (live->second->sessionToken() == token &&
+        managerPeers_[live->first] == peer) {
+      // The client gave up on that connection before we noticed.
+      std::cout << "[Multiplex] Session moved from connection " << live->first
+                << " to " << conn << std::endl;
+      m_pInterface_->CloseConnection(live->first, 0,
+                                     "Session resumed elsewhere", false);
+      manager = live->second;
+      managerPeers_.erase(live->first);
+      multiplexManagers_.erase(live);
+      break;
+    }
+  }
+  if (!manager) {
+    auto detached = std::find_if(
+        detached_.begin(), detached_.end(), [&](const Detached &entry) {
+          return entry.peer == peer && entry.manager->sessionToken() == token;
+        });
+    if (detached != detached_.end()) {
+      std::cout << "[Multiplex] Resuming session on connection " << conn
+                << std::endl;
+      manager = detached->manager;
+      detached_.erase(detached);
+    }
+  }
+  if (!manager) {
+    return createManagerLocked(conn);
+  }
+  manager->setServices(services_);
+  manager->resumeOn(conn, false);
+  multiplexManagers_[conn] = manager;
+  managerPeers_[conn] = peer;
+  return manager;
+}
+
+void SteamMessageHandler::detachDeadManagers() {
+  const auto now = std::chrono::steady_clock::now();
+  for (auto it = multiplexManagers_.begin(); it != multiplexManagers_.end();) {
+    SteamNetConnectionRealTimeStatus_t status{};
+    const bool alive =
+        m_pInterface_->GetConnectionRealTimeStatus(it->first, &status, 0,
+                                                   nullptr) == k_EResultOK &&
+        (status.m_eState == k_ESteamNetworkingConnectionState_Connecting ||
+         status.m_eState == k_ESteamNetworkingConnectionState_FindingRoute ||
+         status.m_eState == k_ESteamNetworkingConnectionState_Connected);
+    if (alive) {
+      ++it;
+      continue;
+    }
+    it = unbindManagerLocked(it, now);
+  }
+  for (auto it = detached_.begin(); it != detached_.end();) {
+    if (now - it->since < MultiplexManager::kResumeWindow) {
+      ++it;
+      continue;
+    }
+    std::cout << "[Multiplex] Session not resumed within "
+              << MultiplexManager::kResumeWindow.count()
+              << "s, closing its streams" << std::endl;
+    retireLocked(it->manager);
+    it = detached_.erase(it);
+  }
+}
+
+SteamMessageHandler::ManagerMap::iterator
+SteamMessageHandler::unbindManagerLocked(
+    ManagerMap::iterator it, std::chrono::steady_clock::time_point now) {
+  if (it->second->canResume()) {
+    detached_.push_back(Detached{it->second, managerPeers_[it->first], now});
+  } else {
+    retireLocked(it->second);
+  }
+  managerPeers_.erase(it->first);
+  return multiplexManagers_.erase(it);
+}
+
+void SteamMessageHandler::retireLocked(
+    std::shared_ptr<MultiplexManager> manager) {
+  manager->closeSession();
+  retiredStreamsReaped_ += manager->getHeldStats().streamsReaped;
+  reclaiming_.push_back(manager);
+  auto timer =
+      std::make_shared<boost::asio::steady_timer>(manager->ioContext());
+  reclaimWhenDrained(std::move(manager), std::move(timer));
+}
+
+void SteamMessageHandler::reclaimWhenDrained(
+    std::shared_ptr<MultiplexManager> manager,
+    std::shared_ptr<boost::asio::steady_timer> timer) {
+  // Handlers the close aborted were queued before this timer expires, so
+  // once nothing is in flight the manager can go.
+  timer->expires_after(kReclaimInterval);
+  timer->async_wait([manager = std::move(manager),
+                     timer](const boost::system::error_code &ec) mutable {
+    if (ec || manager->isDrained()) {
+      return;
+    }
+    reclaimWhenDrained(std::move(manager), std::move(timer));
+  });
+}
+
+void SteamMessageHandler::connectionClosed(HSteamNetConnection conn) {
+  std::lock_guard<std::mutex> lock(managersMutex_);
+  auto it = multiplexManagers_.find(conn);
+  if (it != multiplexManagers_.end()) {
+    unbindManagerLocked(it, std::chrono::steady_clock::now());
+  }
+}
+
+void SteamMessageHandler::dropSessions() {
+  std::lock_guard<std::mutex> lock(managersMutex_);
+  for (auto &entry : multiplexManagers_) {
+    retireLocked(entry.second);
+  }
+  for (auto &entry : detached_) {
+    retireLocked(entry.manager);
+  }
+  multiplexManagers_.clear();
+  managerPeers_.clear();
+  detached_.clear();
+}
+
+SteamMessageHandler::SessionStats SteamMessageHandler::getSessionStats() {
+  SessionStats stats;
+  std::lock_guard<std::mutex> lock(managersMutex_);
+  auto add = [&stats](const MultiplexManager &manager) {
+    const auto held = manager.getHeldStats();
+    stats.streams += held.streams;
+    stats.bytesHeld += held.bytes;
+    stats.streamsReaped += held.streamsReaped;
+  };
+  for (const auto &entry : multiplexManagers_) {
+    add(*entry.second);
+  }
+  for (const auto &entry : detached_) {
+    add(*entry.manager);
+  }
+  reclaiming_.erase(std::remove_if(reclaiming_.begin(), reclaiming_.end(),
+                                   [](const auto &manager) {
+                                     return manager.expired();
+                                   }),
+                    reclaiming_.end());
+  stats.managers = multiplexManagers_.size();
+  stats.detached = detached_.size();
+  stats.reclaiming = reclaiming_.size();
+  stats.streamsReaped += retiredStreamsReaped_;
+  return stats;
+}
+
+uint64_t SteamMessageHandler::peerOf(HSteamNetConnection conn) const {
+  SteamNetConnectionInfo_t info{};
+  if (!m_pInterface_->GetConnectionInfo(conn, &info)) {
+    return 0;
+  }
+  return info.m_identityRemote.GetSteamID().ConvertToUint64();
+}
+
+void SteamMessageHandler::setServices(
+    const std::vector<tunnel::TunnelService> &services) {
+  std::lock_guard<std::mutex> lock(managersMutex_);
+  services_ = services;
+  for (auto &entry : multiplexManagers_) {
+    entry.second->setServices(services_);
+  }
+  for (auto &entry : detached_) {
+    entry.manager->setServices(services_);
   }
-  return multiplexManagers_[conn];
+}
+
+void SteamMessageHandler::setTransportProfile(const TransportProfile &profile) {
+  {
+    std::lock_guard<std::mutex> lock(managersMutex_);
+    profile_ = profile;
+    for (auto &entry : multiplexManagers_) {
+      entry.second->setTransportProfile(profile_);
+    }
+    for (auto &entry : detached_) {
+      entry.manager->setTransportProfile(profile_);
+    }
+  }
+  setLatencyBudget(profile.latencyBudget);
+  setSpinWindow(profile.spinWindow);
+}
+
+void SteamMessageHandler::addConnection(HSteamNetConnection conn) {
+  if (pollGroup_ == k_HSteamNetPollGroup_Invalid || parked_.count(conn)) {
+    return;
+  }
+  if (grouped_.insert(conn).second) {
+    m_pInterface_->SetConnectionPollGroup(conn, pollGroup_);
+  }
+}
+
+void SteamMessageHandler::reconcileConnections() {
+  std::vector<HSteamNetConnection> current;
+  {
+    std::lock_guard<std::mutex> lockConn(connectionsMutex_);
+    current = connections_;
+  }
+  for (auto it = grouped_.begin(); it != grouped_.end();) {
+    if (std::find(current.begin(), current.end(), *it) == current.end()) {
+      it = grouped_.erase(it); // closed; Steam already dropped it from the group
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = parked_.begin(); it != parked_.end();) {
+    if (std::find(current.begin(), current.end(), it->first) == current.end()) {
+      it = parked_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto conn : current) {
+    addConnection(conn);
+  }
+  rateController_.retain(
+      std::set<HSteamNetConnection>(current.begin(), current.end()));
+  std::lock_guard<std::mutex> lock(managersMutex_);
+  detachDeadManagers();
+}
+
+void SteamMessageHandler::updateSendRates(
+    std::chrono::steady_clock::time_point now) {
+  for (auto conn : grouped_) {
+    rateController_.update(conn, now);
+  }
+  for (const auto &entry : parked_) {
+    rateController_.update(entry.first, now);
+  }
+}
+
+void SteamMessageHandler::setSendRateLimits(int minRate, int maxRate,
+                                            int initialRate) {
+  rateController_.setLimits(minRate, maxRate, initialRate);
+}
+
+std::vector<SendRateController::Decision>
+SteamMessageHandler::getSendRateTrace(HSteamNetConnection conn) const {
+  return rateController_.trace(conn);
+}
+
+void SteamMessageHandler::setHostUploadLimit(int64_t bytesPerSec) {
+  uploadScheduler_.setTotalRate(bytesPerSec);
+}
+
+void SteamMessageHandler::setClientUploadShare(uint64_t steamId,
+                                               uint32_t weight,
+                                               int64_t capBytesPerSec) {
+  uploadScheduler_.setWeight(steamId, weight);
+  uploadScheduler_.setCap(steamId, capBytesPerSec);
+}
+
+std::map<uint64_t, SteamMessageHandler::ClientUploadStats>
+SteamMessageHandler::getClientUploadStats() {
+  std::map<uint64_t, ClientUploadStats> result;
+  for (const auto &entry : uploadScheduler_.stats()) {
+    result[entry.first].share = entry.second;
+  }
+  std::lock_guard<std::mutex> lock(managersMutex_);
+  for (const auto &entry : multiplexManagers_) {
+    auto peer = managerPeers_.find(entry.first);
+    if (peer == managerPeers_.end()) {
+      continue;
+    }
+    const auto held = entry.second->getHeldStats();
+    ClientUploadStats &stats = result[peer->second];
+    stats.queuedBytes += held.queuedBytes;
+    stats.queueDelayUs = std::max(stats.queueDelayUs, held.queueDelayUs);
+  }
+  return result;
+}
+
+void SteamMessageHandler::setLatencyBudget(std::chrono::microseconds budget) {
+  latencyBudgetUs_.store(std::max<int64_t>(budget.count(), 0),
+                         std::memory_order_relaxed);
+}
+
+void SteamMessageHandler::setSpinWindow(std::chrono::microseconds window) {
+  spinWindowUs_.store(std::max<int64_t>(window.count(), 0),
+                      std::memory_order_relaxed);
+}
+
+SteamMessageHandler::PollStats SteamMessageHandler::getPollStats() const {
+  PollStats stats;
+  stats.polls = polls_.load(std::memory_order_relaxed);
+  stats.messages = messagesReceived_.load(std::memory_order_relaxed);
+  stats.spinPolls = spinPolls_.load(std::memory_order_relaxed);
+  stats.idleWaits = idleWaits_.load(std::memory_order_relaxed);
+  stats.maxBatch = maxBatch_.load(std::memory_order_relaxed);
+  stats.parkedConnections = parkedCount_.load(std::memory_order_relaxed);
+  return stats;
 }
 
 void SteamMessageHandler::startAsyncPoll() {
@@ -48,44 +431,89 @@ void SteamMessageHandler::startAsyncPoll() {
 
   // Poll networking callbacks
   m_pInterface_->RunCallbacks();
+  polls_.fetch_add(1, std::memory_order_relaxed);
 
-  // Receive messages and check if any were received
-  int totalMessages = 0;
-  std::vector<HSteamNetConnection> currentConnections;
-  {
-    std::lock_guard<std::mutex> lockConn(connectionsMutex_);
-    currentConnections = connections_;
+  const auto now = std::chrono::steady_clock::now();
+  if (now - lastReconcile_ >= kReconcileInterval) {
+    lastReconcile_ = now;
+    reconcileConnections();
+  }
+  if (now - lastRateUpdate_ >= SendRateController::kSampleInterval) {
+    lastRateUpdate_ = now;
+    updateSendRates(now);
+  }
+  // Parked connections rejoin the group once their write queues drained.
+  for (auto it = parked_.begin(); it != parked_.end();) {
+    if (it->second->isReceiveBlocked()) {
+      ++it;
+      continue;
+    }
+    m_pInterface_->SetConnectionPollGroup(it->first, pollGroup_);
+    grouped_.insert(it->first);
+    it = parked_.erase(it);
   }
-  for (auto conn : currentConnections) {
-    ISteamNetworkingMessage *pIncomingMsgs[256]; // larger batch for throughput
-    int numMsgs =
-        m_pInterface_->ReceiveMessagesOnConnection(conn, pIncomingMsgs, 256);
+
+  // Drain the group in large batches. Messages arrive grouped by
+  // connection, so each run goes to its manager in one call.
+  int totalMessages = 0;
+  for (int round = 0; round < kMaxDrainRounds; ++round) {
+    ISteamNetworkingMessage *pIncomingMsgs[kReceiveBatch];
+    const int numMsgs = m_pInterface_->ReceiveMessagesOnPollGroup(
+        pollGroup_, pIncomingMsgs, kReceiveBatch);
+    if (numMsgs <= 0) {
+      break;
+    }
     totalMessages += numMsgs;
-    for (int i = 0; i < numMsgs; ++i) {
-      ISteamNetworkingMessage *pIncomingMsg = pIncomingMsgs[i];
-      const char *data = (const char *)pIncomingMsg->m_pData;
-      size_t size = pIncomingMsg->m_cbSize;
-      // Handle tunnel packets with multiplexing
-      if (multiplexManagers_.find(conn) == multiplexManagers_.end()) {
-        multiplexManagers_[conn] = std::make_shared<MultiplexManager>(
-            m_pInterface_, conn, io_context_, g_isHost_, localPort_);
+    if (numMsgs > static_cast<int>(maxBatch_.load(std::memory_order_relaxed))) {
+      maxBatch_.store(numMsgs, std::memory_order_relaxed);
+    }
+    int first = 0;
+    while (first < numMsgs) {
+      const HSteamNetConnection conn = pIncomingMsgs[first]->m_conn;
+      int last = first + 1;
+      while (last < numMsgs && pIncomingMsgs[last]->m_conn == conn) {
+        ++last;
       }
-      multiplexManagers_[conn]->handleTunnelPacket(data, size);
-      pIncomingMsg->Release();
+      auto multiplexManager = managerForIncoming(conn, pIncomingMsgs[first]);
+      // Handled on the connection's worker, or inline without a pool.
+      multiplexManager->receiveTunnelMessages(pIncomingMsgs + first,
+                                              last - first);
+      if (multiplexManager->isReceiveBlocked() && !parked_.count(conn)) {
+        // Leave further messages in Steam's receive buffer so the peer is
+        // throttled instead of growing the local write queues without bound.
+        m_pInterface_->SetConnectionPollGroup(conn,
+                                              k_HSteamNetPollGroup_Invalid);
+        grouped_.erase(conn);
+        parked_.emplace(conn, multiplexManager);
+      }
+      first = last;
+    }
+    if (numMsgs < kReceiveBatch) {
+      break;
     }
   }
+  messagesReceived_.fetch_add(totalMessages, std::memory_order_relaxed);
+  parkedCount_.store(parked_.size(), std::memory_order_relaxed);
 
-  // Adaptive polling: if messages received, poll immediately; otherwise
-  // increase interval (keep small to avoid backlog)
+  // Hybrid wait: keep polling without sleeping while traffic is recent,
+  // then sleep for the latency budget between idle polls.
   if (totalMessages > 0) {
-    currentPollInterval_ = 0; // 有消息，立即轮询
-  } else {
-    // 无消息，逐渐增加间隔，最大2ms，优先低延迟
-    currentPollInterval_ = std::min(currentPollInterval_ + 1, 2);
+    lastMessageAt_ = now;
   }
-
-  // Schedule next poll
-  timer_->expires_after(std::chrono::milliseconds(currentPollInterval_));
+  const std::chrono::microseconds spinWindow(
+      spinWindowUs_.load(std::memory_order_relaxed));
+  if (now - lastMessageAt_ < spinWindow) {
+    spinPolls_.fetch_add(1, std::memory_order_relaxed);
+    boost::asio::post(io_context_, [this]() {
+      if (running_) {
+        startAsyncPoll();
+      }
+    });
+    return;
+  }
+  idleWaits_.fetch_add(1, std::memory_order_relaxed);
+  timer_->expires_after(
+      std::chrono::microseconds(latencyBudgetUs_.load(std::memory_order_relaxed)));
   timer_->async_wait([this](const boost::system::error_code &error) {
     if (!error && running_) {
       startAsyncPoll();
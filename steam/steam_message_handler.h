@@ -1,12 +1,17 @@
 #ifndef STEAM_MESSAGE_HANDLER_H
 #define STEAM_MESSAGE_HANDLER_H
 
+#include "../net/io_context_pool.h"
 #include "../net/multiplex_manager.h"
 #include "../net/tcp_server.h"
+#include "send_rate_controller.h"
+#include <atomic>
 #include <boost/asio.hpp>
+#include <chrono>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <steamnetworkingtypes.h>
 #include <thread>
 #include <vector>
@@ -17,7 +22,8 @@ public:
                       ISteamNetworkingSockets *interface,
                       std::vector<HSteamNetConnection> &connections,
                       std::mutex &connectionsMutex, bool &g_isHost,
-                      int &localPort);
+                      int &localPort, std::size_t workerThreads = 0,
+                      ISteamNetworkingUtils *utils = nullptr);
   ~SteamMessageHandler();
 
   void start();
@@ -25,23 +31,155 @@ public:
 
   std::shared_ptr<MultiplexManager>
   getMultiplexManager(HSteamNetConnection conn);
+  // Context the connection's manager and local sockets run on: a pool
+  // worker, or the shared io_context when no workers are configured.
+  boost::asio::io_context &ioContextFor(HSteamNetConnection conn);
+
+  // Ends every tunnel session, including those waiting to be resumed.
+  void dropSessions();
+  // Called when Steam reports `conn` closed. Its session waits for a
+  // resume if it can, otherwise its streams end and the manager is freed
+  // once its handlers have drained. Connections closed locally are found
+  // by the periodic sweep instead.
+  void connectionClosed(HSteamNetConnection conn);
+
+  struct SessionStats {
+    std::size_t managers = 0;   // bound to a live connection
+    std::size_t detached = 0;   // waiting to be resumed
+    std::size_t reclaiming = 0; // closed, handlers still draining
+    std::size_t streams = 0;
+    std::size_t bytesHeld = 0;
+    uint64_t streamsReaped = 0; // closed for inactivity
+  };
+  SessionStats getSessionStats();
+
+  // Applied to every current and future multiplex manager.
+  void setServices(const std::vector<tunnel::TunnelService> &services);
+  // Also sets the poll latency budget and spin window.
+  void setTransportProfile(const TransportProfile &profile);
+
+  // All connections are drained through one Steam poll group. Call on the
+  // io_context thread when a connection is accepted; connections added
+  // elsewhere are picked up by a periodic sweep of `connections`.
+  void addConnection(HSteamNetConnection conn);
+
+  // Idle polling: poll back to back for the spin window after the last
+  // message, then sleep for the latency budget between polls.
+  void setLatencyBudget(std::chrono::microseconds budget);
+  void setSpinWindow(std::chrono::microseconds window);
+
+  struct PollStats {
+    uint64_t polls = 0;
+    uint64_t messages = 0;
+    uint64_t spinPolls = 0; // polls rescheduled without sleeping
+    uint64_t idleWaits = 0; // polls followed by a latency-budget sleep
+    int maxBatch = 0;
+    std::size_t parkedConnections = 0; // out of the group while blocked
+  };
+  PollStats getPollStats() const;
+
+  // Per-connection send rate, retuned from each connection's measured
+  // ping, quality and queued bytes (bytes per second).
+  void setSendRateLimits(int minRate, int maxRate, int initialRate);
+  std::vector<SendRateController::Decision>
+  getSendRateTrace(HSteamNetConnection conn) const;
+
+  // Host upload shared across clients by weight, keyed by remote SteamID
+  // (bytes per second, 0 for no limit).
+  void setHostUploadLimit(int64_t bytesPerSec);
+  void setClientUploadShare(uint64_t steamId, uint32_t weight,
+                            int64_t capBytesPerSec);
+  struct ClientUploadStats {
+    UploadScheduler::ClientStats share;
+    std::size_t queuedBytes = 0;
+    uint64_t queueDelayUs = 0;
+  };
+  std::map<uint64_t, ClientUploadStats> getClientUploadStats();
 
 private:
+  static constexpr int kReceiveBatch = 256;
+  static constexpr int kMaxDrainRounds = 8;
+  static constexpr std::chrono::seconds kReconcileInterval{1};
+  static constexpr std::chrono::milliseconds kReclaimInterval{100};
+
   void startAsyncPoll();
+  void reconcileConnections();
+  // Both run with managersMutex_ held. A client picks up a detached
+  // session to the same peer; a host matches the token in the first
+  // message's Hello against the sessions it has.
+  std::shared_ptr<MultiplexManager>
+  createManagerLocked(HSteamNetConnection conn);
+  std::shared_ptr<MultiplexManager>
+  managerForIncoming(HSteamNetConnection conn,
+                     const ISteamNetworkingMessage *first);
+  // Moves managers whose connection is gone to detached_, and closes
+  // detached ones that were not resumed in time.
+  void detachDeadManagers();
+  using ManagerMap =
+      std::map<HSteamNetConnection, std::shared_ptr<MultiplexManager>>;
+  // Both run with managersMutex_ held. Unbinding keeps a resumable session
+  // in detached_ and retires any other; retiring closes the session and
+  // frees the manager once it has drained.
+  ManagerMap::iterator unbindManagerLocked(ManagerMap::iterator it,
+                                           std::chrono::steady_clock::time_point now);
+  void retireLocked(std::shared_ptr<MultiplexManager> manager);
+  // Runs on the manager's context, holding the last reference. Static: the
+  // timer can outlive the handler when that context is the shared one.
+  static void reclaimWhenDrained(std::shared_ptr<MultiplexManager> manager,
+                                 std::shared_ptr<boost::asio::steady_timer> timer);
+  uint64_t peerOf(HSteamNetConnection conn) const;
+  void updateSendRates(std::chrono::steady_clock::time_point now);
 
   boost::asio::io_context &io_context_;
   ISteamNetworkingSockets *m_pInterface_;
+  ISteamNetworkingUtils *m_pUtils_; // null: SteamNetworkingUtils()
   std::vector<HSteamNetConnection> &connections_;
   std::mutex &connectionsMutex_;
   bool &g_isHost_;
   int &localPort_;
 
-  std::map<HSteamNetConnection, std::shared_ptr<MultiplexManager>>
-      multiplexManagers_;
+  // Host managers refer to it; it outlives them.
+  UploadScheduler uploadScheduler_;
+  // Declared before the managers: their sockets and timers must be
+  // destroyed while the contexts they belong to still exist.
+  std::unique_ptr<IoContextPool> workers_;
+  ManagerMap multiplexManagers_;
+  std::map<HSteamNetConnection, uint64_t> managerPeers_; // remote SteamID
+  struct Detached {
+    std::shared_ptr<MultiplexManager> manager;
+    uint64_t peer = 0;
+    std::chrono::steady_clock::time_point since;
+  };
+  std::vector<Detached> detached_;
+  // Closed managers not yet freed, for the gauge.
+  std::vector<std::weak_ptr<MultiplexManager>> reclaiming_;
+  uint64_t retiredStreamsReaped_ = 0;
+  std::vector<tunnel::TunnelService> services_;
+  TransportProfile profile_;
+  std::mutex managersMutex_; // guards the managers, services_ and profile_
 
   std::unique_ptr<boost::asio::steady_timer> timer_;
   bool running_;
-  int currentPollInterval_; // 当前轮询间隔（毫秒）
+
+  // Poll group state; io_context thread only.
+  HSteamNetPollGroup pollGroup_ = k_HSteamNetPollGroup_Invalid;
+  std::set<HSteamNetConnection> grouped_;
+  // Receive-blocked connections, taken out of the group so Steam holds
+  // their messages until the manager catches up.
+  std::map<HSteamNetConnection, std::shared_ptr<MultiplexManager>> parked_;
+  std::chrono::steady_clock::time_point lastReconcile_;
+  std::chrono::steady_clock::time_point lastMessageAt_;
+  SendRateController rateController_;
+  std::chrono::steady_clock::time_point lastRateUpdate_;
+  std::atomic<int64_t> latencyBudgetUs_{1000};
+  std::atomic<int64_t> spinWindowUs_{100};
+
+  std::atomic<uint64_t> polls_{0};
+  std::atomic<uint64_t> messagesReceived_{0};
+  std::atomic<uint64_t> spinPolls_{0};
+  std::atomic<uint64_t> idleWaits_{0};
+  std::atomic<int> maxBatch_{0};
+  std::atomic<std::size_t> parkedCount_{0};
 };
 
 #endif // STEAM_MESSAGE_HANDLER_H
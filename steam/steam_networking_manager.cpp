@@ -54,24 +54,11 @@ bool SteamNetworkingManager::initialize() {
       k_ESteamNetworkingConfig_Global, 0, k_ESteamNetworkingConfig_Int32,
       &logLevel);
 
-  // Increase default reliable send buffer to better handle large bursts
-  int32 sendBufferSize = 2 * 1024 * 1024;
-  SteamNetworkingUtils()->SetConfigValue(
-      k_ESteamNetworkingConfig_SendBufferSize, k_ESteamNetworkingConfig_Global,
-      0, k_ESteamNetworkingConfig_Int32, &sendBufferSize);
+  // Send/receive buffers and Nagle come from the transport profile.
+  transportProfile_.applyToSteam(SteamNetworkingUtils());
 
-  // Receive buffers tuned for moderate bandwidth to avoid runaway queues
-  int32 recvBufferSize = 2 * 1024 * 1024; // 2 MB
-  SteamNetworkingUtils()->SetConfigValue(
-      k_ESteamNetworkingConfig_RecvBufferSize, k_ESteamNetworkingConfig_Global,
-      0, k_ESteamNetworkingConfig_Int32, &recvBufferSize);
-  int32 recvBufferMsgs = 2048;
-  SteamNetworkingUtils()->SetConfigValue(
-      k_ESteamNetworkingConfig_RecvBufferMessages,
-      k_ESteamNetworkingConfig_Global, 0, k_ESteamNetworkingConfig_Int32,
-      &recvBufferMsgs);
-
-  // Cap send rate to a conservative value to keep reliable window stable
+  // Starting send rate; TCP-mode connections are then retuned one by one by
+  // the message handler's SendRateController.
   int32 sendRate = 1024 * 1024; // ~1000 KB/s
   SteamNetworkingUtils()->SetConfigValue(
       k_ESteamNetworkingConfig_SendRateMin, k_ESteamNetworkingConfig_Global, 0,
@@ -93,17 +80,12 @@ bool SteamNetworkingManager::initialize() {
       k_ESteamNetworkingConfig_Global, 0, k_ESteamNetworkingConfig_Int32,
       &icePenaltyDefault);
 
-  // Disable Nagle to reduce latency for tunneled traffic
-  int32 nagleTime = 0;
-  SteamNetworkingUtils()->SetConfigValue(
-      k_ESteamNetworkingConfig_NagleTime, k_ESteamNetworkingConfig_Global, 0,
-      k_ESteamNetworkingConfig_Int32, &nagleTime);
-
-  std::cout << "[SteamNet] SendBuffer=" << (sendBufferSize / 1024 / 1024)
-            << "MB, SendRate=" << (sendRate / 1024 / 1024)
-            << "MB/s, RecvBuffer=" << (recvBufferSize / 1024 / 1024)
-            << "MB, RecvMsgs=" << recvBufferMsgs << ", Nagle=" << nagleTime
-            << std::endl;
+  std::cout << "[SteamNet] Profile=" << transportProfile_.name()
+            << ", SendBuffer=" << (transportProfile_.sendBufferBytes / 1024)
+            << "KB, SendRate=" << (sendRate / 1024 / 1024)
+            << "MB/s, RecvBuffer=" << (transportProfile_.recvBufferBytes / 1024)
+            << "KB, RecvMsgs=" << transportProfile_.recvBufferMessages
+            << ", Nagle=" << transportProfile_.nagleTimeUs << std::endl;
 
   // 1. 允许 P2P (ICE) 直连
   // 默认情况下 Steam 可能会保守地只允许 LAN，这里设置为 "All" 允许公网 P2P
@@ -151,6 +133,7 @@ void SteamNetworkingManager::shutdown() {
   if (hListenSock != k_HSteamListenSocket_Invalid) {
     m_pInterface->CloseListenSocket(hListenSock);
   }
+  closeStripeListeners();
   SteamAPI_Shutdown();
 }
 
@@ -173,8 +156,33 @@ bool SteamNetworkingManager::connectToHostInternal(
       g_isConnected = false;
       hostPing_ = 0;
     }
+    closeStripeConnections();
+    relayOnly_ = relayOnly;
   }
 
+  g_hConnection = connectP2P(hostSteamID, 0, relayOnly);
+
+  if (g_hConnection != k_HSteamNetConnection_Invalid) {
+    connectAttemptStart_ = std::chrono::steady_clock::now();
+    std::cout << "Attempting to connect to host "
+              << hostSteamID.ConvertToUint64() << " with virtual port " << 0;
+    if (relayOnly) {
+      std::cout << " (relay only)";
+    }
+    std::cout << std::endl;
+    return true;
+  }
+
+  std::cerr << "Failed to initiate connection";
+  if (relayOnly) {
+    std::cerr << " via relay";
+  }
+  std::cerr << std::endl;
+  return false;
+}
+
+HSteamNetConnection SteamNetworkingManager::connectP2P(
+    const CSteamID &hostSteamID, int virtualPort, bool relayOnly) {
   SteamNetworkingIdentity identity;
   identity.SetSteamID(hostSteamID);
 
@@ -193,26 +201,105 @@ bool SteamNetworkingManager::connectToHostInternal(
     ++optionCount;
   }
 
-  g_hConnection = m_pInterface->ConnectP2P(
-      identity, 0, optionCount, optionCount > 0 ? options : nullptr);
+  return m_pInterface->ConnectP2P(identity, virtualPort, optionCount,
+                                  optionCount > 0 ? options : nullptr);
+}
 
-  if (g_hConnection != k_HSteamNetConnection_Invalid) {
-    connectAttemptStart_ = std::chrono::steady_clock::now();
-    std::cout << "Attempting to connect to host "
-              << hostSteamID.ConvertToUint64() << " with virtual port " << 0;
-    if (relayOnly) {
-      std::cout << " (relay only)";
+void SteamNetworkingManager::setStripeCount(int count) {
+  stripeCount_.store(std::clamp(count, 1, kMaxStripes));
+}
+
+void SteamNetworkingManager::openStripeListeners() {
+  std::lock_guard<std::mutex> lock(connectionsMutex);
+  for (int port = static_cast<int>(stripeListenSocks_.size()) + 1;
+       port < kMaxStripes; ++port) {
+    const HSteamListenSocket sock =
+        m_pInterface->CreateListenSocketP2P(port, 0, nullptr);
+    if (sock == k_HSteamListenSocket_Invalid) {
+      std::cerr << "[SteamNet] Failed to listen on stripe port " << port
+                << std::endl;
+      break;
     }
-    std::cout << std::endl;
-    return true;
+    stripeListenSocks_.push_back(sock);
   }
+}
 
-  std::cerr << "Failed to initiate connection";
-  if (relayOnly) {
-    std::cerr << " via relay";
+void SteamNetworkingManager::closeStripeListeners() {
+  std::lock_guard<std::mutex> lock(connectionsMutex);
+  for (auto sock : stripeListenSocks_) {
+    m_pInterface->CloseListenSocket(sock);
   }
-  std::cerr << std::endl;
-  return false;
+  stripeListenSocks_.clear();
+}
+
+void SteamNetworkingManager::openStripeConnections() {
+  const int count = stripeCount_.load();
+  for (int port = 1; port < count; ++port) {
+    const bool open =
+        std::any_of(stripePorts_.begin(), stripePorts_.end(),
+                    [port](const auto &entry) { return entry.second == port; });
+    if (open) {
+      continue;
+    }
+    const HSteamNetConnection conn = connectP2P(g_hostSteamID, port, relayOnly_);
+    if (conn == k_HSteamNetConnection_Invalid) {
+      std::cerr << "[SteamNet] Failed to open stripe connection on port "
+                << port << std::endl;
+      continue;
+    }
+    stripePorts_[conn] = port;
+    std::cout << "[SteamNet] Opening stripe connection on virtual port "
+              << port << std::endl;
+  }
+}
+
+void SteamNetworkingManager::closeStripeConnections() {
+  for (const auto &entry : stripePorts_) {
+    m_pInterface->CloseConnection(entry.first, 0, "Stripe closed", false);
+    connections.erase(
+        std::remove(connections.begin(), connections.end(), entry.first),
+        connections.end());
+  }
+  stripePorts_.clear();
+  stripesUp_.clear();
+}
+
+int SteamNetworkingManager::virtualPortOf(HSteamNetConnection conn) const {
+  auto it = stripePorts_.find(conn);
+  return it != stripePorts_.end() ? it->second : 0;
+}
+
+HSteamNetConnection SteamNetworkingManager::connectionForNewStream() {
+  std::vector<HSteamNetConnection> candidates;
+  std::size_t rotation = 0;
+  {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    if (g_hConnection == k_HSteamNetConnection_Invalid) {
+      return g_hConnection;
+    }
+    candidates.push_back(g_hConnection);
+    if (g_isClient) {
+      candidates.insert(candidates.end(), stripesUp_.begin(), stripesUp_.end());
+    }
+    rotation = nextStripe_++;
+  }
+  if (candidates.size() == 1 || !messageHandler_) {
+    return candidates.front();
+  }
+  // Fewest active streams wins; ties rotate so idle stripes fill evenly.
+  HSteamNetConnection best = candidates.front();
+  std::size_t bestStreams = std::numeric_limits<std::size_t>::max();
+  for (std::size_t i = 0; i < candidates.size(); ++i) {
+    const HSteamNetConnection conn =
+        candidates[(rotation + i) % candidates.size()];
+    const std::size_t streams =
+        messageHandler_->getMultiplexManager(conn)->activeStreamCount();
+    if (streams < bestStreams) {
+      best = conn;
+      bestStreams = streams;
+    }
+  }
+  return best;
 }
 
 bool SteamNetworkingManager::joinHost(uint64 hostID) {
@@ -242,12 +329,21 @@ void SteamNetworkingManager::disconnect() {
     m_pInterface->CloseConnection(conn, 0, nullptr, false);
   }
   connections.clear();
+  if (messageHandler_) {
+    messageHandler_->dropSessions();
+  }
 
   // Close listen socket
   if (hListenSock != k_HSteamListenSocket_Invalid) {
     m_pInterface->CloseListenSocket(hListenSock);
     hListenSock = k_HSteamListenSocket_Invalid;
   }
+  for (auto sock : stripeListenSocks_) {
+    m_pInterface->CloseListenSocket(sock);
+  }
+  stripeListenSocks_.clear();
+  stripePorts_.clear();
+  stripesUp_.clear();
 
   // Reset state
   g_isHost = false;
@@ -280,6 +376,7 @@ void SteamNetworkingManager::closeConnectionToPeer(const CSteamID &peer) {
       g_hConnection = k_HSteamNetConnection_Invalid;
       g_isConnected = false;
       hostPing_ = 0;
+      closeStripeConnections();
     }
   }
 
@@ -291,6 +388,8 @@ void SteamNetworkingManager::closeConnectionToPeer(const CSteamID &peer) {
       std::cout << "[SteamNet] Closing host connection to peer "
                 << peer.ConvertToUint64() << std::endl;
       m_pInterface->CloseConnection(*it, 0, nullptr, false);
+      stripePorts_.erase(*it);
+      stripesUp_.erase(*it);
       it = connections.erase(it);
       continue;
     }
@@ -307,7 +406,51 @@ void SteamNetworkingManager::setMessageHandlerDependencies(
   localBindPort_ = &localBindPort;
   messageHandler_ =
       new SteamMessageHandler(io_context, m_pInterface, connections,
-                              connectionsMutex, g_isHost, localPort);
+                              connectionsMutex, g_isHost, localPort,
+                              workerThreads_);
+  messageHandler_->setServices(getServices());
+  messageHandler_->setTransportProfile(transportProfile_);
+}
+
+void SteamNetworkingManager::setTransportProfile(
+    const TransportProfile &profile) {
+  transportProfile_ = profile;
+  if (m_pInterface) {
+    std::set<HSteamNetConnection> live;
+    {
+      std::lock_guard<std::mutex> lock(connectionsMutex);
+      live.insert(connections.begin(), connections.end());
+      for (const auto &entry : stripePorts_) {
+        live.insert(entry.first);
+      }
+      if (g_hConnection != k_HSteamNetConnection_Invalid) {
+        live.insert(g_hConnection);
+      }
+    }
+    profile.applyToSteam(SteamNetworkingUtils(),
+                         {live.begin(), live.end()});
+  }
+  if (messageHandler_) {
+    messageHandler_->setTransportProfile(profile);
+  }
+  std::cout << "[SteamNet] Transport profile: " << profile.name()
+            << std::endl;
+}
+
+void SteamNetworkingManager::setServices(
+    const std::vector<tunnel::TunnelService> &services) {
+  {
+    std::lock_guard<std::mutex> lock(servicesMutex_);
+    services_ = services;
+  }
+  if (messageHandler_) {
+    messageHandler_->setServices(services);
+  }
+}
+
+std::vector<tunnel::TunnelService> SteamNetworkingManager::getServices() const {
+  std::lock_guard<std::mutex> lock(servicesMutex_);
+  return services_;
 }
 
 void SteamNetworkingManager::startMessageHandler() {
@@ -553,23 +696,38 @@ void SteamNetworkingManager::handleConnectionStatusChanged(
                     std::strstr(debug, "Timed out attempting to connect") !=
                         nullptr);
 
-      if (g_isClient && !relayFallbackTried_ && g_hostSteamID.IsValid() &&
+      // A failed stripe is dropped on its own; only the primary connection
+      // drives the relay fallback and the lobby timeout.
+      const bool stripe = stripePorts_.count(pInfo->m_hConn) != 0;
+      if (!stripe && g_isClient && !relayFallbackTried_ &&
+          g_hostSteamID.IsValid() &&
           (failedWhileConnecting || endToEndTimeout || natTraversalFailed)) {
         relayFallbackPending_ = true;
         std::cout << "[SteamNet] Queued relay-only retry after ICE failure"
                   << std::endl;
-      } else if (g_isClient && timedOutConnecting) {
+      } else if (!stripe && g_isClient && timedOutConnecting) {
         leaveLobby = true;
       }
     }
     if (pInfo->m_eOldState == k_ESteamNetworkingConnectionState_None &&
         pInfo->m_info.m_eState == k_ESteamNetworkingConnectionState_Connecting) {
+      // Stripes accepted by a host are recognised by their listen socket.
+      int virtualPort = virtualPortOf(pInfo->m_hConn);
+      auto stripeListener =
+          std::find(stripeListenSocks_.begin(), stripeListenSocks_.end(),
+                    pInfo->m_info.m_hListenSocket);
+      if (virtualPort == 0 && stripeListener != stripeListenSocks_.end()) {
+        virtualPort =
+            static_cast<int>(stripeListener - stripeListenSocks_.begin()) + 1;
+        stripePorts_[pInfo->m_hConn] = virtualPort;
+      }
       // Proactively close duplicate connections to the same peer to avoid
-      // Steam's internal "Duplicate P2P connection" assertion.
+      // Steam's internal "Duplicate P2P connection" assertion. Only the same
+      // virtual port counts: stripes to one peer are not duplicates.
       CSteamID peer = pInfo->m_info.m_identityRemote.GetSteamID();
       if (peer.IsValid()) {
         for (auto it = connections.begin(); it != connections.end();) {
-          if (*it == pInfo->m_hConn) {
+          if (*it == pInfo->m_hConn || virtualPortOf(*it) != virtualPort) {
             ++it;
             continue;
           }
@@ -581,13 +739,18 @@ void SteamNetworkingManager::handleConnectionStatusChanged(
             m_pInterface->CloseConnection(*it, 0,
                                           "Replace duplicate connection",
                                           false);
+            if (messageHandler_) {
+              messageHandler_->connectionClosed(*it);
+            }
+            stripePorts_.erase(*it);
+            stripesUp_.erase(*it);
             it = connections.erase(it);
             continue;
           }
           ++it;
         }
 
-        if (g_hConnection != k_HSteamNetConnection_Invalid &&
+        if (virtualPort == 0 && g_hConnection != k_HSteamNetConnection_Invalid &&
             g_hConnection != pInfo->m_hConn) {
           SteamNetConnectionInfo_t info;
           if (m_pInterface->GetConnectionInfo(g_hConnection, &info) &&
@@ -596,6 +759,9 @@ void SteamNetworkingManager::handleConnectionStatusChanged(
                       << peer.ConvertToUint64() << std::endl;
             m_pInterface->CloseConnection(
                 g_hConnection, 0, "Replace duplicate connection", false);
+            if (messageHandler_) {
+              messageHandler_->connectionClosed(g_hConnection);
+            }
             g_hConnection = k_HSteamNetConnection_Invalid;
             g_isConnected = false;
             hostPing_ = 0;
@@ -605,8 +771,13 @@ void SteamNetworkingManager::handleConnectionStatusChanged(
 
       m_pInterface->AcceptConnection(pInfo->m_hConn);
       connections.push_back(pInfo->m_hConn);
-      g_hConnection = pInfo->m_hConn;
-      g_isConnected = true;
+      if (messageHandler_) {
+        messageHandler_->addConnection(pInfo->m_hConn);
+      }
+      if (virtualPort == 0) {
+        g_hConnection = pInfo->m_hConn;
+        g_isConnected = true;
+      }
       std::cout << "Accepted incoming connection from "
                 << pInfo->m_info.m_identityRemote.GetSteamID().ConvertToUint64()
                 << std::endl;
@@ -620,12 +791,31 @@ void SteamNetworkingManager::handleConnectionStatusChanged(
                   << "ms, relay=" << (info.m_idPOPRelay != 0 ? "yes" : "no")
                   << std::endl;
       }
+    } else if (pInfo->m_eOldState ==
+                   k_ESteamNetworkingConnectionState_Connecting &&
+               pInfo->m_info.m_eState ==
+                   k_ESteamNetworkingConnectionState_Connected &&
+               stripePorts_.count(pInfo->m_hConn)) {
+      stripesUp_.insert(pInfo->m_hConn);
+      std::cout << "[SteamNet] Stripe connection on virtual port "
+                << stripePorts_[pInfo->m_hConn] << " connected" << std::endl;
+      if (g_isClient && messageHandler_) {
+        messageHandler_->getMultiplexManager(pInfo->m_hConn);
+      }
     } else if (pInfo->m_eOldState ==
                    k_ESteamNetworkingConnectionState_Connecting &&
                pInfo->m_info.m_eState ==
                    k_ESteamNetworkingConnectionState_Connected) {
       g_isConnected = true;
       std::cout << "Connected to host" << std::endl;
+      if (g_isClient && pInfo->m_hConn == g_hConnection) {
+        openStripeConnections();
+      }
+      if (g_isClient && messageHandler_) {
+        // Created now so a session from a lost connection resumes without
+        // waiting for the next local client.
+        messageHandler_->getMultiplexManager(pInfo->m_hConn);
+      }
       // Log connection info
       SteamNetConnectionInfo_t info;
       SteamNetConnectionRealTimeStatus_t status;
@@ -637,10 +827,35 @@ void SteamNetworkingManager::handleConnectionStatusChanged(
                   << "ms, relay=" << (info.m_idPOPRelay != 0 ? "yes" : "no")
                   << std::endl;
       }
+    } else if ((pInfo->m_info.m_eState ==
+                    k_ESteamNetworkingConnectionState_ClosedByPeer ||
+                pInfo->m_info.m_eState ==
+                    k_ESteamNetworkingConnectionState_ProblemDetectedLocally) &&
+               stripePorts_.count(pInfo->m_hConn)) {
+      // A lost stripe only takes its own streams down.
+      std::cout << "[SteamNet] Stripe connection on virtual port "
+                << stripePorts_[pInfo->m_hConn] << " closed" << std::endl;
+      m_pInterface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
+      if (messageHandler_) {
+        messageHandler_->connectionClosed(pInfo->m_hConn);
+      }
+      stripePorts_.erase(pInfo->m_hConn);
+      stripesUp_.erase(pInfo->m_hConn);
+      connections.erase(std::remove(connections.begin(), connections.end(),
+                                    pInfo->m_hConn),
+                        connections.end());
     } else if (pInfo->m_info.m_eState ==
                    k_ESteamNetworkingConnectionState_ClosedByPeer ||
                pInfo->m_info.m_eState ==
                    k_ESteamNetworkingConnectionState_ProblemDetectedLocally) {
+      if (g_isClient && pInfo->m_hConn == g_hConnection) {
+        closeStripeConnections();
+      }
+      // Frees Steam's handle; the tunnel session is detached or reclaimed.
+      m_pInterface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
+      if (messageHandler_) {
+        messageHandler_->connectionClosed(pInfo->m_hConn);
+      }
       g_isConnected = false;
       g_hConnection = k_HSteamNetConnection_Invalid;
       connectAttemptStart_ = {};
@@ -4,11 +4,13 @@
 #include "steam_message_handler.h"
 #include <isteamnetworkingsockets.h>
 #include <isteamnetworkingutils.h>
+#include <atomic>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <chrono>
 #include <steam_api.h>
+#include <set>
 #include <steamnetworkingtypes.h>
 #include <vector>
 
@@ -65,6 +67,9 @@ public:
   ISteamNetworkingSockets *getInterface() { return m_pInterface; }
   bool &getIsHost() { return g_isHost; }
 
+  // Worker threads for TCP-mode connections; takes effect for the next
+  // setMessageHandlerDependencies. 0 runs everything on io_context.
+  void setWorkerThreads(std::size_t threads) { workerThreads_ = threads; }
   void setMessageHandlerDependencies(boost::asio::io_context &io_context,
                                      std::unique_ptr<TCPServer> &server,
                                      int &localPort, int &localBindPort);
@@ -74,6 +79,30 @@ public:
   void stopMessageHandler();
   SteamMessageHandler *getMessageHandler() { return messageHandler_; }
 
+  // Named services forwarded alongside the default port (see TunnelService).
+  void setServices(const std::vector<tunnel::TunnelService> &services);
+  std::vector<tunnel::TunnelService> getServices() const;
+
+  // Applies the profile to Steam, the message handler and its managers;
+  // takes effect on live connections.
+  void setTransportProfile(const TransportProfile &profile);
+  const TransportProfile &getTransportProfile() const {
+    return transportProfile_;
+  }
+
+  // Opt-in striping: a client opens `count` connections to the host, on
+  // virtual ports 0..count-1, each with its own congestion window and send
+  // rate, and spreads new tunnel streams across them. Hosts always accept
+  // the extra ports. Takes effect on the next join; 1 disables.
+  static constexpr int kMaxStripes = 4;
+  void setStripeCount(int count);
+  int getStripeCount() const { return stripeCount_; }
+  void openStripeListeners();
+  void closeStripeListeners();
+  // Connection a new local stream should ride on: the connected stripe
+  // carrying the fewest streams, or the primary connection.
+  HSteamNetConnection connectionForNewStream();
+
   // Update user info (ping, relay status)
   void update();
 
@@ -83,6 +112,12 @@ public:
 
 private:
   bool connectToHostInternal(const CSteamID &hostSteamID, bool relayOnly);
+  HSteamNetConnection connectP2P(const CSteamID &hostSteamID, int virtualPort,
+                                 bool relayOnly);
+  // Called with connectionsMutex held.
+  void openStripeConnections();
+  void closeStripeConnections();
+  int virtualPortOf(HSteamNetConnection conn) const;
 
   // Steam API
   ISteamNetworkingSockets *m_pInterface;
@@ -112,6 +147,18 @@ private:
   int *localBindPort_;
   SteamMessageHandler *messageHandler_;
   SteamRoomManager *roomManager_;
+  std::vector<tunnel::TunnelService> services_;
+  mutable std::mutex servicesMutex_;
+  std::size_t workerThreads_ = IoContextPool::defaultSize();
+  TransportProfile transportProfile_;
+
+  // Striping; guarded by connectionsMutex.
+  std::atomic<int> stripeCount_{1};
+  bool relayOnly_ = false; // transport of the current primary connection
+  std::map<HSteamNetConnection, int> stripePorts_; // stripe -> virtual port
+  std::set<HSteamNetConnection> stripesUp_;        // stripes now connected
+  std::vector<HSteamListenSocket> stripeListenSocks_; // ports 1..kMaxStripes-1
+  std::size_t nextStripe_ = 0;
 
   bool relayFallbackPending_;
   bool relayFallbackTried_;
@@ -14,6 +14,7 @@ constexpr const char *kLobbyKeyHostId = "ct_host_id";
 constexpr const char *kLobbyKeyPingLocation = "ct_ping_loc";
 constexpr const char *kLobbyKeyTag = "ct_tag";
 constexpr const char *kLobbyKeyPinned = "ct_pin";
+constexpr const char *kLobbyKeyProfile = "ct_profile";
 constexpr const char *kLobbyTagValue = "1";
 constexpr const char *kPingPrefix = "PING|";
 constexpr const char *kLobbyModeTun = "tun";
@@ -247,6 +248,7 @@ void SteamMatchmakingCallbacks::OnLobbyDataUpdate(
   }
 
   roomManager_->notifyPinnedMessageChanged(lobby);
+  roomManager_->notifyTransportProfile(lobby);
 }
 
 void SteamMatchmakingCallbacks::OnLobbyEntered(LobbyEnter_t *pCallback) {
@@ -276,6 +278,7 @@ void SteamMatchmakingCallbacks::OnLobbyEntered(LobbyEnter_t *pCallback) {
 
     roomManager_->notifyPinnedMessageChanged(
         roomManager_->getCurrentLobby());
+    roomManager_->notifyTransportProfile(roomManager_->getCurrentLobby());
 
     if (roomManager_->vpnMode_) {
       const CSteamID hostID =
@@ -409,6 +412,11 @@ void SteamRoomManager::setPinnedMessageChangedCallback(
   pinnedMessageChangedCallback_ = std::move(callback);
 }
 
+void SteamRoomManager::setTransportProfileCallback(
+    std::function<void(const std::string &)> callback) {
+  transportProfileCallback_ = std::move(callback);
+}
+
 void SteamRoomManager::setPinnedMessageData(const std::string &data) {
   if (currentLobby == k_steamIDNil || !SteamMatchmaking()) {
     return;
@@ -505,6 +513,9 @@ bool SteamRoomManager::startHosting() {
 
   if (networkingManager_->getListenSock() != k_HSteamListenSocket_Invalid) {
     networkingManager_->getIsHost() = true;
+    // Clients choose how many parallel connections to open; the host just
+    // accepts them.
+    networkingManager_->openStripeListeners();
     std::cout << "Created listen socket for hosting game room" << std::endl;
     return true;
   } else {
@@ -520,6 +531,7 @@ void SteamRoomManager::stopHosting() {
         networkingManager_->getListenSock());
     networkingManager_->getListenSock() = k_HSteamListenSocket_Invalid;
   }
+  networkingManager_->closeStripeListeners();
   leaveLobby();
   networkingManager_->getIsHost() = false;
 }
@@ -641,6 +653,10 @@ void SteamRoomManager::refreshLobbyMetadata() {
   const bool wantsTun = advertisedWantsTun_;
   SteamMatchmaking()->SetLobbyData(currentLobby, kLobbyKeyMode,
                                    wantsTun ? kLobbyModeTun : kLobbyModeTcp);
+  if (!advertisedProfile_.empty()) {
+    SteamMatchmaking()->SetLobbyData(currentLobby, kLobbyKeyProfile,
+                                     advertisedProfile_.c_str());
+  }
 }
 
 void SteamRoomManager::decideTransportForCurrentLobby() {
@@ -790,6 +806,17 @@ void SteamRoomManager::notifyPinnedMessageChanged(const CSteamID &lobby) {
   pinnedMessageChangedCallback_(getPinnedMessageData(lobby));
 }
 
+void SteamRoomManager::notifyTransportProfile(const CSteamID &lobby) {
+  if (!transportProfileCallback_ || !SteamMatchmaking()) {
+    return;
+  }
+  const char *profile =
+      SteamMatchmaking()->GetLobbyData(lobby, kLobbyKeyProfile);
+  if (profile && profile[0] != '\0') {
+    transportProfileCallback_(profile);
+  }
+}
+
 std::string
 SteamRoomManager::getPinnedMessageData(const CSteamID &lobby) const {
   if (!SteamMatchmaking() || !lobby.IsValid()) {
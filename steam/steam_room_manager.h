@@ -75,6 +75,10 @@ public:
   void stopHosting();
   void setLobbyName(const std::string &name);
   void setAdvertisedMode(bool wantsTun) { advertisedWantsTun_ = wantsTun; }
+  // Transport profile name published with the lobby; members follow it.
+  void setAdvertisedProfile(const std::string &name) {
+    advertisedProfile_ = name;
+  }
   void setPublishLobby(bool publish);
   std::string getLobbyName() const;
   void setLobbyListCallback(
@@ -103,6 +107,8 @@ public:
       std::function<void(const CSteamID &lobby)> callback);
   void setPinnedMessageChangedCallback(
       std::function<void(const std::string &)> callback);
+  void setTransportProfileCallback(
+      std::function<void(const std::string &)> callback);
   void setPinnedMessageData(const std::string &data);
   void clearPinnedMessageData();
 
@@ -117,6 +123,7 @@ private:
   void handleChatMessage(const CSteamID &sender, const std::string &payload);
   bool lobbyWantsTun(CSteamID lobby) const;
   void notifyPinnedMessageChanged(const CSteamID &lobby);
+  void notifyTransportProfile(const CSteamID &lobby);
   std::string getPinnedMessageData(const CSteamID &lobby) const;
 
   SteamNetworkingManager *networkingManager_;
@@ -130,6 +137,7 @@ private:
   std::string lobbyName_;
   bool publishLobby_ = true;
   bool advertisedWantsTun_ = false;
+  std::string advertisedProfile_;
   struct PingInfo {
     int ping = -1;
     std::string relay;
@@ -144,4 +152,5 @@ private:
   std::function<void(const CSteamID &, const std::string &)>
       chatMessageCallback_;
   std::function<void(const std::string &)> pinnedMessageChangedCallback_;
+  std::function<void(const std::string &)> transportProfileCallback_;
 };
@@ -24,21 +24,8 @@ bool SteamVpnNetworkingManager::initialize() {
     return false;
   }
 
-  // Align bandwidth/Nagle settings with the Qt TCP mode defaults
-  int32 sendBufferSize = 2 * 1024 * 1024;
-  SteamNetworkingUtils()->SetConfigValue(
-      k_ESteamNetworkingConfig_SendBufferSize, k_ESteamNetworkingConfig_Global,
-      0, k_ESteamNetworkingConfig_Int32, &sendBufferSize);
-
-  int32 recvBufferSize = 2 * 1024 * 1024;
-  SteamNetworkingUtils()->SetConfigValue(
-      k_ESteamNetworkingConfig_RecvBufferSize, k_ESteamNetworkingConfig_Global,
-      0, k_ESteamNetworkingConfig_Int32, &recvBufferSize);
-  int32 recvBufferMsgs = 2048;
-  SteamNetworkingUtils()->SetConfigValue(
-      k_ESteamNetworkingConfig_RecvBufferMessages,
-      k_ESteamNetworkingConfig_Global, 0, k_ESteamNetworkingConfig_Int32,
-      &recvBufferMsgs);
+  // Buffers and Nagle follow the same transport profile as TCP mode
+  transportProfile_.applyToSteam(SteamNetworkingUtils());
 
   int32 sendRate = 1024 * 1024;
   SteamNetworkingUtils()->SetConfigValue(
@@ -48,11 +35,6 @@ bool SteamVpnNetworkingManager::initialize() {
       k_ESteamNetworkingConfig_SendRateMax, k_ESteamNetworkingConfig_Global, 0,
       k_ESteamNetworkingConfig_Int32, &sendRate);
 
-  int32 nagleTime = 0;
-  SteamNetworkingUtils()->SetConfigValue(
-      k_ESteamNetworkingConfig_NagleTime, k_ESteamNetworkingConfig_Global, 0,
-      k_ESteamNetworkingConfig_Int32, &nagleTime);
-
   int32 nIceEnable = k_nSteamNetworkingConfig_P2P_Transport_ICE_Enable_Public |
                      k_nSteamNetworkingConfig_P2P_Transport_ICE_Enable_Private;
   SteamNetworkingUtils()->SetConfigValue(
@@ -76,9 +58,24 @@ bool SteamVpnNetworkingManager::initialize() {
   }
 
   messageHandler_ = new VpnMessageHandler(messagesInterface_, this);
+  messageHandler_->setPollIntervals(transportProfile_.vpnMinPollInterval,
+                                    transportProfile_.vpnMaxPollInterval);
   return true;
 }
 
+void SteamVpnNetworkingManager::setTransportProfile(
+    const TransportProfile &profile) {
+  transportProfile_ = profile;
+  if (messagesInterface_) {
+    // ISteamNetworkingMessages sessions take the global values.
+    profile.applyToSteam(SteamNetworkingUtils());
+  }
+  if (messageHandler_) {
+    messageHandler_->setPollIntervals(profile.vpnMinPollInterval,
+                                      profile.vpnMaxPollInterval);
+  }
+}
+
 void SteamVpnNetworkingManager::shutdown() {
   {
     std::lock_guard<std::mutex> lock(peersMutex_);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../net/transport_profile.h"
 #include <mutex>
 #include <set>
 #include <steam_api.h>
@@ -37,6 +38,9 @@ public:
   void startMessageHandler();
   void stopMessageHandler();
 
+  // Steam buffers, Nagle and the poll interval range; applies at once.
+  void setTransportProfile(const TransportProfile &profile);
+
   void setVpnBridge(SteamVpnBridge *vpnBridge) { vpnBridge_ = vpnBridge; }
   SteamVpnBridge *getVpnBridge() { return vpnBridge_; }
 
@@ -54,6 +58,7 @@ private:
   VpnMessageHandler *messageHandler_;
   SteamVpnBridge *vpnBridge_;
   CSteamID hostSteamID_;
+  TransportProfile transportProfile_;
 
   STEAM_CALLBACK(SteamVpnNetworkingManager, OnSessionRequest,
                  SteamNetworkingMessagesSessionRequest_t);
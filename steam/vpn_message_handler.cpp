@@ -22,6 +22,13 @@ void VpnMessageHandler::setIoContext(boost::asio::io_context *externalContext) {
   }
 }
 
+void VpnMessageHandler::setPollIntervals(std::chrono::microseconds min,
+                                         std::chrono::microseconds max) {
+  min = std::max(min, std::chrono::microseconds{1});
+  minPollIntervalUs_.store(min.count());
+  maxPollIntervalUs_.store(std::max(max, min).count());
+}
+
 void VpnMessageHandler::start() {
   if (running_) {
     return;
@@ -113,10 +120,12 @@ void VpnMessageHandler::pollMessages() {
     }
     msg->Release();
   }
+  const std::chrono::microseconds minInterval{minPollIntervalUs_.load()};
+  const std::chrono::microseconds maxInterval{maxPollIntervalUs_.load()};
   if (numMsgs > 0) {
-    currentPollInterval_ = MIN_POLL_INTERVAL;
+    currentPollInterval_ = minInterval;
   } else {
-    currentPollInterval_ =
-        std::min(currentPollInterval_ + POLL_INCREMENT, MAX_POLL_INTERVAL);
+    currentPollInterval_ = std::clamp(currentPollInterval_ + POLL_INCREMENT,
+                                      minInterval, maxInterval);
   }
 }
@@ -19,6 +19,9 @@ public:
   void start();
   void stop();
   void setIoContext(boost::asio::io_context *externalContext);
+  // The poll interval backs off from `min` toward `max` while idle.
+  void setPollIntervals(std::chrono::microseconds min,
+                        std::chrono::microseconds max);
 
 private:
   void schedulePoll();
@@ -40,4 +43,6 @@ private:
   static constexpr std::chrono::microseconds MIN_POLL_INTERVAL{100};
   static constexpr std::chrono::microseconds MAX_POLL_INTERVAL{1000};
   static constexpr std::chrono::microseconds POLL_INCREMENT{100};
+  std::atomic<int64_t> minPollIntervalUs_{MIN_POLL_INTERVAL.count()};
+  std::atomic<int64_t> maxPollIntervalUs_{MAX_POLL_INTERVAL.count()};
 };